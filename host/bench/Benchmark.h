@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "FlatJson.h"
+#include "HostShim.h"
+#include "PWMControl.h"
+#include "SettingsManager.h"
+
+// Host benchmark of the hot paths, run against the recording shims. Every
+// case runs a fixed number of iterations on fixed input after a short
+// warm-up and logs one line of percentiles, so two runs on the same
+// machine compare directly:
+//
+//   bench <case> n=<iterations> min=<us> p50=<us> p90=<us> max=<us>
+//
+// Command cases re-apply a channel's own duty, so the output does not move.
+// Apply latency is read off the shim's ledc_update_duty record rather than
+// off the caller's polling, so it does not include the caller's wake-up.
+// Per-command logging is turned down for the run so stdout does not set
+// the pace.
+class Benchmark {
+public:
+    static const int WARMUP = 8;
+
+    Benchmark(PWMControl& pump, SettingsManager& settings, int iterations)
+        : pump(pump), settings(settings), iterations(iterations) {
+    }
+
+    // Number of cases that failed to complete; 0 when every case ran
+    int run() {
+        ESP_LOGI("Benchmark", "Starting, %d iterations per case", iterations);
+        esp_log_level_t pwmLevel = esp_log_level_get("PWMControl");
+        esp_log_level_t settingsLevel = esp_log_level_get("SettingsManager");
+        esp_log_level_t webLevel = esp_log_level_get("LocalWebServer");
+        esp_log_level_set("PWMControl", ESP_LOG_WARN);
+        esp_log_level_set("SettingsManager", ESP_LOG_WARN);
+        esp_log_level_set("LocalWebServer", ESP_LOG_WARN);
+
+        benchSetpoints(0);
+        benchPulses(0);
+        benchEnqueueToApply(0);
+        benchHttpPump(0);
+        benchFlatJson();
+        benchBatchParse();
+        benchSettingsStore();
+        benchSettingsLoad();
+
+        esp_log_level_set("PWMControl", pwmLevel);
+        esp_log_level_set("SettingsManager", settingsLevel);
+        esp_log_level_set("LocalWebServer", webLevel);
+        ESP_LOGI("Benchmark", "Done, %d failures", failures);
+        return failures;
+    }
+
+private:
+    // Call to applied through the setpoint mailbox
+    void benchSetpoints(int channel) {
+        float duty = pump.getState(channel).target;
+        int64_t started = esp_timer_get_time();
+        measure("setpoint_apply", [&] {
+            waitFor(channel, pump.setDutyCyclePercentage(channel, duty));
+        });
+        reportRate("setpoint_rate", started);
+    }
+
+    // The same through the command queue, as a pulse to the current duty
+    void benchPulses(int channel) {
+        float duty = pump.getState(channel).target;
+        int64_t started = esp_timer_get_time();
+        measure("pulse_apply", [&] {
+            waitFor(channel, pump.setDutyCyclePercentage(channel, duty, 60000));
+        });
+        reportRate("pulse_rate", started);
+        // A plain setpoint ends the pulse left behind
+        waitFor(channel, pump.setDutyCyclePercentage(channel, duty));
+    }
+
+    // Post to the latched write, timed by the shim's record of the latch
+    void benchEnqueueToApply(int channel) {
+        float duty = pump.getState(channel).target;
+        measureRecorded("enqueue_to_apply", [&] {
+            int64_t posted = esp_timer_get_time();
+            if (!waitFor(channel, pump.setDutyCyclePercentage(channel, duty))) {
+                return int64_t{-1};
+            }
+            for (const HostCall& call : host::calls("ledc_update_duty", posted)) {
+                if (call.unit == channel) {
+                    return call.time_us - posted;
+                }
+            }
+            return int64_t{-1};
+        });
+        host::clearCalls();
+    }
+
+    // A whole /pump request through the httpd shim: routing, body parsing,
+    // the command and the wait for it to apply
+    void benchHttpPump(int channel) {
+        char body[64];
+        snprintf(body, sizeof(body), "{\"id\": %d, \"duty\": %g}", channel, pump.getState(channel).target);
+        measure("http_pump", [&] {
+            HostResponse response = host::httpRequest(HTTP_POST, "/pump", body);
+            if (response.status != 200 || response.body.find("\"OK\"") == std::string::npos) {
+                ++failures;
+            }
+        });
+    }
+
+    void benchFlatJson() {
+        static const char body[] = "{\"id\": 1, \"duty\": 42.5, \"ramp_ms\": 250, \"ramp\": \"ease\", \"period\": 5000}";
+        char buffer[sizeof(body)];
+        measure("parse_pump", [&] {
+            memcpy(buffer, body, sizeof(body));
+            FlatJson json;
+            float duty = 0.0f;
+            int ramp = 0;
+            const char* shape = nullptr;
+            json.parse(buffer);
+            json.getFloat("duty", duty);
+            json.getInt("ramp_ms", ramp);
+            json.getString("ramp", shape);
+        });
+    }
+
+    void benchBatchParse() {
+        static const char body[] = "{\"channels\": [{\"id\": 0, \"duty\": 40}, {\"id\": 1, \"duty\": 60},"
+                                   " {\"id\": 2, \"duty\": 20}, {\"id\": 3, \"duty\": 80}]}";
+        measure("parse_batch", [&] {
+            cJSON* root = cJSON_Parse(body);
+            cJSON* item = nullptr;
+            cJSON_ArrayForEach(item, cJSON_GetObjectItem(root, "channels")) {
+                cJSON_GetObjectItem(item, "duty");
+            }
+            cJSON_Delete(root);
+        });
+    }
+
+    // One blob write per iteration into the NVS shim
+    void benchSettingsStore() {
+        measure("settings_store", [&] {
+            settings.save();
+            settings.flush();
+        });
+    }
+
+    void benchSettingsLoad() {
+        measure("settings_load", [&] {
+            settings.loadSettings();
+        });
+    }
+
+    // Yields rather than sleeps so the duty task gets the CPU at once;
+    // counts a failure if the command is not applied within a second
+    bool waitFor(int channel, uint32_t seq) {
+        if (seq == 0) {
+            ++failures;
+            return false;
+        }
+        int64_t deadline = esp_timer_get_time() + WAIT_LIMIT_US;
+        while (static_cast<int32_t>(pump.getState(channel).applied_seq - seq) < 0) {
+            if (esp_timer_get_time() > deadline) {
+                ++failures;
+                return false;
+            }
+            taskYIELD();
+        }
+        return true;
+    }
+
+    template <typename Body>
+    void measure(const char* name, Body body) {
+        measureRecorded(name, [&] {
+            int64_t start = esp_timer_get_time();
+            body();
+            return esp_timer_get_time() - start;
+        });
+    }
+
+    // `body` returns its own duration, negative when it has none
+    template <typename Body>
+    void measureRecorded(const char* name, Body body) {
+        for (int i = 0; i < WARMUP; ++i) {
+            body();
+        }
+        count = 0;
+        for (int i = 0; i < std::min(iterations, MAX_SAMPLES); ++i) {
+            int64_t elapsed = body();
+            if (elapsed >= 0) {
+                samples[count++] = static_cast<uint32_t>(elapsed);
+            }
+        }
+        if (count == 0) {
+            ESP_LOGE("Benchmark", "bench %s has no samples", name);
+            ++failures;
+            return;
+        }
+        std::sort(samples, samples + count);
+        ESP_LOGI("Benchmark", "bench %s n=%d min=%lu p50=%lu p90=%lu max=%lu", name, count,
+                 static_cast<unsigned long>(samples[0]), static_cast<unsigned long>(samples[count / 2]),
+                 static_cast<unsigned long>(samples[count * 9 / 10]), static_cast<unsigned long>(samples[count - 1]));
+    }
+
+    // Commands per second over the last case, warm-up included
+    void reportRate(const char* name, int64_t started) {
+        int64_t elapsed = esp_timer_get_time() - started;
+        int commands = WARMUP + count;
+        ESP_LOGI("Benchmark", "bench %s %lld/s", name,
+                 elapsed > 0 ? static_cast<long long>(commands * 1000000LL / elapsed) : 0LL);
+    }
+
+    static const int MAX_SAMPLES = 4096;
+    static const int64_t WAIT_LIMIT_US = 1000000;
+
+    PWMControl& pump;
+    SettingsManager& settings;
+    int iterations;
+    int count = 0;
+    int failures = 0;
+    uint32_t samples[MAX_SAMPLES];
+};
@@ -0,0 +1,33 @@
+#include <cstdlib>
+
+#include "esp_log.h"
+
+#include "Benchmark.h"
+#include "HostShim.h"
+#include "LocalWebServer.h"
+#include "NvsStorageManager.h"
+#include "PWMControl.h"
+#include "SettingsManager.h"
+
+// host_bench [iterations]: brings the control path and the web server up
+// on the shims as app_main does, runs the benchmark and exits non-zero if
+// any case failed
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 128;
+    if (iterations <= 0) {
+        iterations = 128;
+    }
+
+    static NvsStorageManager nv;
+    static SettingsManager settings(nv);
+    static PWMControl pump(settings);
+    static LocalWebContext ctx{nullptr, &pump, &settings, nullptr, nullptr, nullptr};
+    static LocalWebServer webServer{&ctx};
+    if (webServer.start() != ESP_OK) {
+        ESP_LOGE("host_bench", "Failed to start web server.");
+        host::finish(1);
+    }
+
+    int failures = Benchmark(pump, settings, iterations).run();
+    host::finish(failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Shared by the shim implementations; not for firmware or tests
+namespace host {
+
+using Clock = std::chrono::steady_clock;
+
+// Start of esp_timer time and of the tick count
+Clock::time_point epoch();
+
+inline Clock::time_point atMicros(int64_t us) {
+    return epoch() + std::chrono::microseconds(us);
+}
+
+void record(const char* function, int unit, uint64_t value);
+
+// Reason phrase for an HTTP status, "" if unknown
+const char* httpReason(int status);
+
+}  // namespace host
@@ -0,0 +1,426 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "cJSON.h"
+
+namespace {
+
+cJSON* newItem(int type) {
+    cJSON* item = static_cast<cJSON*>(calloc(1, sizeof(cJSON)));
+    if (item != nullptr) {
+        item->type = type;
+    }
+    return item;
+}
+
+char* duplicate(const char* text, size_t len) {
+    char* copy = static_cast<char*>(malloc(len + 1));
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+void append(cJSON* parent, cJSON* item) {
+    if (parent->child == nullptr) {
+        parent->child = item;
+        item->prev = item;  // cJSON keeps the tail in the head's prev
+        return;
+    }
+    cJSON* tail = parent->child->prev;
+    tail->next = item;
+    item->prev = tail;
+    parent->child->prev = item;
+}
+
+const char* skip(const char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+        ++p;
+    }
+    return p;
+}
+
+void appendUtf8(std::string& out, unsigned code) {
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+bool hex4(const char* p, unsigned& value) {
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// `p` is at the opening quote; returns the position after the closing one
+const char* parseString(const char* p, char*& out) {
+    std::string text;
+    for (++p; *p != '"'; ++p) {
+        if (*p == '\0' || static_cast<unsigned char>(*p) < 0x20) {
+            return nullptr;
+        }
+        if (*p != '\\') {
+            text += *p;
+            continue;
+        }
+        switch (*++p) {
+        case '"': text += '"'; break;
+        case '\\': text += '\\'; break;
+        case '/': text += '/'; break;
+        case 'b': text += '\b'; break;
+        case 'f': text += '\f'; break;
+        case 'n': text += '\n'; break;
+        case 'r': text += '\r'; break;
+        case 't': text += '\t'; break;
+        case 'u': {
+            unsigned code = 0;
+            if (!hex4(p + 1, code)) {
+                return nullptr;
+            }
+            p += 4;
+            if (code >= 0xD800 && code < 0xDC00) {
+                unsigned low = 0;
+                if (p[1] != '\\' || p[2] != 'u' || !hex4(p + 3, low) || low < 0xDC00 || low > 0xDFFF) {
+                    return nullptr;
+                }
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+            }
+            appendUtf8(text, code);
+            break;
+        }
+        default:
+            return nullptr;
+        }
+    }
+    out = duplicate(text.data(), text.size());
+    return p + 1;
+}
+
+const char* parseValue(const char* p, cJSON* item, int depth);
+
+const char* parseContainer(const char* p, cJSON* item, int depth, bool object) {
+    item->type = object ? cJSON_Object : cJSON_Array;
+    char close = object ? '}' : ']';
+    p = skip(p + 1);
+    if (*p == close) {
+        return p + 1;
+    }
+    for (;;) {
+        cJSON* child = newItem(cJSON_Invalid);
+        append(item, child);
+        if (object) {
+            if (*p != '"' || (p = parseString(p, child->string)) == nullptr) {
+                return nullptr;
+            }
+            p = skip(p);
+            if (*p++ != ':') {
+                return nullptr;
+            }
+        }
+        if ((p = parseValue(skip(p), child, depth + 1)) == nullptr) {
+            return nullptr;
+        }
+        p = skip(p);
+        if (*p == close) {
+            return p + 1;
+        }
+        if (*p++ != ',') {
+            return nullptr;
+        }
+        p = skip(p);
+    }
+}
+
+const char* parseValue(const char* p, cJSON* item, int depth) {
+    if (depth > 1000) {
+        return nullptr;
+    }
+    if (strncmp(p, "null", 4) == 0) {
+        item->type = cJSON_NULL;
+        return p + 4;
+    }
+    if (strncmp(p, "false", 5) == 0) {
+        item->type = cJSON_False;
+        return p + 5;
+    }
+    if (strncmp(p, "true", 4) == 0) {
+        item->type = cJSON_True;
+        item->valueint = 1;
+        return p + 4;
+    }
+    if (*p == '"') {
+        item->type = cJSON_String;
+        return parseString(p, item->valuestring);
+    }
+    if (*p == '{' || *p == '[') {
+        return parseContainer(p, item, depth, *p == '{');
+    }
+    if (*p == '-' || (*p >= '0' && *p <= '9')) {
+        char* end = nullptr;
+        double number = strtod(p, &end);
+        if (end == p) {
+            return nullptr;
+        }
+        item->type = cJSON_Number;
+        item->valuedouble = number;
+        item->valueint = number >= INT32_MAX ? INT32_MAX : number <= INT32_MIN ? INT32_MIN : static_cast<int>(number);
+        return end;
+    }
+    return nullptr;
+}
+
+void printString(std::string& out, const char* text) {
+    out += '"';
+    for (const char* p = text; *p != '\0'; ++p) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            } else {
+                out += static_cast<char>(c);
+            }
+        }
+    }
+    out += '"';
+}
+
+// Integers print as such, anything else with the fewest digits that read
+// back the same, as cJSON does
+void printNumber(std::string& out, double d) {
+    char buffer[32];
+    if (std::isnan(d) || std::isinf(d)) {
+        snprintf(buffer, sizeof(buffer), "null");
+    } else if (d == static_cast<double>(static_cast<long long>(d)) && std::fabs(d) < 1e15) {
+        snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(d));
+    } else {
+        snprintf(buffer, sizeof(buffer), "%1.15g", d);
+        if (strtod(buffer, nullptr) != d) {
+            snprintf(buffer, sizeof(buffer), "%1.17g", d);
+        }
+    }
+    out += buffer;
+}
+
+void print(std::string& out, const cJSON* item) {
+    switch (item->type & 0xFF) {
+    case cJSON_NULL: out += "null"; break;
+    case cJSON_False: out += "false"; break;
+    case cJSON_True: out += "true"; break;
+    case cJSON_Number: printNumber(out, item->valuedouble); break;
+    case cJSON_String: printString(out, item->valuestring != nullptr ? item->valuestring : ""); break;
+    case cJSON_Array:
+    case cJSON_Object: {
+        bool object = (item->type & 0xFF) == cJSON_Object;
+        out += object ? '{' : '[';
+        for (const cJSON* child = item->child; child != nullptr; child = child->next) {
+            if (child != item->child) {
+                out += ',';
+            }
+            if (object) {
+                printString(out, child->string != nullptr ? child->string : "");
+                out += ':';
+            }
+            print(out, child);
+        }
+        out += object ? '}' : ']';
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+cJSON* addToObject(cJSON* object, const char* name, cJSON* item) {
+    if (item == nullptr || !cJSON_AddItemToObject(object, name, item)) {
+        cJSON_Delete(item);
+        return nullptr;
+    }
+    return item;
+}
+
+}  // namespace
+
+cJSON* cJSON_Parse(const char* value) {
+    if (value == nullptr) {
+        return nullptr;
+    }
+    cJSON* root = newItem(cJSON_Invalid);
+    const char* end = parseValue(skip(value), root, 0);
+    if (end == nullptr) {
+        cJSON_Delete(root);
+        return nullptr;
+    }
+    return root;
+}
+
+void cJSON_Delete(cJSON* item) {
+    while (item != nullptr) {
+        cJSON* next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+char* cJSON_PrintUnformatted(const cJSON* item) {
+    if (item == nullptr) {
+        return nullptr;
+    }
+    std::string out;
+    print(out, item);
+    return duplicate(out.data(), out.size());
+}
+
+char* cJSON_Print(const cJSON* item) {
+    return cJSON_PrintUnformatted(item);
+}
+
+void cJSON_free(void* object) {
+    free(object);
+}
+
+cJSON* cJSON_GetObjectItem(const cJSON* object, const char* string) {
+    if (object == nullptr || string == nullptr) {
+        return nullptr;
+    }
+    for (cJSON* child = object->child; child != nullptr; child = child->next) {
+        if (child->string != nullptr && strcasecmp(child->string, string) == 0) {
+            return child;
+        }
+    }
+    return nullptr;
+}
+
+char* cJSON_GetStringValue(const cJSON* item) {
+    return cJSON_IsString(item) ? item->valuestring : nullptr;
+}
+
+cJSON_bool cJSON_IsFalse(const cJSON* item) {
+    return item != nullptr && (item->type & 0xFF) == cJSON_False;
+}
+
+cJSON_bool cJSON_IsTrue(const cJSON* item) {
+    return item != nullptr && (item->type & 0xFF) == cJSON_True;
+}
+
+cJSON_bool cJSON_IsBool(const cJSON* item) {
+    return item != nullptr && (item->type & (cJSON_True | cJSON_False)) != 0;
+}
+
+cJSON_bool cJSON_IsNull(const cJSON* item) {
+    return item != nullptr && (item->type & 0xFF) == cJSON_NULL;
+}
+
+cJSON_bool cJSON_IsNumber(const cJSON* item) {
+    return item != nullptr && (item->type & 0xFF) == cJSON_Number;
+}
+
+cJSON_bool cJSON_IsString(const cJSON* item) {
+    return item != nullptr && (item->type & 0xFF) == cJSON_String;
+}
+
+cJSON_bool cJSON_IsArray(const cJSON* item) {
+    return item != nullptr && (item->type & 0xFF) == cJSON_Array;
+}
+
+cJSON_bool cJSON_IsObject(const cJSON* item) {
+    return item != nullptr && (item->type & 0xFF) == cJSON_Object;
+}
+
+cJSON* cJSON_CreateObject(void) {
+    return newItem(cJSON_Object);
+}
+
+cJSON* cJSON_CreateArray(void) {
+    return newItem(cJSON_Array);
+}
+
+cJSON* cJSON_CreateString(const char* string) {
+    cJSON* item = newItem(cJSON_String);
+    item->valuestring = duplicate(string, strlen(string));
+    return item;
+}
+
+cJSON* cJSON_CreateNumber(double num) {
+    cJSON* item = newItem(cJSON_Number);
+    item->valuedouble = num;
+    item->valueint = num >= INT32_MAX ? INT32_MAX : num <= INT32_MIN ? INT32_MIN : static_cast<int>(num);
+    return item;
+}
+
+cJSON* cJSON_CreateBool(cJSON_bool boolean) {
+    return newItem(boolean ? cJSON_True : cJSON_False);
+}
+
+cJSON_bool cJSON_AddItemToArray(cJSON* array, cJSON* item) {
+    if (array == nullptr || item == nullptr || array == item) {
+        return false;
+    }
+    append(array, item);
+    return true;
+}
+
+cJSON_bool cJSON_AddItemToObject(cJSON* object, const char* string, cJSON* item) {
+    if (object == nullptr || string == nullptr || item == nullptr || object == item) {
+        return false;
+    }
+    free(item->string);
+    item->string = duplicate(string, strlen(string));
+    append(object, item);
+    return true;
+}
+
+cJSON* cJSON_AddStringToObject(cJSON* object, const char* name, const char* string) {
+    return addToObject(object, name, cJSON_CreateString(string));
+}
+
+cJSON* cJSON_AddNumberToObject(cJSON* object, const char* name, double number) {
+    return addToObject(object, name, cJSON_CreateNumber(number));
+}
+
+cJSON* cJSON_AddBoolToObject(cJSON* object, const char* name, cJSON_bool boolean) {
+    return addToObject(object, name, cJSON_CreateBool(boolean));
+}
+
+cJSON* cJSON_AddArrayToObject(cJSON* object, const char* name) {
+    return addToObject(object, name, cJSON_CreateArray());
+}
@@ -0,0 +1,93 @@
+// Host builds of the external components the firmware links against
+#include <cstdio>
+
+#include "HostShim.h"
+#include "JsonWrapper.h"
+#include "Ota.h"
+#include "WebServer.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+
+#include "HostInternal.h"
+
+WebServer::~WebServer() {
+}
+
+esp_err_t WebServer::start() {
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_uri_handlers = 40;
+    esp_err_t err = httpd_start(&server, &config);
+    if (err != ESP_OK) {
+        return err;
+    }
+    httpd_uri_t healthz = {};
+    healthz.uri = "/healthz";
+    healthz.method = HTTP_GET;
+    healthz.handler = healthz_handler;
+    healthz.user_ctx = this;
+    return httpd_register_uri_handler(server, &healthz);
+}
+
+esp_err_t WebServer::sendJsonError(httpd_req_t* req, int status, const char* message) {
+    char line[48];
+    snprintf(line, sizeof(line), "%d %s", status, host::httpReason(status));
+    JsonWrapper json;
+    json.AddItem("status", "ERROR");
+    json.AddItem("message", message);
+    std::string body = json.ToString();
+    httpd_resp_set_status(req, line);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, body.c_str(), body.size());
+}
+
+esp_err_t WebServer::healthz_handler(httpd_req_t* req) {
+    WebServer* self = static_cast<WebServer*>(req->user_ctx);
+    JsonWrapper json;
+    json.AddItem("status", "OK");
+    self->populate_healthz_fields(self->webContext, json);
+    std::string body = json.ToString();
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, body.c_str(), body.size());
+}
+
+void OTAUpdater::perform_update(const std::string& from) {
+    ESP_LOGW("OTAUpdater", "No network on the host, not fetching %s", from.c_str());
+}
+
+namespace {
+
+const esp_partition_t running_partition = {0x10000, 0x1e0000, "ota_0"};
+
+}  // namespace
+
+const esp_partition_t* esp_ota_get_running_partition(void) {
+    return &running_partition;
+}
+
+const esp_partition_t* esp_ota_get_boot_partition(void) {
+    return &running_partition;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from) {
+    return nullptr;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size) {
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    return ESP_ERR_INVALID_ARG;
+}
@@ -0,0 +1,167 @@
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+#include "HostInternal.h"
+
+struct esp_timer {
+    esp_timer_cb_t callback = nullptr;
+    void* arg = nullptr;
+    const char* name = nullptr;
+    bool active = false;
+    int64_t expiry_us = 0;
+    uint64_t period_us = 0;     // 0 for one-shot
+    esp_timer* next = nullptr;  // all timers, in creation order
+};
+
+namespace {
+
+std::mutex timers_mutex;
+std::condition_variable timers_changed;
+esp_timer* timers = nullptr;
+bool dispatcher_started = false;
+
+esp_timer* earliest() {
+    esp_timer* first = nullptr;
+    for (esp_timer* timer = timers; timer != nullptr; timer = timer->next) {
+        if (timer->active && (first == nullptr || timer->expiry_us < first->expiry_us)) {
+            first = timer;
+        }
+    }
+    return first;
+}
+
+// The "esp_timer" task. Callbacks run without the lock held, so they may
+// start and stop timers, their own included.
+void dispatch(void*) {
+    std::unique_lock<std::mutex> lock(timers_mutex);
+    for (;;) {
+        esp_timer* due = earliest();
+        if (due == nullptr) {
+            timers_changed.wait(lock);
+            continue;
+        }
+        if (esp_timer_get_time() < due->expiry_us) {
+            timers_changed.wait_until(lock, host::atMicros(due->expiry_us));
+            continue;
+        }
+        if (due->period_us > 0) {
+            due->expiry_us += static_cast<int64_t>(due->period_us);
+        } else {
+            due->active = false;
+        }
+        esp_timer_cb_t callback = due->callback;
+        void* arg = due->arg;
+        lock.unlock();
+        callback(arg);
+        lock.lock();
+    }
+}
+
+esp_err_t arm(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timer == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->expiry_us = esp_timer_get_time() + static_cast<int64_t>(timeout_us);
+    timer->period_us = period_us;
+    timers_changed.notify_all();
+    return ESP_OK;
+}
+
+}  // namespace
+
+int64_t esp_timer_get_time(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(host::Clock::now() - host::epoch()).count();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+    if (create_args == nullptr || create_args->callback == nullptr || out_handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_timer* timer = new esp_timer;
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->name = create_args->name;
+
+    bool start = false;
+    {
+        std::lock_guard<std::mutex> lock(timers_mutex);
+        timer->next = timers;
+        timers = timer;
+        start = !dispatcher_started;
+        dispatcher_started = true;
+    }
+    if (start) {
+        xTaskCreate(dispatch, "esp_timer", CONFIG_ESP_TIMER_TASK_STACK_SIZE, nullptr, 22, nullptr);
+    }
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return arm(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return arm(timer, period, period);
+}
+
+esp_err_t esp_timer_restart(esp_timer_handle_t timer, uint64_t timeout_us) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timer == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->expiry_us = esp_timer_get_time() + static_cast<int64_t>(timeout_us);
+    if (timer->period_us > 0) {
+        timer->period_us = timeout_us;
+    }
+    timers_changed.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timer == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    timers_changed.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    if (timer == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (esp_timer** link = &timers; *link != nullptr; link = &(*link)->next) {
+        if (*link == timer) {
+            *link = timer->next;
+            break;
+        }
+    }
+    delete timer;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> lock(timers_mutex);
+    return timer != nullptr && timer->active;
+}
@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "HostInternal.h"
+
+struct HostTask {
+    std::string name;
+    uint32_t stack_depth = 0;
+    std::mutex mutex;
+    std::condition_variable notified;
+    uint32_t notify_count = 0;
+};
+
+struct QueueDefinition {
+    size_t item_size = 0;
+    size_t length = 0;
+    std::deque<std::vector<uint8_t>> items;
+    std::mutex mutex;
+    std::condition_variable changed;
+};
+
+struct EventGroupDef {
+    EventBits_t bits = 0;
+    std::mutex mutex;
+    std::condition_variable changed;
+};
+
+namespace {
+
+// Tasks are never freed, so handles stay valid for the whole run
+std::mutex tasks_mutex;
+std::list<HostTask> tasks;
+thread_local HostTask* current_task = nullptr;
+
+const int64_t tick_us = 1000000 / configTICK_RATE_HZ;
+
+HostTask* newTask(const char* name, uint32_t stack_depth) {
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    HostTask& task = tasks.emplace_back();
+    task.name = name != nullptr ? name : "";
+    task.stack_depth = stack_depth;
+    return &task;
+}
+
+// Threads the shims did not start (main, the test itself) become tasks
+// on first use
+HostTask* currentTask() {
+    if (current_task == nullptr) {
+        current_task = newTask("main", CONFIG_ESP_MAIN_TASK_STACK_SIZE);
+    }
+    return current_task;
+}
+
+// Waits on `cv` until `ready` holds or the ticks run out
+template <typename Ready>
+bool waitTicks(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, TickType_t ticks, Ready ready) {
+    if (ticks == portMAX_DELAY) {
+        cv.wait(lock, ready);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::microseconds(static_cast<int64_t>(ticks) * tick_us), ready);
+}
+
+TaskHandle_t startTask(TaskFunction_t code, const char* name, uint32_t stack_depth, void* parameters) {
+    HostTask* task = newTask(name, stack_depth);
+    std::thread([task, code, parameters] {
+        current_task = task;
+        code(parameters);
+    }).detach();
+    return task;
+}
+
+QueueHandle_t newQueue(UBaseType_t length, UBaseType_t item_size) {
+    QueueDefinition* queue = new QueueDefinition;
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+BaseType_t send(QueueHandle_t queue, const void* item, TickType_t ticks, bool front) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!waitTicks(queue->changed, lock, ticks, [queue] { return queue->items.size() < queue->length; })) {
+        return pdFAIL;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(item);
+    std::vector<uint8_t> copy(bytes, bytes + (item != nullptr ? queue->item_size : 0));
+    if (front) {
+        queue->items.push_front(std::move(copy));
+    } else {
+        queue->items.push_back(std::move(copy));
+    }
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+}  // namespace
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint32_t stack_depth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* created) {
+    TaskHandle_t task = startTask(code, name, stack_depth, parameters);
+    if (created != nullptr) {
+        *created = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stack_depth, void* parameters,
+                                   UBaseType_t priority, TaskHandle_t* created, BaseType_t core) {
+    return xTaskCreate(code, name, stack_depth, parameters, priority, created);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t code, const char* name, uint32_t stack_depth, void* parameters,
+                               UBaseType_t priority, StackType_t* stack, StaticTask_t* buffer) {
+    return startTask(code, name, stack_depth, parameters);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t code, const char* name, uint32_t stack_depth,
+                                           void* parameters, UBaseType_t priority, StackType_t* stack,
+                                           StaticTask_t* buffer, BaseType_t core) {
+    return startTask(code, name, stack_depth, parameters);
+}
+
+// A thread cannot be stopped from outside; deleting yourself parks the thread
+void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr || task == current_task) {
+        for (;;) {
+            std::this_thread::sleep_for(std::chrono::hours(1));
+        }
+    }
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return static_cast<TickType_t>(esp_timer_get_time() / tick_us);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    TickType_t wake = xTaskGetTickCount() + ticks;
+    std::this_thread::sleep_until(host::atMicros(static_cast<int64_t>(wake) * tick_us));
+}
+
+BaseType_t xTaskDelayUntil(TickType_t* previous_wake, TickType_t increment) {
+    TickType_t wake = *previous_wake + increment;
+    *previous_wake = wake;
+    if (static_cast<int32_t>(wake - xTaskGetTickCount()) <= 0) {
+        return pdFALSE;
+    }
+    std::this_thread::sleep_until(host::atMicros(static_cast<int64_t>(wake) * tick_us));
+    return pdTRUE;
+}
+
+void taskYIELD(void) {
+    std::this_thread::yield();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return currentTask();
+}
+
+TaskHandle_t xTaskGetHandle(const char* name) {
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    for (HostTask& task : tasks) {
+        if (task.name == name) {
+            return &task;
+        }
+    }
+    return nullptr;
+}
+
+char* pcTaskGetName(TaskHandle_t task) {
+    return (task != nullptr ? task : currentTask())->name.data();
+}
+
+// Host threads have their own stacks, so the whole of the requested one
+// is reported free
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return (task != nullptr ? task : currentTask())->stack_depth;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    ++task->notify_count;
+    task->notified.notify_all();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken) {
+    xTaskNotifyGive(task);
+    if (woken != nullptr) {
+        *woken = pdTRUE;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    HostTask* task = currentTask();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    waitTicks(task->notified, lock, ticks_to_wait, [task] { return task->notify_count > 0; });
+    uint32_t count = task->notify_count;
+    if (count > 0) {
+        task->notify_count = clear_on_exit ? 0 : count - 1;
+    }
+    return count;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    return newQueue(length, item_size);
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t* storage,
+                                 StaticQueue_t* buffer) {
+    return newQueue(length, item_size);
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait) {
+    return send(queue, item, ticks_to_wait, false);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait) {
+    return send(queue, item, ticks_to_wait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait) {
+    return send(queue, item, ticks_to_wait, true);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken) {
+    return send(queue, item, 0, false);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks_to_wait) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!waitTicks(queue->changed, lock, ticks_to_wait, [queue] { return !queue->items.empty(); })) {
+        return pdFAIL;
+    }
+    if (item != nullptr && queue->item_size > 0) {
+        memcpy(item, queue->items.front().data(), queue->item_size);
+    }
+    queue->items.pop_front();
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return static_cast<UBaseType_t>(queue->items.size());
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return static_cast<UBaseType_t>(queue->length - queue->items.size());
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return newQueue(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t* buffer) {
+    return newQueue(1, 0);
+}
+
+// A mutex is a binary semaphore that starts given; there is no priority
+// inheritance to model on the host
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t mutex = newQueue(1, 0);
+    xSemaphoreGive(mutex);
+    return mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer) {
+    return xSemaphoreCreateMutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+    return xQueueReceive(semaphore, nullptr, ticks_to_wait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return send(semaphore, nullptr, 0, false);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* woken) {
+    return xSemaphoreGive(semaphore);
+}
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    return new EventGroupDef;
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t* buffer) {
+    return new EventGroupDef;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    delete group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    group->bits |= bits;
+    group->changed.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    EventBits_t before = group->bits;
+    group->bits &= ~bits;
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks_to_wait) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto ready = [&] { return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0; };
+    waitTicks(group->changed, lock, ticks_to_wait, ready);
+    EventBits_t seen = group->bits;
+    if (ready() && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    return seen;
+}
@@ -0,0 +1,355 @@
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "HostShim.h"
+#include "esp_http_server.h"
+#include "freertos/task.h"
+
+#include "HostInternal.h"
+
+namespace {
+
+struct HostServer {
+    uint16_t max_uri_handlers = 0;
+    std::vector<std::pair<std::string, httpd_uri_t>> handlers;  // the string owns uri
+};
+
+// One request and its response. Async hand-off is not supported, so an
+// exchange never outlives its handler.
+struct HostExchange {
+    httpd_req_t req{};
+    std::string body;
+    size_t received = 0;
+    std::string query;
+    bool websocket_frame = false;
+    HostResponse response;
+};
+
+struct Job {
+    std::function<void()> run;
+};
+
+std::mutex jobs_mutex;
+std::condition_variable jobs_changed;
+std::deque<Job> jobs;
+HostServer* running = nullptr;
+int next_sockfd = 54;
+
+HostExchange& exchange(httpd_req_t* r) {
+    return *static_cast<HostExchange*>(r->aux);
+}
+
+const char* reason(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 409: return "Conflict";
+    case 411: return "Length Required";
+    case 413: return "Content Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    default: return "";
+    }
+}
+
+// The httpd task: requests and queued work run here one at a time
+void serve(void*) {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(jobs_mutex);
+            jobs_changed.wait(lock, [] { return !jobs.empty(); });
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job.run();
+    }
+}
+
+void post(std::function<void()> run) {
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    jobs.push_back(Job{std::move(run)});
+    jobs_changed.notify_all();
+}
+
+void handle(HostExchange& ex, const std::string& path) {
+    const httpd_uri_t* match = nullptr;
+    bool pathKnown = false;
+    int method = ex.websocket_frame ? HTTP_GET : ex.req.method;
+    for (const auto& [uri, handler] : running->handlers) {
+        if (uri == path) {
+            pathKnown = true;
+            if (handler.method == method) {
+                match = &handler;
+            }
+        }
+    }
+    if (match == nullptr) {
+        httpd_resp_send_err(&ex.req, pathKnown ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, nullptr);
+        return;
+    }
+    ex.req.user_ctx = match->user_ctx;
+    ex.req.handle = running;
+    if (match->handler(&ex.req) != ESP_OK && ex.response.status == 0) {
+        ex.response.status = -1;  // the target closes the socket without a response
+    }
+}
+
+HostResponse exchangeOnHttpd(HostExchange& ex, const char* uri) {
+    std::string target = uri;
+    size_t question = target.find('?');
+    std::string path = target.substr(0, question);
+    if (question != std::string::npos) {
+        ex.query = target.substr(question + 1);
+    }
+    strncpy(const_cast<char*>(ex.req.uri), uri, HTTPD_MAX_URI_LEN);
+    ex.req.aux = &ex;
+
+    std::mutex done_mutex;
+    std::condition_variable done_changed;
+    bool done = false;
+    post([&] {
+        handle(ex, path);
+        std::lock_guard<std::mutex> lock(done_mutex);
+        done = true;
+        done_changed.notify_all();
+    });
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done_changed.wait(lock, [&] { return done; });
+    return ex.response;
+}
+
+}  // namespace
+
+const char* HostResponse::header(const char* name) const {
+    for (const auto& [field, value] : headers) {
+        if (strcasecmp(field.c_str(), name) == 0) {
+            return value.c_str();
+        }
+    }
+    return nullptr;
+}
+
+HostResponse host::httpRequest(httpd_method_t method, const char* uri, const char* body) {
+    HostExchange ex;
+    ex.req.method = method;
+    ex.body = body != nullptr ? body : "";
+    ex.req.content_len = ex.body.size();
+    if (running == nullptr) {
+        ex.response.status = -1;
+        return ex.response;
+    }
+    return exchangeOnHttpd(ex, uri);
+}
+
+// Frames reach the handler with method 0, not HTTP_GET, as from the
+// target's parser once the handshake is done
+HostResponse host::websocketFrame(const char* uri, const void* payload, size_t len) {
+    HostExchange ex;
+    ex.req.method = 0;
+    ex.websocket_frame = true;
+    ex.body.assign(static_cast<const char*>(payload), len);
+    if (running == nullptr) {
+        ex.response.status = -1;
+        return ex.response;
+    }
+    return exchangeOnHttpd(ex, uri);
+}
+
+esp_err_t httpd_start(httpd_handle_t* handle, const httpd_config_t* config) {
+    if (running != nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    running = new HostServer;
+    running->max_uri_handlers = config->max_uri_handlers;
+    xTaskCreate(serve, "httpd", config->stack_size, nullptr, config->task_priority, nullptr);
+    *handle = running;
+    return ESP_OK;
+}
+
+// The httpd task keeps running; only a server that was never started
+// could be stopped cleanly on the host
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    return handle == running ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t* uri_handler) {
+    HostServer* server = static_cast<HostServer*>(handle);
+    if (server == nullptr || uri_handler == nullptr || uri_handler->uri == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (const auto& [uri, handler] : server->handlers) {
+        if (uri == uri_handler->uri && handler.method == uri_handler->method) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (server->handlers.size() >= server->max_uri_handlers) {
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    server->handlers.emplace_back(uri_handler->uri, *uri_handler);
+    server->handlers.back().second.uri = server->handlers.back().first.c_str();
+    return ESP_OK;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void* arg) {
+    if (handle == nullptr || handle != running || work == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    post([work, arg] { work(arg); });
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    return ESP_OK;
+}
+
+// There are no sockets to write to
+int httpd_socket_send(httpd_handle_t handle, int sockfd, const char* buf, size_t buf_len, int flags) {
+    return HTTPD_SOCK_ERR_FAIL;
+}
+
+int httpd_req_recv(httpd_req_t* r, char* buf, size_t buf_len) {
+    HostExchange& ex = exchange(r);
+    size_t n = std::min(buf_len, ex.body.size() - ex.received);
+    memcpy(buf, ex.body.data() + ex.received, n);
+    ex.received += n;
+    return static_cast<int>(n);
+}
+
+int httpd_req_to_sockfd(httpd_req_t* r) {
+    return next_sockfd;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t* r, char* buf, size_t buf_len) {
+    const std::string& query = exchange(r).query;
+    if (query.empty()) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    snprintf(buf, buf_len, "%s", query.c_str());
+    return query.size() < buf_len ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+esp_err_t httpd_query_key_value(const char* qry, const char* key, char* val, size_t val_size) {
+    size_t key_len = strlen(key);
+    for (const char* p = qry; p != nullptr && *p != '\0';) {
+        const char* end = strchr(p, '&');
+        size_t len = end != nullptr ? static_cast<size_t>(end - p) : strlen(p);
+        if (len > key_len && strncmp(p, key, key_len) == 0 && p[key_len] == '=') {
+            size_t value_len = len - key_len - 1;
+            snprintf(val, val_size, "%.*s", static_cast<int>(value_len), p + key_len + 1);
+            return value_len < val_size ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+        }
+        p = end != nullptr ? end + 1 : nullptr;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t* r, httpd_req_t** out) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t* r) {
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t* r, const char* status) {
+    exchange(r).response.status = atoi(status);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t* r, const char* type) {
+    exchange(r).response.type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t* r, const char* field, const char* value) {
+    exchange(r).response.headers.emplace_back(field, value);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    HostResponse& response = exchange(r).response;
+    size_t len = buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : static_cast<size_t>(buf_len);
+    host::record("httpd_resp_send", -1, len);
+    if (response.status == 0) {
+        response.status = 200;
+    }
+    if (response.type.empty()) {
+        response.type = HTTPD_TYPE_TEXT;
+    }
+    response.body.assign(buf != nullptr ? buf : "", len);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    HostResponse& response = exchange(r).response;
+    size_t len = buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : static_cast<size_t>(buf_len);
+    host::record("httpd_resp_send_chunk", -1, len);
+    if (response.status == 0) {
+        response.status = 200;
+    }
+    if (response.type.empty()) {
+        response.type = HTTPD_TYPE_TEXT;
+    }
+    if (buf != nullptr) {
+        response.body.append(buf, len);
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t* req, httpd_err_code_t error, const char* msg) {
+    static const int statuses[] = {500, 501, 505, 400, 401, 403, 404, 405, 408, 411, 414, 431};
+    int status = error < HTTPD_ERR_CODE_MAX ? statuses[error] : 500;
+    HostResponse& response = exchange(req).response;
+    host::record("httpd_resp_send_err", -1, status);
+    response.status = status;
+    response.type = HTTPD_TYPE_TEXT;
+    response.body = msg != nullptr ? msg : reason(status);
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t* req, httpd_ws_frame_t* pkt, size_t max_len) {
+    HostExchange& ex = exchange(req);
+    if (!ex.websocket_frame) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pkt->final = true;
+    pkt->fragmented = false;
+    pkt->type = HTTPD_WS_TYPE_BINARY;
+    pkt->len = ex.body.size();
+    if (max_len > 0) {
+        if (max_len < pkt->len) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(pkt->payload, ex.body.data(), pkt->len);
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t* req, httpd_ws_frame_t* pkt) {
+    HostResponse& response = exchange(req).response;
+    host::record("httpd_ws_send_frame", -1, pkt->len);
+    response.status = 101;
+    response.body.append(reinterpret_cast<const char*>(pkt->payload), pkt->len);
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t* frame) {
+    return ESP_ERR_INVALID_ARG;
+}
+
+const char* host::httpReason(int status) {
+    return reason(status);
+}
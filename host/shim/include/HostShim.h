@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "esp_http_server.h"
+#include "nvs.h"
+
+// Test side of the host shims. LEDC, NVS and httpd calls are recorded with
+// the esp_timer time they were made at, so a test can check what reached
+// the "hardware" and when, and the modelled registers can be read back.
+struct HostCall {
+    int64_t time_us;
+    const char* function;   // e.g. "ledc_update_duty"
+    int unit;               // LEDC channel or timer, -1 where there is none
+    uint64_t value;         // duty, frequency, length; 0 where there is none
+};
+
+struct HostResponse {
+    int status = 0;
+    std::string type;
+    std::string body;
+    std::vector<std::pair<std::string, std::string>> headers;
+
+    const char* header(const char* name) const;
+};
+
+namespace host {
+
+// Every call recorded since the last clearCalls(), oldest first
+std::vector<HostCall> calls();
+// Those of one function made at or after `since_us`
+std::vector<HostCall> calls(const char* function, int64_t since_us = 0);
+void clearCalls();
+
+// Latched duty register of a channel, a fade included as far as it got
+uint32_t ledcDuty(int channel);
+uint32_t ledcFrequency(int timer);
+uint32_t ledcResolution(int timer);
+
+// The next `count` NVS sets fail with `error` and store nothing, as on a
+// full partition
+void failNvsWrites(int count, esp_err_t error = ESP_ERR_NVS_NOT_ENOUGH_SPACE);
+
+// Runs the handler registered for the URI on the httpd task and returns
+// its response; 404 if none is registered
+HostResponse httpRequest(httpd_method_t method, const char* uri, const char* body = nullptr);
+// One binary frame to a websocket URI; the body holds the frames sent back
+HostResponse websocketFrame(const char* uri, const void* payload, size_t len);
+
+// Ends the process without unwinding. Task threads never return, so this
+// is how a host program exits.
+[[noreturn]] void finish(int status);
+
+}  // namespace host
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <type_traits>
+#include "cJSON.h"
+
+// The jsonwrapper component, as far as the firmware uses it: an object
+// builder for health reports and field lookups on a parsed body
+class JsonWrapper {
+public:
+    JsonWrapper() : root(cJSON_CreateObject()) {
+    }
+
+    ~JsonWrapper() {
+        cJSON_Delete(root);
+    }
+
+    JsonWrapper(const JsonWrapper&) = delete;
+    JsonWrapper& operator=(const JsonWrapper&) = delete;
+
+    // An empty object if `text` does not parse
+    static JsonWrapper Parse(const std::string& text) {
+        cJSON* parsed = cJSON_Parse(text.c_str());
+        return JsonWrapper(parsed != nullptr ? parsed : cJSON_CreateObject());
+    }
+
+    bool ContainsField(const std::string& key) const {
+        return cJSON_GetObjectItem(root, key.c_str()) != nullptr;
+    }
+
+    // Numbers read into arithmetic types; strings, and booleans as "true"
+    // or "false", into std::string
+    template <typename T>
+    bool GetField(const std::string& key, T& value) const {
+        cJSON* item = cJSON_GetObjectItem(root, key.c_str());
+        if constexpr (std::is_arithmetic_v<T>) {
+            if (!cJSON_IsNumber(item)) {
+                return false;
+            }
+            value = static_cast<T>(item->valuedouble);
+        } else {
+            if (cJSON_IsBool(item)) {
+                value = cJSON_IsTrue(item) ? "true" : "false";
+            } else if (cJSON_IsString(item)) {
+                value = item->valuestring;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename T>
+    void AddItem(const std::string& key, T value) {
+        if constexpr (std::is_same_v<T, bool>) {
+            cJSON_AddBoolToObject(root, key.c_str(), value);
+        } else if constexpr (std::is_arithmetic_v<T>) {
+            cJSON_AddNumberToObject(root, key.c_str(), static_cast<double>(value));
+        } else {
+            cJSON_AddStringToObject(root, key.c_str(), std::string(value).c_str());
+        }
+    }
+
+    std::string ToString() const {
+        char* text = cJSON_PrintUnformatted(root);
+        std::string result = text != nullptr ? text : "";
+        cJSON_free(text);
+        return result;
+    }
+
+private:
+    explicit JsonWrapper(cJSON* root) : root(root) {
+    }
+
+    cJSON* root;
+};
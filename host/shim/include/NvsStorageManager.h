@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include "nvs.h"
+
+// The nvsstoragemanager component's string store, on the host NVS
+class NvsStorageManager {
+public:
+    static constexpr const char* NAMESPACE = "storage";
+
+    bool store(const std::string& key, const std::string& value) {
+        nvs_handle_t handle;
+        if (nvs_open(NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+            return false;
+        }
+        bool stored = nvs_set_str(handle, key.c_str(), value.c_str()) == ESP_OK && nvs_commit(handle) == ESP_OK;
+        nvs_close(handle);
+        return stored;
+    }
+
+    bool retrieve(const std::string& key, std::string& value) {
+        nvs_handle_t handle;
+        if (nvs_open(NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+            return false;
+        }
+        size_t length = 0;
+        bool found = nvs_get_str(handle, key.c_str(), nullptr, &length) == ESP_OK;
+        if (found) {
+            value.resize(length);
+            found = nvs_get_str(handle, key.c_str(), value.data(), &length) == ESP_OK;
+            value.resize(length > 0 ? length - 1 : 0);
+        }
+        nvs_close(handle);
+        return found;
+    }
+};
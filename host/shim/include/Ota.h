@@ -0,0 +1,19 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+// The otawrapper component's pull updater. There is nothing to download
+// from on the host, so an update fails without touching the boot partition.
+class OTAUpdater {
+public:
+    OTAUpdater(std::string url, std::function<void(int)> progress)
+        : url(std::move(url)), progress(std::move(progress)) {
+    }
+
+    void perform_update(const std::string& from);
+
+private:
+    std::string url;
+    std::function<void(int)> progress;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "JsonWrapper.h"
+#include "WifiManager.h"
+#include "esp_http_server.h"
+
+struct WebContext {
+    WiFiManager* wifi;
+
+    explicit WebContext(WiFiManager* wifi) : wifi(wifi) {
+    }
+};
+
+// The webserver component's base class: start() brings up the host httpd
+// with GET /healthz, which reports what populate_healthz_fields adds.
+class WebServer {
+public:
+    explicit WebServer(WebContext* context) : webContext(context) {
+    }
+
+    virtual ~WebServer();
+    virtual esp_err_t start();
+
+    // {"status":"ERROR","message":...} with the given HTTP status
+    esp_err_t sendJsonError(httpd_req_t* req, int status, const char* message);
+
+protected:
+    virtual void populate_healthz_fields(WebContext* context, JsonWrapper& json) {
+    }
+
+    httpd_handle_t server = nullptr;
+    WebContext* webContext;
+
+private:
+    static esp_err_t healthz_handler(httpd_req_t* req);
+};
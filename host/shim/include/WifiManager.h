@@ -0,0 +1,4 @@
+#pragma once
+
+// Nothing connects on the host; contexts carry a null WiFiManager
+class WiFiManager;
@@ -0,0 +1,7 @@
+#pragma once
+
+// Placement attributes have no meaning off the target
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
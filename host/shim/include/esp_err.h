@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+#define ESP_ERR_INVALID_CRC 0x109
+#define ESP_ERR_INVALID_VERSION 0x10A
+
+const char* esp_err_to_name(esp_err_t code);
+
+// Aborts like the target does, after naming the call that failed
+void hostErrorCheckFailed(esp_err_t code, const char* file, int line, const char* expression);
+#define ESP_ERROR_CHECK(x)                                            \
+    do {                                                              \
+        esp_err_t err_rc_ = (x);                                      \
+        if (err_rc_ != ESP_OK) {                                      \
+            hostErrorCheckFailed(err_rc_, __FILE__, __LINE__, #x);    \
+        }                                                             \
+    } while (0)
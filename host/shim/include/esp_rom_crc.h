@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// Same polynomial and conventions as the ROM routine
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
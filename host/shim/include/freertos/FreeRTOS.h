@@ -0,0 +1,67 @@
+#pragma once
+
+// Host stand-in for the FreeRTOS kernel. Tasks are threads, the tick
+// follows the steady clock at CONFIG_FREERTOS_HZ and a critical section is
+// a recursive mutex, so code that only relies on the FreeRTOS contract
+// behaves the same. Only what the firmware uses is here.
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define configMAX_PRIORITIES 25
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000U))
+#define pdTICKS_TO_MS(ticks) ((TickType_t)(((uint64_t)(ticks) * 1000U) / configTICK_RATE_HZ))
+
+#define tskIDLE_PRIORITY ((UBaseType_t)0)
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+#if CONFIG_FREERTOS_UNICORE
+#define portNUM_PROCESSORS 1
+#else
+#define portNUM_PROCESSORS 2
+#endif
+
+// Critical sections exclude each other but, unlike on the target, do not
+// stop other tasks from running
+struct portMUX_TYPE {
+    std::recursive_mutex mutex;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) ((mux)->mutex.lock())
+#define portEXIT_CRITICAL(mux) ((mux)->mutex.unlock())
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+#define taskENTER_CRITICAL(mux) portENTER_CRITICAL(mux)
+#define taskEXIT_CRITICAL(mux) portEXIT_CRITICAL(mux)
+#define taskENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define taskEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+// The kernel objects live on the host heap; the static buffers only keep
+// the firmware's layout
+typedef struct {
+    void* reserved;
+} StaticTask_t;
+
+typedef struct {
+    void* reserved;
+} StaticQueue_t;
+
+typedef StaticQueue_t StaticSemaphore_t;
+
+typedef struct {
+    void* reserved;
+} StaticEventGroup_t;
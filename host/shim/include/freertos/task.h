@@ -0,0 +1,35 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct HostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+// Priorities and core affinity are accepted and ignored; the host
+// scheduler decides who runs
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint32_t stack_depth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* created);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stack_depth, void* parameters,
+                                   UBaseType_t priority, TaskHandle_t* created, BaseType_t core);
+TaskHandle_t xTaskCreateStatic(TaskFunction_t code, const char* name, uint32_t stack_depth, void* parameters,
+                               UBaseType_t priority, StackType_t* stack, StaticTask_t* buffer);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t code, const char* name, uint32_t stack_depth,
+                                           void* parameters, UBaseType_t priority, StackType_t* stack,
+                                           StaticTask_t* buffer, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+
+// Delays end on a tick boundary, as on the target
+void vTaskDelay(TickType_t ticks);
+BaseType_t xTaskDelayUntil(TickType_t* previous_wake, TickType_t increment);
+#define vTaskDelayUntil(previous_wake, increment) ((void)xTaskDelayUntil((previous_wake), (increment)))
+TickType_t xTaskGetTickCount(void);
+void taskYIELD(void);
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+TaskHandle_t xTaskGetHandle(const char* name);
+char* pcTaskGetName(TaskHandle_t task);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
@@ -0,0 +1,11 @@
+#pragma once
+
+// The esp32c6 LEDC, less gamma curve fades: the mock runs linear fades
+// only, so Ease ramps take the firmware's linear fallback here
+#define SOC_LEDC_SUPPORTED 1
+#define SOC_LEDC_SUPPORT_PLL_DIV_CLOCK 1
+#define SOC_LEDC_SUPPORT_XTAL_CLOCK 1
+#define SOC_LEDC_CHANNEL_NUM 6
+#define SOC_LEDC_TIMER_BIT_WIDTH 20
+#define SOC_LEDC_SUPPORT_FADE_STOP 1
+#define SOC_PCNT_SUPPORTED 1
@@ -0,0 +1,242 @@
+#include <mutex>
+#include <thread>
+
+#include "HostShim.h"
+#include "driver/ledc.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "HostInternal.h"
+
+namespace {
+
+struct LedcTimer {
+    bool configured = false;
+    uint32_t freq_hz = 0;
+    uint32_t resolution_bits = 0;
+    ledc_clk_cfg_t clk_cfg = LEDC_AUTO_CLK;
+};
+
+// `duty` is what the output runs at once latched; a fade moves it from
+// fade_from to `duty` between fade_start_us and fade_end_us
+struct LedcChannel {
+    bool configured = false;
+    ledc_timer_t timer = LEDC_TIMER_0;
+    uint32_t staged = 0;
+    uint32_t duty = 0;
+    uint32_t fade_from = 0;
+    int64_t fade_start_us = 0;
+    int64_t fade_end_us = 0;
+};
+
+std::mutex ledc_mutex;
+LedcTimer timers[LEDC_TIMER_MAX];
+LedcChannel channels[LEDC_CHANNEL_MAX];
+bool fade_installed = false;
+
+uint32_t clockHz(ledc_clk_cfg_t clk_cfg) {
+    switch (clk_cfg) {
+    case LEDC_USE_XTAL_CLK:
+        return CONFIG_XTAL_FREQ * 1000000U;
+    case LEDC_USE_RC_FAST_CLK:
+        return 17500000;
+    default:
+        return 80000000;
+    }
+}
+
+// The 10.8 fixed point divider has to land in [1, 1024)
+bool dividerInRange(ledc_clk_cfg_t clk_cfg, uint32_t freq_hz, uint32_t bits) {
+    if (freq_hz == 0 || bits == 0 || bits > SOC_LEDC_TIMER_BIT_WIDTH) {
+        return false;
+    }
+    uint64_t counts = static_cast<uint64_t>(freq_hz) << bits;
+    uint64_t divider = ((static_cast<uint64_t>(clockHz(clk_cfg)) << 8) + counts / 2) / counts;
+    return divider >= 256 && divider < (1u << 18);
+}
+
+bool fading(const LedcChannel& ch, int64_t now) {
+    return now < ch.fade_end_us;
+}
+
+uint32_t dutyAt(const LedcChannel& ch, int64_t now) {
+    if (!fading(ch, now)) {
+        return ch.duty;
+    }
+    double done = static_cast<double>(now - ch.fade_start_us) / static_cast<double>(ch.fade_end_us - ch.fade_start_us);
+    return static_cast<uint32_t>(ch.fade_from + (static_cast<double>(ch.duty) - ch.fade_from) * done + 0.5);
+}
+
+bool validChannel(ledc_mode_t mode, ledc_channel_t channel) {
+    return mode == LEDC_LOW_SPEED_MODE && channel >= LEDC_CHANNEL_0 && channel < LEDC_CHANNEL_MAX;
+}
+
+bool validTimer(ledc_mode_t mode, ledc_timer_t timer) {
+    return mode == LEDC_LOW_SPEED_MODE && timer >= LEDC_TIMER_0 && timer < LEDC_TIMER_MAX;
+}
+
+}  // namespace
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t* timer_conf) {
+    host::record("ledc_timer_config", timer_conf->timer_num, timer_conf->freq_hz);
+    if (!validTimer(timer_conf->speed_mode, timer_conf->timer_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!dividerInRange(timer_conf->clk_cfg, timer_conf->freq_hz, timer_conf->duty_resolution)) {
+        return ESP_FAIL;
+    }
+    std::lock_guard<std::mutex> lock(ledc_mutex);
+    LedcTimer& timer = timers[timer_conf->timer_num];
+    timer.configured = true;
+    timer.freq_hz = timer_conf->freq_hz;
+    timer.resolution_bits = timer_conf->duty_resolution;
+    timer.clk_cfg = timer_conf->clk_cfg;
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t* ledc_conf) {
+    host::record("ledc_channel_config", ledc_conf->channel, ledc_conf->duty);
+    if (!validChannel(ledc_conf->speed_mode, ledc_conf->channel)
+        || !validTimer(ledc_conf->speed_mode, ledc_conf->timer_sel)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(ledc_mutex);
+    LedcChannel& ch = channels[ledc_conf->channel];
+    ch.configured = true;
+    ch.timer = ledc_conf->timer_sel;
+    ch.staged = ledc_conf->duty;
+    ch.duty = ledc_conf->duty;
+    ch.fade_end_us = 0;
+    return ESP_OK;
+}
+
+esp_err_t ledc_timer_rst(ledc_mode_t speed_mode, ledc_timer_t timer_sel) {
+    host::record("ledc_timer_rst", timer_sel, 0);
+    return validTimer(speed_mode, timer_sel) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t ledc_set_freq(ledc_mode_t speed_mode, ledc_timer_t timer_num, uint32_t freq_hz) {
+    host::record("ledc_set_freq", timer_num, freq_hz);
+    if (!validTimer(speed_mode, timer_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(ledc_mutex);
+    LedcTimer& timer = timers[timer_num];
+    if (!timer.configured) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!dividerInRange(timer.clk_cfg, freq_hz, timer.resolution_bits)) {
+        return ESP_FAIL;
+    }
+    timer.freq_hz = freq_hz;
+    return ESP_OK;
+}
+
+uint32_t ledc_get_freq(ledc_mode_t speed_mode, ledc_timer_t timer_num) {
+    std::lock_guard<std::mutex> lock(ledc_mutex);
+    return validTimer(speed_mode, timer_num) ? timers[timer_num].freq_hz : 0;
+}
+
+esp_err_t ledc_stop(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t idle_level) {
+    host::record("ledc_stop", channel, idle_level);
+    return validChannel(speed_mode, channel) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+// Like the driver, waits out a running fade, which holds the channel
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty) {
+    host::record("ledc_set_duty", channel, duty);
+    if (!validChannel(speed_mode, channel)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::unique_lock<std::mutex> lock(ledc_mutex);
+    LedcChannel& ch = channels[channel];
+    while (fading(ch, esp_timer_get_time())) {
+        int64_t end_us = ch.fade_end_us;
+        lock.unlock();
+        std::this_thread::sleep_until(host::atMicros(end_us));
+        lock.lock();
+    }
+    ch.staged = duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+    if (!validChannel(speed_mode, channel)) {
+        host::record("ledc_update_duty", channel, 0);
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(ledc_mutex);
+    LedcChannel& ch = channels[channel];
+    ch.duty = ch.staged;
+    host::record("ledc_update_duty", channel, ch.duty);
+    return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+    std::lock_guard<std::mutex> lock(ledc_mutex);
+    return validChannel(speed_mode, channel) ? dutyAt(channels[channel], esp_timer_get_time()) : 0;
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags) {
+    host::record("ledc_fade_func_install", -1, 0);
+    std::lock_guard<std::mutex> lock(ledc_mutex);
+    if (fade_installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    fade_installed = true;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_fade_time_and_start(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t target_duty,
+                                       uint32_t max_fade_time_ms, ledc_fade_mode_t fade_mode) {
+    host::record("ledc_set_fade_time_and_start", channel, target_duty);
+    if (!validChannel(speed_mode, channel)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int64_t end_us = 0;
+    {
+        std::lock_guard<std::mutex> lock(ledc_mutex);
+        if (!fade_installed) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        LedcChannel& ch = channels[channel];
+        int64_t now = esp_timer_get_time();
+        ch.fade_from = dutyAt(ch, now);
+        ch.fade_start_us = now;
+        ch.fade_end_us = now + static_cast<int64_t>(max_fade_time_ms) * 1000;
+        ch.duty = target_duty;
+        ch.staged = target_duty;
+        end_us = ch.fade_end_us;
+    }
+    if (fade_mode == LEDC_FADE_WAIT_DONE) {
+        std::this_thread::sleep_until(host::atMicros(end_us));
+    }
+    return ESP_OK;
+}
+
+// The output stays where the fade had got to
+esp_err_t ledc_fade_stop(ledc_mode_t speed_mode, ledc_channel_t channel) {
+    host::record("ledc_fade_stop", channel, 0);
+    if (!validChannel(speed_mode, channel)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(ledc_mutex);
+    LedcChannel& ch = channels[channel];
+    ch.duty = dutyAt(ch, esp_timer_get_time());
+    ch.staged = ch.duty;
+    ch.fade_end_us = 0;
+    return ESP_OK;
+}
+
+uint32_t host::ledcDuty(int channel) {
+    return ledc_get_duty(LEDC_LOW_SPEED_MODE, static_cast<ledc_channel_t>(channel));
+}
+
+uint32_t host::ledcFrequency(int timer) {
+    return ledc_get_freq(LEDC_LOW_SPEED_MODE, static_cast<ledc_timer_t>(timer));
+}
+
+uint32_t host::ledcResolution(int timer) {
+    std::lock_guard<std::mutex> lock(ledc_mutex);
+    return timer >= 0 && timer < LEDC_TIMER_MAX ? timers[timer].resolution_bits : 0;
+}
@@ -0,0 +1,213 @@
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "HostShim.h"
+#include "nvs.h"
+
+#include "HostInternal.h"
+
+struct nvs_opaque_iterator_t {
+    std::vector<nvs_entry_info_t> entries;
+    size_t position = 0;
+};
+
+namespace {
+
+struct NvsEntry {
+    nvs_type_t type;
+    std::vector<uint8_t> data;  // strings keep their terminator
+};
+
+struct NvsHandle {
+    std::string namespace_name;
+    bool writable;
+};
+
+std::mutex nvs_mutex;
+std::map<std::string, std::map<std::string, NvsEntry>> partition;
+std::map<nvs_handle_t, NvsHandle> handles;
+nvs_handle_t next_handle = 1;
+int failing_writes = 0;
+esp_err_t failing_error = ESP_OK;
+
+NvsHandle* findHandle(nvs_handle_t handle) {
+    auto found = handles.find(handle);
+    return found != handles.end() ? &found->second : nullptr;
+}
+
+esp_err_t setEntry(nvs_handle_t handle, const char* key, nvs_type_t type, const void* value, size_t length) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    NvsHandle* open = findHandle(handle);
+    if (open == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!open->writable) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    if (key == nullptr || strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    if (failing_writes > 0) {
+        --failing_writes;
+        return failing_error;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(value);
+    partition[open->namespace_name][key] = NvsEntry{type, std::vector<uint8_t>(bytes, bytes + length)};
+    return ESP_OK;
+}
+
+// With out_value null only the length is returned, as in the driver
+esp_err_t getEntry(nvs_handle_t handle, const char* key, nvs_type_t type, void* out_value, size_t* length) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    NvsHandle* open = findHandle(handle);
+    if (open == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    auto& entries = partition[open->namespace_name];
+    auto found = entries.find(key);
+    if (found == entries.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (found->second.type != type) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    const std::vector<uint8_t>& data = found->second.data;
+    if (out_value == nullptr) {
+        *length = data.size();
+        return ESP_OK;
+    }
+    if (*length < data.size()) {
+        *length = data.size();
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, data.data(), data.size());
+    *length = data.size();
+    return ESP_OK;
+}
+
+}  // namespace
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle) {
+    if (name == nullptr || strlen(name) >= NVS_NS_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    // Read-only opens do not create the namespace
+    if (open_mode == NVS_READONLY && partition.find(name) == partition.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    partition[name];
+    *out_handle = next_handle++;
+    handles[*out_handle] = NvsHandle{name, open_mode == NVS_READWRITE};
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    handles.erase(handle);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    host::record("nvs_commit", -1, 0);
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    return findHandle(handle) != nullptr ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+    host::record("nvs_erase_key", -1, 0);
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    NvsHandle* open = findHandle(handle);
+    if (open == nullptr) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!open->writable) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    return partition[open->namespace_name].erase(key) > 0 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value) {
+    host::record("nvs_set_str", -1, strlen(value) + 1);
+    return setEntry(handle, key, NVS_TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value, size_t* length) {
+    return getEntry(handle, key, NVS_TYPE_STR, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length) {
+    host::record("nvs_set_blob", -1, length);
+    return setEntry(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length) {
+    return getEntry(handle, key, NVS_TYPE_BLOB, out_value, length);
+}
+
+// Iterators work on a copy taken when the search starts
+esp_err_t nvs_entry_find(const char* part_name, const char* namespace_name, nvs_type_t type,
+                         nvs_iterator_t* output_iterator) {
+    *output_iterator = nullptr;
+    if (part_name == nullptr || strcmp(part_name, NVS_DEFAULT_PART_NAME) != 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    nvs_opaque_iterator_t* it = new nvs_opaque_iterator_t;
+    {
+        std::lock_guard<std::mutex> lock(nvs_mutex);
+        for (const auto& [name, entries] : partition) {
+            if (namespace_name != nullptr && name != namespace_name) {
+                continue;
+            }
+            for (const auto& [key, entry] : entries) {
+                if (type != NVS_TYPE_ANY && entry.type != type) {
+                    continue;
+                }
+                nvs_entry_info_t info{};
+                strncpy(info.namespace_name, name.c_str(), sizeof(info.namespace_name) - 1);
+                strncpy(info.key, key.c_str(), sizeof(info.key) - 1);
+                info.type = entry.type;
+                it->entries.push_back(info);
+            }
+        }
+    }
+    if (it->entries.empty()) {
+        delete it;
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *output_iterator = it;
+    return ESP_OK;
+}
+
+// Past the last entry the iterator is released and nulled
+esp_err_t nvs_entry_next(nvs_iterator_t* iterator) {
+    if (iterator == nullptr || *iterator == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (++(*iterator)->position >= (*iterator)->entries.size()) {
+        delete *iterator;
+        *iterator = nullptr;
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_info(const nvs_iterator_t iterator, nvs_entry_info_t* out_info) {
+    if (iterator == nullptr || out_info == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_info = iterator->entries[iterator->position];
+    return ESP_OK;
+}
+
+void nvs_release_iterator(nvs_iterator_t iterator) {
+    delete iterator;
+}
+
+void host::failNvsWrites(int count, esp_err_t error) {
+    std::lock_guard<std::mutex> lock(nvs_mutex);
+    failing_writes = count;
+    failing_error = error;
+}
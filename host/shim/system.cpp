@@ -0,0 +1,180 @@
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "HostShim.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "HostInternal.h"
+
+namespace {
+
+std::mutex calls_mutex;
+std::vector<HostCall> recorded;
+
+std::mutex log_mutex;
+std::map<std::string, esp_log_level_t> log_levels;
+esp_log_level_t default_log_level = ESP_LOG_INFO;
+
+std::vector<shutdown_handler_t> shutdown_handlers;
+
+// esp_timer time starts with the process rather than at first use
+const host::Clock::time_point process_start = host::epoch();
+
+}  // namespace
+
+host::Clock::time_point host::epoch() {
+    static const Clock::time_point start = Clock::now();
+    return start;
+}
+
+void host::record(const char* function, int unit, uint64_t value) {
+    int64_t now = esp_timer_get_time();
+    std::lock_guard<std::mutex> lock(calls_mutex);
+    recorded.push_back(HostCall{now, function, unit, value});
+}
+
+std::vector<HostCall> host::calls() {
+    std::lock_guard<std::mutex> lock(calls_mutex);
+    return recorded;
+}
+
+std::vector<HostCall> host::calls(const char* function, int64_t since_us) {
+    std::vector<HostCall> matching;
+    std::lock_guard<std::mutex> lock(calls_mutex);
+    for (const HostCall& call : recorded) {
+        if (call.time_us >= since_us && std::string(call.function) == function) {
+            matching.push_back(call);
+        }
+    }
+    return matching;
+}
+
+void host::clearCalls() {
+    std::lock_guard<std::mutex> lock(calls_mutex);
+    recorded.clear();
+}
+
+void host::finish(int status) {
+    fflush(stdout);
+    fflush(stderr);
+    std::_Exit(status);
+}
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+    std::lock_guard<std::mutex> lock(log_mutex);
+    if (std::string(tag) == "*") {
+        default_log_level = level;
+        log_levels.clear();
+    } else {
+        log_levels[tag] = level;
+    }
+}
+
+esp_log_level_t esp_log_level_get(const char* tag) {
+    std::lock_guard<std::mutex> lock(log_mutex);
+    auto found = log_levels.find(tag);
+    return found != log_levels.end() ? found->second : default_log_level;
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+    if (level > esp_log_level_get(tag)) {
+        return;
+    }
+    static const char letters[] = "NEWIDV";
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    std::lock_guard<std::mutex> lock(log_mutex);
+    printf("%c (%lld) %s: %s\n", letters[level], static_cast<long long>(esp_timer_get_time() / 1000), tag, message);
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_TYPE_MISMATCH: return "ESP_ERR_NVS_TYPE_MISMATCH";
+    case ESP_ERR_NVS_READ_ONLY: return "ESP_ERR_NVS_READ_ONLY";
+    case ESP_ERR_NVS_NOT_ENOUGH_SPACE: return "ESP_ERR_NVS_NOT_ENOUGH_SPACE";
+    case ESP_ERR_NVS_INVALID_NAME: return "ESP_ERR_NVS_INVALID_NAME";
+    case ESP_ERR_NVS_INVALID_HANDLE: return "ESP_ERR_NVS_INVALID_HANDLE";
+    case ESP_ERR_NVS_KEY_TOO_LONG: return "ESP_ERR_NVS_KEY_TOO_LONG";
+    case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+void hostErrorCheckFailed(esp_err_t code, const char* file, int line, const char* expression) {
+    fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\nexpression: %s\n", code,
+            esp_err_to_name(code), file, line, expression);
+    std::abort();
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; ++i) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return ESP_RST_POWERON;
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+    shutdown_handlers.push_back(handler);
+    return ESP_OK;
+}
+
+void esp_restart(void) {
+    for (shutdown_handler_t handler : shutdown_handlers) {
+        handler();
+    }
+    host::finish(0);
+}
+
+// The host has no heap budget to report
+uint32_t esp_get_free_heap_size(void) {
+    return 0;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return 0;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return 0;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return 0;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return 0;
+}
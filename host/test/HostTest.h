@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdio>
+
+// Just enough of a test harness for ctest: CHECK reports a failed
+// condition with its place and carries on, RUN names the test it belongs
+// to, and failures() is the process's exit status.
+namespace hosttest {
+
+inline int failed = 0;
+inline const char* current = "";
+
+inline bool check(bool ok, const char* condition, const char* file, int line) {
+    if (!ok) {
+        ++failed;
+        std::printf("FAIL %s: %s:%d: %s\n", current, file, line, condition);
+    }
+    return ok;
+}
+
+inline void run(const char* name, void (*test)()) {
+    int before = failed;
+    current = name;
+    test();
+    std::printf("%s %s\n", failed == before ? "ok" : "FAILED", name);
+}
+
+inline int failures() {
+    return failed == 0 ? 0 : 1;
+}
+
+}  // namespace hosttest
+
+#define CHECK(condition) hosttest::check((condition), #condition, __FILE__, __LINE__)
+#define RUN(test) hosttest::run(#test, test)
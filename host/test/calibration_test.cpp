@@ -0,0 +1,80 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "Calibration.h"
+#include "HostTest.h"
+
+// A pump with no flow below 25% drive, reaching full flow at full drive
+namespace {
+
+CalibrationTable deadbandTable() {
+    CalibrationCurve curve;
+    curve.count = 3;
+    curve.points[0] = {0, 2500};
+    curve.points[1] = {5000, 6000};
+    curve.points[2] = {10000, 10000};
+    CHECK(validateCalibration(curve) == nullptr);
+    CalibrationTable table;
+    table.build(curve);
+    return table;
+}
+
+uint32_t level(uint32_t centi) {
+    return (centi * level_full_scale + 5000) / 10000;
+}
+
+// Within one table step, as between samples the table cuts the corner
+// at a point
+bool near(uint32_t value, uint32_t expected) {
+    int32_t step = level_full_scale / CalibrationTable::segments;
+    return std::abs(static_cast<int32_t>(value) - static_cast<int32_t>(expected)) <= step;
+}
+
+// No flow is off; the least flow above it starts at the dead band edge,
+// and full flow is the last point's drive
+void flowEndpoints() {
+    CalibrationTable table = deadbandTable();
+    CHECK(table.flowToDrive(0) == 0);
+    CHECK(near(table.flowToDrive(1), level(2500)));
+    CHECK(near(table.flowToDrive(level(5000)), level(6000)));
+    CHECK(table.flowToDrive(level_full_scale) == level_full_scale);
+}
+
+// Drive 0, and any drive up to the dead band edge, gives no flow; full
+// drive gives full flow
+void driveEndpoints() {
+    CalibrationTable table = deadbandTable();
+    CHECK(table.driveToFlow(0) == 0);
+    CHECK(table.driveToFlow(level(2000)) == 0);
+    CHECK(near(table.driveToFlow(level(2500)), 0));
+    CHECK(near(table.driveToFlow(level(6000)), level(5000)));
+    CHECK(table.driveToFlow(level_full_scale) == level_full_scale);
+}
+
+// Off maps to no flow and back to off
+void offRoundTrips() {
+    CalibrationTable table = deadbandTable();
+    CHECK(table.driveToFlow(table.flowToDrive(0)) == 0);
+    CHECK(table.flowToDrive(table.driveToFlow(0)) == 0);
+}
+
+// Without a curve flow is drive, at the endpoints too
+void uncalibratedIsIdentity() {
+    CalibrationTable table;
+    table.build(CalibrationCurve{});
+    CHECK(!table.calibrated());
+    CHECK(table.flowToDrive(0) == 0);
+    CHECK(table.driveToFlow(0) == 0);
+    CHECK(table.flowToDrive(level_full_scale) == level_full_scale);
+    CHECK(table.driveToFlow(level_full_scale) == level_full_scale);
+}
+
+}  // namespace
+
+int main() {
+    RUN(flowEndpoints);
+    RUN(driveEndpoints);
+    RUN(offRoundTrips);
+    RUN(uncalibratedIsIdentity);
+    return hosttest::failures();
+}
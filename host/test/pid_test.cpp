@@ -0,0 +1,151 @@
+#include <cmath>
+#include <cstdio>
+
+#include "HostTest.h"
+#include "PidController.h"
+
+// A pump or fan as a first-order plant: speed follows the duty with gain
+// RPM_PER_DUTY and time constant TAU_S, so full duty settles at 3000 RPM
+namespace {
+
+const float RPM_PER_DUTY = 30.0f;
+const float TAU_S = 0.5f;
+const float DT_S = 0.05f;   // SPEED_CONTROL_PERIOD_MS's default
+
+struct Plant {
+    float rpm = 0.0f;
+
+    void step(float duty, float dt) {
+        rpm += (RPM_PER_DUTY * duty - rpm) * dt / TAU_S;
+    }
+};
+
+// The Kconfig defaults: 0.020 %/RPM, 0.040 %/RPM s, no D
+PidGains defaultGains() {
+    PidGains gains;
+    gains.kp = 0.02f;
+    gains.ki = 0.04f;
+    return gains;
+}
+
+struct Loop {
+    PidController pid;
+    Plant plant;
+    float duty = 0.0f;
+
+    explicit Loop(const PidGains& gains) : pid(gains) {
+        pid.reset(0.0f, 0.0f);
+    }
+
+    // Runs the loop for `seconds`; returns the highest speed seen
+    float run(float target, float seconds) {
+        float peak = plant.rpm;
+        for (int i = 0; i < static_cast<int>(seconds / DT_S + 0.5f); ++i) {
+            duty = pid.update(target, plant.rpm, DT_S);
+            plant.step(duty, DT_S);
+            peak = std::fmax(peak, plant.rpm);
+        }
+        return peak;
+    }
+
+    // Seconds until the speed stays within `band` of `target`, or -1
+    float settle(float target, float band, float seconds) {
+        float settled = -1.0f;
+        for (int i = 0; i < static_cast<int>(seconds / DT_S + 0.5f); ++i) {
+            duty = pid.update(target, plant.rpm, DT_S);
+            plant.step(duty, DT_S);
+            if (std::fabs(plant.rpm - target) > band) {
+                settled = -1.0f;
+            } else if (settled < 0.0f) {
+                settled = (i + 1) * DT_S;
+            }
+        }
+        return settled;
+    }
+};
+
+// The integral carries the steady-state duty, so the speed lands on the
+// setpoint with no offset and follows it when it moves
+void tracksSetpoint() {
+    Loop loop(defaultGains());
+    loop.run(1500.0f, 10.0f);
+    CHECK(std::fabs(loop.plant.rpm - 1500.0f) < 5.0f);
+    CHECK(std::fabs(loop.duty - 1500.0f / RPM_PER_DUTY) < 0.5f);
+
+    loop.run(600.0f, 10.0f);
+    CHECK(std::fabs(loop.plant.rpm - 600.0f) < 5.0f);
+    CHECK(std::fabs(loop.pid.getIntegral() - 600.0f / RPM_PER_DUTY) < 0.5f);
+}
+
+// An unreachable setpoint pins the output at its limit without the
+// integral running up behind it, so a reachable one afterwards is
+// followed as quickly as from rest and without a windup overshoot
+void limitsOutputWithoutWindup() {
+    PidGains gains = defaultGains();
+    Loop loop(gains);
+    bool inLimits = true;
+    for (int i = 0; i < 400; ++i) {
+        loop.run(5000.0f, DT_S);
+        inLimits = inLimits && loop.duty >= gains.out_min && loop.duty <= gains.out_max;
+    }
+    CHECK(inLimits);
+    CHECK(loop.duty == gains.out_max);
+    // Only as much integral as, with P, holds the limit
+    CHECK(std::fabs(loop.pid.getIntegral() + gains.kp * (5000.0f - loop.plant.rpm) - gains.out_max) < 0.5f);
+    CHECK(std::fabs(loop.plant.rpm - RPM_PER_DUTY * gains.out_max) < 5.0f);
+
+    // Down from full speed to 1500
+    float settled = loop.settle(1500.0f, 30.0f, 10.0f);
+    CHECK(settled > 0.0f && settled < 4.0f);
+    CHECK(std::fabs(loop.plant.rpm - 1500.0f) < 5.0f);
+
+    // The same at the lower limit: asked to go below zero, then back up
+    for (int i = 0; i < 400; ++i) {
+        loop.run(-1000.0f, DT_S);
+    }
+    CHECK(loop.duty == gains.out_min);
+    CHECK(loop.pid.getIntegral() >= gains.out_min);
+    float peak = loop.run(1500.0f, 10.0f);
+    CHECK(peak < 1500.0f * 1.05f);
+    CHECK(std::fabs(loop.plant.rpm - 1500.0f) < 5.0f);
+}
+
+// A setpoint step from steady state settles within a few time constants
+// and overshoots little; with D on, the step does not kick the output,
+// because the derivative acts on the measurement
+void stepResponse() {
+    Loop loop(defaultGains());
+    loop.run(1000.0f, 10.0f);
+    float peak = loop.plant.rpm;
+    float settled = -1.0f;
+    for (int i = 0; i < 200; ++i) {
+        loop.run(2000.0f, DT_S);
+        peak = std::fmax(peak, loop.plant.rpm);
+        if (std::fabs(loop.plant.rpm - 2000.0f) > 40.0f) {
+            settled = -1.0f;
+        } else if (settled < 0.0f) {
+            settled = (i + 1) * DT_S;
+        }
+    }
+    CHECK(settled > 0.0f && settled < 4.0f);
+    CHECK(peak < 2000.0f * 1.05f);
+
+    PidGains gains = defaultGains();
+    gains.kd = 0.01f;
+    Loop damped(gains);
+    damped.run(1000.0f, 10.0f);
+    float before = damped.duty;
+    float first = damped.pid.update(2000.0f, damped.plant.rpm, DT_S);
+    float error = 2000.0f - damped.plant.rpm;
+    // Proportional and one step of integral only
+    CHECK(std::fabs(first - before - (gains.kp + gains.ki * DT_S) * error) < 0.5f);
+}
+
+}  // namespace
+
+int main() {
+    RUN(tracksSetpoint);
+    RUN(limitsOutputWithoutWindup);
+    RUN(stepResponse);
+    return hosttest::failures();
+}
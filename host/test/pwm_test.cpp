@@ -0,0 +1,265 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include "HostShim.h"
+#include "HostTest.h"
+#include "LedcTiming.h"
+#include "LocalWebServer.h"
+#include "NvsStorageManager.h"
+#include "PWMControl.h"
+#include "SettingsManager.h"
+
+// PWMControl on the recording LEDC shim: what reached the outputs, and when,
+// directly and through the web server's handlers
+namespace {
+
+const int64_t TICK_US = 1000000 / configTICK_RATE_HZ;
+
+PWMControl* pump = nullptr;
+
+void sleepUntil(int64_t time_us) {
+    int64_t now = esp_timer_get_time();
+    if (time_us > now) {
+        std::this_thread::sleep_for(std::chrono::microseconds(time_us - now));
+    }
+}
+
+// A pulse is ended by its own esp_timer, so the output reverts at the
+// deadline rather than on the next tick after it
+void pulseEndsAtItsDeadline() {
+    PwmChannelState state = pump->waitApplied(0, pump->setDutyCyclePercentage(0, 20.0f));
+    uint32_t base = host::ledcDuty(0);
+
+    // Just after a tick, so the deadline falls early in one
+    int64_t now = esp_timer_get_time();
+    sleepUntil(now - now % TICK_US + TICK_US + 500);
+    state = pump->waitApplied(0, pump->setDutyCyclePercentage(0, 80.0f, 21));
+    CHECK(state.pulse_active);
+    CHECK(host::ledcDuty(0) != base);
+    int64_t deadline = state.pulse_deadline_us;
+    int64_t nextTick = (deadline / TICK_US + 1) * TICK_US;
+    CHECK(nextTick - deadline > 5000);
+
+    sleepUntil(deadline + 3 * TICK_US);
+    const HostCall* revert = nullptr;
+    std::vector<HostCall> latches = host::calls("ledc_update_duty", deadline);
+    for (const HostCall& call : latches) {
+        if (call.unit == 0) {
+            revert = &call;
+            break;
+        }
+    }
+    if (!CHECK(revert != nullptr)) {
+        return;
+    }
+    CHECK(revert->value == base);
+    CHECK(revert->time_us - deadline < 3000);
+    CHECK(revert->time_us < nextTick);
+    CHECK(!pump->getState(0).pulse_active);
+}
+
+// Time from `sent` to channel 0's duty being latched, or -1 if it was not
+int64_t latchedAfter(int64_t sent) {
+    for (const HostCall& call : host::calls("ledc_update_duty", sent)) {
+        if (call.unit == 0) {
+            return call.time_us - sent;
+        }
+    }
+    return -1;
+}
+
+// Just after a tick, so anything waiting for the next one would show it
+void sleepPastTick() {
+    int64_t now = esp_timer_get_time();
+    sleepUntil(now - now % TICK_US + TICK_US + 500);
+}
+
+// A long pulse does not hold up the commands behind it: pulses stacked on
+// it, more than the queue holds, and the setpoint that ends it are each
+// latched well within a tick of being sent
+void commandsApplyDuringLongPulse() {
+    pump->waitApplied(0, pump->setDutyCyclePercentage(0, 20.0f));
+    uint32_t base = host::ledcDuty(0);
+
+    sleepPastTick();
+    int64_t sent = esp_timer_get_time();
+    PwmChannelState state = pump->waitApplied(0, pump->setDutyCyclePercentage(0, 80.0f, 60000));
+    CHECK(state.pulse_active);
+    int64_t latency = latchedAfter(sent);
+    CHECK(latency >= 0 && latency < 3000);
+
+    for (int i = 0; i < 12; ++i) {
+        sleepPastTick();
+        sent = esp_timer_get_time();
+        uint32_t seq = pump->setDutyCyclePercentage(0, 30.0f + 5.0f * i, 60000);
+        if (!CHECK(seq != 0)) {
+            return;
+        }
+        state = pump->waitApplied(0, seq);
+        latency = latchedAfter(sent);
+        if (!CHECK(latency >= 0 && latency < 3000)) {
+            printf("  pulse %d latched after %lld us\n", i, static_cast<long long>(latency));
+        }
+        CHECK(state.pulse_active);
+        CHECK(std::fabs(state.duty - (30.0f + 5.0f * i)) < 0.1f);
+        CHECK(std::fabs(state.target - 20.0f) < 0.1f);
+    }
+
+    sleepPastTick();
+    sent = esp_timer_get_time();
+    state = pump->waitApplied(0, pump->setDutyCyclePercentage(0, 20.0f));
+    latency = latchedAfter(sent);
+    if (!CHECK(latency >= 0 && latency < 3000)) {
+        printf("  setpoint latched after %lld us\n", static_cast<long long>(latency));
+    }
+    CHECK(!state.pulse_active);
+    CHECK(host::ledcDuty(0) == base);
+}
+
+int countCalls(const std::vector<HostCall>& calls, const char* function) {
+    int count = 0;
+    for (const HostCall& call : calls) {
+        count += strcmp(call.function, function) == 0;
+    }
+    return count;
+}
+
+void retune(int frequency) {
+    pump->waitApplied(0, pump->setFrequency(0, frequency));
+}
+
+// A frequency the timer reaches at the same clock and resolution is set in
+// place with ledc_set_freq: no reconfiguration, no stop and start, and the
+// duty register is left as it was
+void retuneKeepsDutyInPlace() {
+    LedcTiming from = ledcSelectTiming(5000);
+    LedcTiming to = ledcSelectTiming(5500);
+    CHECK(from.clock == to.clock && from.resolution_bits == to.resolution_bits);
+    retune(5000);
+    PwmChannelState before = pump->waitApplied(0, pump->setDutyCyclePercentage(0, 37.0f));
+    uint32_t duty = host::ledcDuty(0);
+
+    int64_t since = esp_timer_get_time();
+    PwmChannelState after = pump->waitApplied(0, pump->setFrequency(0, 5500));
+    std::vector<HostCall> calls = host::calls();
+    std::erase_if(calls, [&](const HostCall& call) { return call.time_us < since; });
+
+    CHECK(countCalls(calls, "ledc_set_freq") == 1);
+    for (const char* function : {"ledc_timer_config", "ledc_channel_config", "ledc_timer_rst", "ledc_stop",
+                                 "ledc_set_duty", "ledc_update_duty", "ledc_fade_stop"}) {
+        if (!CHECK(countCalls(calls, function) == 0)) {
+            printf("  %s was called\n", function);
+        }
+    }
+    for (const HostCall& call : host::calls("ledc_set_freq", since)) {
+        CHECK(call.value == 5500);
+        CHECK(host::ledcFrequency(call.unit) == 5500);
+    }
+    CHECK(after.frequency == 5500);
+    CHECK(after.achieved_hz == to.achieved_hz);
+    CHECK(after.last_retune_gap_us == 0);
+    // The retune is one ledc_set_freq call, well under the driver's stop,
+    // configure and start
+    CHECK(after.last_retune_us >= 0);
+    CHECK(after.last_retune_us <= esp_timer_get_time() - since);
+    CHECK(after.last_retune_us < 1000);
+    CHECK(after.duty == before.duty);
+    CHECK(host::ledcDuty(0) == duty);
+}
+
+// One that needs other duty bits reconfigures the timer and rescales the
+// duty, so the output keeps its percentage
+void retuneToOtherResolutionKeepsPercentage() {
+    retune(5000);
+    pump->waitApplied(0, pump->setDutyCyclePercentage(0, 37.0f));
+    LedcTiming to = ledcSelectTiming(20000);
+    CHECK(to.resolution_bits != ledcSelectTiming(5000).resolution_bits);
+
+    int64_t since = esp_timer_get_time();
+    PwmChannelState after = pump->waitApplied(0, pump->setFrequency(0, 20000));
+    std::vector<HostCall> configs = host::calls("ledc_timer_config", since);
+    std::vector<HostCall> updates = host::calls("ledc_update_duty", since);
+    if (!CHECK(!configs.empty() && !updates.empty())) {
+        return;
+    }
+    // The gap runs from reconfiguring the timer to the duty being latched
+    // again, and is part of the whole retune
+    CHECK(after.last_retune_gap_us >= updates.back().time_us - configs.front().time_us);
+    CHECK(after.last_retune_gap_us <= after.last_retune_us);
+    CHECK(after.last_retune_us <= esp_timer_get_time() - since);
+    CHECK(after.last_retune_us < 5000);
+    CHECK(after.frequency == 20000);
+    CHECK(after.resolution_bits == to.resolution_bits);
+    CHECK(std::fabs(after.duty - 37.0f) < 0.1f);
+    float percent = 100.0f * host::ledcDuty(0) / (1u << to.resolution_bits);
+    CHECK(std::fabs(percent - 37.0f) < 0.1f);
+}
+
+// A frequency that would allow more duty bits is still set in place when
+// the current resolution reaches it; the resolution is not raised
+void lowerFrequencyKeepsResolution() {
+    retune(20000);
+    PwmChannelState before = pump->waitApplied(0, pump->setDutyCyclePercentage(0, 37.0f));
+    uint32_t duty = host::ledcDuty(0);
+    CHECK(ledcSelectTiming(5000).resolution_bits > before.resolution_bits);
+
+    int64_t since = esp_timer_get_time();
+    PwmChannelState after = pump->waitApplied(0, pump->setFrequency(0, 5000));
+    CHECK(host::calls("ledc_set_freq", since).size() == 1);
+    CHECK(host::calls("ledc_timer_config", since).empty());
+    CHECK(host::calls("ledc_update_duty", since).empty());
+    CHECK(after.frequency == 5000);
+    CHECK(after.resolution_bits == before.resolution_bits);
+    uint32_t clock_hz = ledcSelectTiming(20000).clock->hz;
+    CHECK(after.achieved_hz == ledcAchievedFrequency(clock_hz, 5000, before.resolution_bits));
+    CHECK(after.last_retune_gap_us == 0);
+    CHECK(host::ledcDuty(0) == duty);
+    CHECK(host::ledcFrequency(host::calls("ledc_set_freq", since).front().unit) == 5000);
+}
+
+// A batch answers with each channel as applied, like /pump does for one,
+// and a refused entry changes nothing
+void batchAnswersWithAppliedState() {
+    HostResponse response =
+        host::httpRequest(HTTP_POST, "/pump/batch", "{\"channels\": [{\"id\": 0, \"duty\": 42.5}]}");
+    CHECK(response.status == 200);
+    CHECK(response.body.find("{\"status\":\"OK\",\"channels\":[{\"status\":\"OK\",\"id\":0,\"duty\":42.5,")
+          == 0);
+    PwmChannelState state = pump->getState(0);
+    CHECK(std::fabs(state.duty - 42.5f) < 0.1f);
+    uint32_t duty = host::ledcDuty(0);
+
+    response = host::httpRequest(HTTP_POST, "/pump/batch", "{\"channels\": [{\"id\": 0, \"duty\": 150}]}");
+    CHECK(response.status == 400);
+    CHECK(response.body.find("'duty' out of range") != std::string::npos);
+    CHECK(host::ledcDuty(0) == duty);
+}
+
+}  // namespace
+
+int main() {
+    static NvsStorageManager nv;
+    static SettingsManager settings(nv);
+    static PWMControl control(settings);
+    pump = &control;
+    static LocalWebContext ctx{nullptr, &control, &settings, nullptr, nullptr, nullptr};
+    static LocalWebServer webServer{&ctx};
+    if (!CHECK(webServer.start() == ESP_OK)) {
+        host::finish(hosttest::failures());
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    RUN(pulseEndsAtItsDeadline);
+    RUN(commandsApplyDuringLongPulse);
+    RUN(retuneKeepsDutyInPlace);
+    RUN(retuneToOtherResolutionKeepsPercentage);
+    RUN(lowerFrequencyKeepsResolution);
+    RUN(batchAnswersWithAppliedState);
+    // The control tasks never return, so leave without unwinding
+    host::finish(hosttest::failures());
+}
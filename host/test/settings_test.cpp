@@ -0,0 +1,123 @@
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "esp_log.h"
+#include "nvs.h"
+
+#include "HostShim.h"
+#include "HostTest.h"
+#include "NvsStorageManager.h"
+#include "SettingsManager.h"
+
+// SettingsManager on the NVS shim: migration of the string settings
+// earlier firmware kept through NvsStorageManager, and the write-behind
+// flush
+namespace {
+
+NvsStorageManager nv;
+
+void putString(const char* ns, const char* key, const char* value) {
+    nvs_handle_t handle;
+    nvs_open(ns, NVS_READWRITE, &handle);
+    nvs_set_str(handle, key, value);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+bool hasString(const char* ns, const char* key) {
+    nvs_handle_t handle;
+    if (nvs_open(ns, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    size_t length = 0;
+    bool found = nvs_get_str(handle, key, nullptr, &length) == ESP_OK;
+    nvs_close(handle);
+    return found;
+}
+
+void eraseString(const char* ns, const char* key) {
+    nvs_handle_t handle;
+    if (nvs_open(ns, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_erase_key(handle, key);
+        nvs_close(handle);
+    }
+}
+
+// Without a blob the next SettingsManager migrates again
+void forgetBlob() {
+    eraseString(settings_blob_namespace, settings_blob_key);
+}
+
+// Keys with the schema's names in other components' namespaces are not
+// touched; only those NvsStorageManager returned are erased
+void migrationErasesOnlyItsOwnKeys() {
+    forgetBlob();
+    putString(NvsStorageManager::NAMESPACE, "tz", "EST5");
+    putString(NvsStorageManager::NAMESPACE, "duty", "40");
+    putString("other", "tz", "UTC0");
+    putString("other", "duty", "40");
+    putString("other", "frequency", "2000");
+
+    SettingsManager settings(nv);
+    CHECK(settings.snapshot().tz == "EST5");
+    CHECK(settings.snapshot().channels[0].duty == 40.0f);
+    CHECK(!hasString(NvsStorageManager::NAMESPACE, "tz"));
+    CHECK(!hasString(NvsStorageManager::NAMESPACE, "duty"));
+    CHECK(hasString("other", "tz"));
+    CHECK(hasString("other", "duty"));
+    CHECK(hasString("other", "frequency"));
+    eraseString("other", "tz");
+    eraseString("other", "duty");
+    eraseString("other", "frequency");
+}
+
+// When another namespace holds the same keys and values, which one the
+// store used is not certain, so both are left
+void ambiguousNamespaceKeepsKeys() {
+    forgetBlob();
+    putString(NvsStorageManager::NAMESPACE, "tz", "CET-1");
+    putString("mirror", "tz", "CET-1");
+
+    SettingsManager settings(nv);
+    CHECK(settings.snapshot().tz == "CET-1");
+    CHECK(hasString(NvsStorageManager::NAMESPACE, "tz"));
+    CHECK(hasString("mirror", "tz"));
+    eraseString(NvsStorageManager::NAMESPACE, "tz");
+    eraseString("mirror", "tz");
+}
+
+// A failed write leaves the settings pending; the flush timer is armed
+// again and its retry writes them
+void failedFlushIsRetried() {
+    SettingsManager settings(nv);
+    settings.flush();
+    PersistStats before = settings.getPersistStats();
+
+    host::failNvsWrites(1);
+    settings.save();
+    settings.flush();
+    PersistStats failed = settings.getPersistStats();
+    CHECK(failed.failed == before.failed + 1);
+    CHECK(failed.written == before.written);
+
+    // A save while the write is pending again collapses into it
+    settings.save();
+    CHECK(settings.getPersistStats().avoided == before.avoided + 1);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(CONFIG_SETTINGS_FLUSH_QUIET_MS + 500));
+    PersistStats retried = settings.getPersistStats();
+    CHECK(retried.written == before.written + 1);
+    CHECK(retried.failed == before.failed + 1);
+}
+
+}  // namespace
+
+int main() {
+    esp_log_level_set("*", ESP_LOG_WARN);
+    RUN(migrationErasesOnlyItsOwnKeys);
+    RUN(ambiguousNamespaceKeepsKeys);
+    RUN(failedFlushIsRetried);
+    host::finish(hosttest::failures());
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "esp_timer.h"
+
+// Milestones of start-up, in the order they normally happen
+enum class BootPhase : uint8_t {
+    AppMain,
+    SettingsLoaded,
+    OutputRestored,
+    WifiConnected,
+    WebServerStarted,
+    TimeSynced,
+    Count,
+};
+
+// Records when each boot phase was reached, in microseconds since boot.
+// Phases are marked from different tasks, hence the atomics.
+class BootTimeline {
+public:
+    static void mark(BootPhase phase) {
+        times[static_cast<size_t>(phase)].store(esp_timer_get_time());
+    }
+
+    // -1 until the phase has been reached
+    static int64_t at(BootPhase phase) {
+        return times[static_cast<size_t>(phase)].load();
+    }
+
+    static const char* name(BootPhase phase) {
+        switch (phase) {
+        case BootPhase::AppMain:          return "boot_app_main_us";
+        case BootPhase::SettingsLoaded:   return "boot_settings_us";
+        case BootPhase::OutputRestored:   return "boot_output_us";
+        case BootPhase::WifiConnected:    return "boot_wifi_us";
+        case BootPhase::WebServerStarted: return "boot_web_us";
+        case BootPhase::TimeSynced:       return "boot_ntp_us";
+        default:                          return "boot_unknown_us";
+        }
+    }
+
+private:
+    static inline std::atomic<int64_t> times[static_cast<size_t>(BootPhase::Count)] = {
+        -1, -1, -1, -1, -1, -1,
+    };
+};
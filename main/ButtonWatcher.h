@@ -0,0 +1,100 @@
+#pragma once
+
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "MemoryBudget.h"
+#include "TaskConfig.h"
+
+// Watches an active-low button from its GPIO interrupt and calls back once
+// it has been held for CONFIG_BUTTON_LONG_PRESS_MS. The task sleeps until an
+// edge wakes it, so an idle button costs no CPU.
+class ButtonWatcher {
+public:
+    using Callback = void (*)(void* arg);
+
+    static const int DEBOUNCE_MS = 30;
+
+    ButtonWatcher(gpio_num_t pin, Callback onLongPress, void* arg)
+        : pin(pin), onLongPress(onLongPress), arg(arg) {
+    }
+
+    bool start() {
+        gpio_config_t io{};
+        io.pin_bit_mask = 1ULL << pin;
+        io.mode = GPIO_MODE_INPUT;
+        io.pull_up_en = GPIO_PULLUP_ENABLE;
+        io.pull_down_en = GPIO_PULLDOWN_DISABLE;
+        io.intr_type = GPIO_INTR_ANYEDGE;
+        esp_err_t err = gpio_config(&io);
+        if (err != ESP_OK) {
+            ESP_LOGE("ButtonWatcher", "Failed to configure GPIO %d: %s", pin, esp_err_to_name(err));
+            return false;
+        }
+        if (xTaskCreate(buttonTask, "button_task", button_task_stack, this, button_task_priority, &task) != pdPASS) {
+            ESP_LOGE("ButtonWatcher", "Failed to create button task");
+            return false;
+        }
+        // Someone else may have installed the shared ISR service already
+        err = gpio_install_isr_service(0);
+        if (err == ESP_OK || err == ESP_ERR_INVALID_STATE) {
+            err = gpio_isr_handler_add(pin, onEdge, this);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE("ButtonWatcher", "Failed to attach GPIO %d interrupt: %s", pin, esp_err_to_name(err));
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static void IRAM_ATTR onEdge(void* arg) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(static_cast<ButtonWatcher*>(arg)->task, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+
+    // Level once the contacts have settled; edges during the wait are
+    // bounces and are dropped
+    bool settledPressed() const {
+        vTaskDelay(pdMS_TO_TICKS(DEBOUNCE_MS));
+        ulTaskNotifyTake(pdTRUE, 0);
+        return gpio_get_level(pin) == 0;
+    }
+
+    static void buttonTask(void* pvParameter) {
+        ButtonWatcher* button = static_cast<ButtonWatcher*>(pvParameter);
+        for (;;) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            if (!button->settledPressed()) {
+                continue;
+            }
+            // Held until the deadline unless a settled release comes first
+            TickType_t start = xTaskGetTickCount();
+            TickType_t hold = pdMS_TO_TICKS(CONFIG_BUTTON_LONG_PRESS_MS - DEBOUNCE_MS);
+            bool held = true;
+            for (TickType_t waited = 0; held && waited < hold; waited = xTaskGetTickCount() - start) {
+                if (ulTaskNotifyTake(pdTRUE, hold - waited) != 0) {
+                    held = button->settledPressed();
+                }
+            }
+            if (!held) {
+                continue;
+            }
+            button->onLongPress(button->arg);
+            // One callback per hold
+            while (button->settledPressed()) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+        }
+    }
+
+    gpio_num_t pin;
+    Callback onLongPress;
+    void* arg;
+    TaskHandle_t task = nullptr;
+};
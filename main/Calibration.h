@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+
+inline constexpr int calibration_max_points = 16;
+
+// Output levels are fixed point fractions of full scale
+inline constexpr uint32_t level_full_scale = 65535;
+
+// A measured point of a channel's curve: at `duty_centi` drive the pump
+// delivers `flow_centi`, both in hundredths of a percent of full scale.
+// Points run from zero to full flow, with drive rising strictly along
+// them; below the first point's drive there is no flow. The first point
+// marks the edge of that dead band: asking for no flow turns the drive
+// off rather than holding it there.
+struct CalibrationPoint {
+    uint16_t flow_centi;
+    uint16_t duty_centi;
+};
+
+struct CalibrationCurve {
+    uint8_t count = 0;          // 0 = uncalibrated, flow is drive
+    CalibrationPoint points[calibration_max_points] = {};
+};
+
+static_assert(sizeof(CalibrationPoint) == 4, "CalibrationPoint is stored in NVS as is");
+
+// Reason the curve cannot be used, or null if it is fine
+inline const char* validateCalibration(const CalibrationCurve& curve) {
+    if (curve.count == 0) {
+        return nullptr;
+    }
+    if (curve.count < 2 || curve.count > calibration_max_points) {
+        return "A curve needs 2 to 16 points";
+    }
+    if (curve.points[0].flow_centi != 0 || curve.points[curve.count - 1].flow_centi != 10000) {
+        return "A curve must run from flow 0 to flow 100";
+    }
+    for (int i = 0; i < curve.count; ++i) {
+        if (curve.points[i].duty_centi > 10000) {
+            return "Curve duty must be 0 to 100";
+        }
+        if (i > 0 && (curve.points[i].flow_centi <= curve.points[i - 1].flow_centi
+                      || curve.points[i].duty_centi <= curve.points[i - 1].duty_centi)) {
+            return "Curve flow and duty must both rise";
+        }
+    }
+    return nullptr;
+}
+
+// A curve compiled into two dense tables, flow to drive and drive to flow,
+// sampled at `segments` even steps of the input. A lookup is one index and
+// one linear interpolation between neighbours, in integers only; the
+// piecewise curve is only walked when the tables are built.
+class CalibrationTable {
+public:
+    static const uint32_t segments = 256;
+
+    // Compiles `curve`, or goes back to the identity for an empty one
+    void build(const CalibrationCurve& curve) {
+        active = curve.count >= 2;
+        if (!active) {
+            return;
+        }
+        for (uint32_t i = 0; i <= segments; ++i) {
+            uint32_t x = i * level_full_scale / segments;
+            to_drive[i] = static_cast<uint16_t>(interpolate(curve, x, true));
+            to_flow[i] = static_cast<uint16_t>(interpolate(curve, x, false));
+        }
+    }
+
+    bool calibrated() const {
+        return active;
+    }
+
+    // Flow 0 is off, not the dead band edge the table starts at; any flow
+    // above it starts from that edge
+    uint32_t flowToDrive(uint32_t flow) const {
+        return active && flow > 0 ? lookup(to_drive, flow) : flow;
+    }
+
+    uint32_t driveToFlow(uint32_t drive) const {
+        return active ? lookup(to_flow, drive) : drive;
+    }
+
+private:
+    static uint32_t lookup(const uint16_t* table, uint32_t x) {
+        if (x >= level_full_scale) {
+            return table[segments];
+        }
+        uint32_t position = x * segments;
+        uint32_t index = position / level_full_scale;
+        uint32_t fraction = position % level_full_scale;
+        int32_t step = static_cast<int32_t>(table[index + 1]) - table[index];
+        return table[index] + static_cast<int32_t>(static_cast<int64_t>(step) * fraction / level_full_scale);
+    }
+
+    // Walks the points from `x`, a flow level when `forward`, else a drive
+    // level, to the other side of the curve
+    static uint32_t interpolate(const CalibrationCurve& curve, uint32_t x, bool forward) {
+        auto from = [&](int i) { return centiToLevel(forward ? curve.points[i].flow_centi : curve.points[i].duty_centi); };
+        auto to = [&](int i) { return centiToLevel(forward ? curve.points[i].duty_centi : curve.points[i].flow_centi); };
+        if (x <= from(0)) {
+            return to(0);
+        }
+        for (int i = 1; i < curve.count; ++i) {
+            if (x <= from(i)) {
+                uint32_t span = from(i) - from(i - 1);
+                int64_t rise = static_cast<int64_t>(to(i)) - to(i - 1);
+                return to(i - 1) + static_cast<int32_t>((rise * (x - from(i - 1)) + span / 2) / span);
+            }
+        }
+        return to(curve.count - 1);
+    }
+
+    static uint32_t centiToLevel(uint16_t centi) {
+        return (static_cast<uint32_t>(centi) * level_full_scale + 5000) / 10000;
+    }
+
+    bool active = false;
+    uint16_t to_drive[segments + 1] = {};
+    uint16_t to_flow[segments + 1] = {};
+};
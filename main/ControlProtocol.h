@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+// Binary frames carried by the /ws control channel. One command per
+// WebSocket binary message, answered by one ack once the duty task has
+// applied it (or it timed out). All fields are little-endian.
+enum class ControlOp : uint8_t {
+    Duty = 1,       // value: duty in hundredths of a percent (0..10000)
+    Frequency = 2,  // value: frequency in Hz
+};
+
+enum class ControlStatus : uint8_t {
+    Ok = 0,
+    Pending = 1,     // accepted but not applied within the wait bound
+    Busy = 2,        // command queue full; retry later
+    BadFrame = 3,
+    BadChannel = 4,
+    BadValue = 5,
+};
+
+struct __attribute__((packed)) ControlCommandFrame {
+    uint32_t client_seq;    // echoed in the ack
+    uint8_t op;             // ControlOp
+    uint8_t channel;
+    uint16_t ramp_ms;       // Duty only; 0 steps straight there
+    uint32_t value;
+};
+
+struct __attribute__((packed)) ControlAckFrame {
+    uint32_t client_seq;
+    uint32_t applied_seq;   // PWMControl sequence number, 0 if rejected
+    uint8_t status;         // ControlStatus
+    uint8_t channel;
+    uint16_t duty_centi;    // applied duty in hundredths of a percent
+    uint32_t frequency;
+    uint32_t achieved_hz;
+    uint32_t apply_us;      // time from frame receipt to applied state
+};
+
+static_assert(sizeof(ControlCommandFrame) == 12, "command frame layout is part of the protocol");
+static_assert(sizeof(ControlAckFrame) == 24, "ack frame layout is part of the protocol");
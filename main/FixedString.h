@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+// A NUL-terminated string in a buffer of `Capacity` bytes, for settings
+// that must never touch the heap. Text that does not fit is refused rather
+// than cut, so a caller can report it.
+template <size_t Capacity>
+class FixedString {
+public:
+    static_assert(Capacity > 1, "room for at least one character");
+
+    FixedString() = default;
+
+    FixedString(const char* text) {
+        assign(text);
+    }
+
+    bool assign(const char* text) {
+        size_t len = strlen(text);
+        if (len >= Capacity) {
+            return false;
+        }
+        memcpy(data, text, len + 1);
+        return true;
+    }
+
+    FixedString& operator=(const char* text) {
+        assign(text);
+        return *this;
+    }
+
+    const char* c_str() const {
+        return data;
+    }
+
+    size_t size() const {
+        return strlen(data);
+    }
+
+    static constexpr size_t max_size() {
+        return Capacity - 1;
+    }
+
+    bool operator==(const char* other) const {
+        return strcmp(data, other) == 0;
+    }
+
+    bool operator!=(const char* other) const {
+        return !(*this == other);
+    }
+
+private:
+    char data[Capacity] = {};
+};
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cmath>
+#include <cstring>
+
+// In-place parser for the small, flat JSON objects the control endpoints
+// take, e.g. {"duty": 50.0, "period": 5000, "ramp": "ease"}. Strings are
+// unescaped and terminated inside the caller's buffer, so parsing allocates
+// nothing; the buffer must outlive the FlatJson. Nested objects and arrays
+// are rejected. Numbers are scanned here too, since newlib's strtod can
+// allocate.
+class FlatJson {
+public:
+    static const int MAX_FIELDS = 16;   // every setting of four channels
+
+    enum class Type : unsigned char {
+        String,
+        Number,
+        Bool,
+        Null,
+    };
+
+    bool parse(char* text) {
+        count = 0;
+        char* p = skipSpace(text);
+        if (*p++ != '{') {
+            return false;
+        }
+        p = skipSpace(p);
+        if (*p == '}') {
+            return *skipSpace(p + 1) == '\0';
+        }
+        while (true) {
+            if (count == MAX_FIELDS || *p != '"') {
+                return false;
+            }
+            Field& field = fields[count];
+            field.key = p + 1;
+            if ((p = parseString(p)) == nullptr) {
+                return false;
+            }
+            p = skipSpace(p);
+            if (*p++ != ':') {
+                return false;
+            }
+            p = skipSpace(p);
+            if ((p = parseValue(p, field)) == nullptr) {
+                return false;
+            }
+            ++count;
+            p = skipSpace(p);
+            if (*p == '}') {
+                return *skipSpace(p + 1) == '\0';
+            }
+            if (*p++ != ',') {
+                return false;
+            }
+            p = skipSpace(p);
+        }
+    }
+
+    int size() const {
+        return count;
+    }
+
+    // Keys in the order they appear, for callers that walk every field
+    const char* keyAt(int i) const {
+        return fields[i].key;
+    }
+
+    bool contains(const char* key) const {
+        return find(key) != nullptr;
+    }
+
+    bool getFloat(const char* key, float& out) const {
+        const Field* field = find(key);
+        if (field == nullptr || field->type != Type::Number) {
+            return false;
+        }
+        double value = 0.0;
+        bool integral = true;
+        scanNumber(field->value, value, integral);
+        if (!std::isfinite(static_cast<float>(value))) {
+            return false;
+        }
+        out = static_cast<float>(value);
+        return true;
+    }
+
+    // Integers only; "1.5" or "1e3" are rejected rather than truncated.
+    bool getInt(const char* key, int& out) const {
+        const Field* field = find(key);
+        if (field == nullptr || field->type != Type::Number) {
+            return false;
+        }
+        double value = 0.0;
+        bool integral = true;
+        scanNumber(field->value, value, integral);
+        if (!integral || value < -2147483648.0 || value > 2147483647.0) {
+            return false;
+        }
+        out = static_cast<int>(value);
+        return true;
+    }
+
+    bool getBool(const char* key, bool& out) const {
+        const Field* field = find(key);
+        if (field == nullptr || field->type != Type::Bool) {
+            return false;
+        }
+        out = field->value[0] == 't';
+        return true;
+    }
+
+    bool getString(const char* key, const char*& out) const {
+        const Field* field = find(key);
+        if (field == nullptr || field->type != Type::String) {
+            return false;
+        }
+        out = field->value;
+        return true;
+    }
+
+private:
+    struct Field {
+        const char* key;
+        const char* value;
+        Type type;
+    };
+
+    Field fields[MAX_FIELDS];
+    int count = 0;
+
+    const Field* find(const char* key) const {
+        for (int i = 0; i < count; ++i) {
+            if (strcmp(fields[i].key, key) == 0) {
+                return &fields[i];
+            }
+        }
+        return nullptr;
+    }
+
+    static char* skipSpace(char* p) {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            ++p;
+        }
+        return p;
+    }
+
+    // `p` is at the opening quote. Unescapes in place, terminates the string
+    // and returns the position after the closing quote, or null.
+    static char* parseString(char* p) {
+        char* out = ++p;
+        while (*p != '"') {
+            if (*p == '\0' || static_cast<unsigned char>(*p) < 0x20) {
+                return nullptr;
+            }
+            if (*p != '\\') {
+                *out++ = *p++;
+                continue;
+            }
+            switch (*++p) {
+            case '"':  *out++ = '"';  break;
+            case '\\': *out++ = '\\'; break;
+            case '/':  *out++ = '/';  break;
+            case 'b':  *out++ = '\b'; break;
+            case 'f':  *out++ = '\f'; break;
+            case 'n':  *out++ = '\n'; break;
+            case 'r':  *out++ = '\r'; break;
+            case 't':  *out++ = '\t'; break;
+            default:
+                return nullptr;  // \u escapes are not needed by any field
+            }
+            ++p;
+        }
+        *out = '\0';
+        return p + 1;
+    }
+
+    static char* parseValue(char* p, Field& field) {
+        field.value = p;
+        if (*p == '"') {
+            field.type = Type::String;
+            field.value = p + 1;
+            return parseString(p);
+        }
+        if (strncmp(p, "true", 4) == 0 || strncmp(p, "false", 5) == 0) {
+            field.type = Type::Bool;
+            return p + (*p == 't' ? 4 : 5);
+        }
+        if (strncmp(p, "null", 4) == 0) {
+            field.type = Type::Null;
+            return p + 4;
+        }
+        double value = 0.0;
+        bool integral = true;
+        char* end = scanNumber(p, value, integral);
+        if (end == nullptr) {
+            return nullptr;
+        }
+        field.type = Type::Number;
+        return end;
+    }
+
+    // Scans a JSON number, returning the position after it, or null if `p`
+    // does not start one. Good to float precision, which is all we need.
+    static char* scanNumber(const char* start, double& value, bool& integral) {
+        char* p = const_cast<char*>(start);
+        bool negative = *p == '-';
+        if (negative) {
+            ++p;
+        }
+        if (*p < '0' || *p > '9') {
+            return nullptr;
+        }
+        value = 0.0;
+        for (; *p >= '0' && *p <= '9'; ++p) {
+            value = value * 10.0 + (*p - '0');
+        }
+        integral = true;
+        if (*p == '.') {
+            char* digits = ++p;
+            double scale = 0.1;
+            for (; *p >= '0' && *p <= '9'; ++p, scale /= 10.0) {
+                value += (*p - '0') * scale;
+            }
+            if (p == digits) {
+                return nullptr;
+            }
+            integral = false;
+        }
+        if (*p == 'e' || *p == 'E') {
+            ++p;
+            bool negativeExponent = *p == '-';
+            if (*p == '-' || *p == '+') {
+                ++p;
+            }
+            if (*p < '0' || *p > '9') {
+                return nullptr;
+            }
+            int exponent = 0;
+            for (; *p >= '0' && *p <= '9'; ++p) {
+                exponent = exponent < 400 ? exponent * 10 + (*p - '0') : exponent;
+            }
+            value *= std::pow(10.0, negativeExponent ? -exponent : exponent);
+            integral = false;
+        }
+        if (negative) {
+            value = -value;
+        }
+        return p;
+    }
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include "driver/ledc.h"
+#include "sdkconfig.h"
+#include "soc/soc_caps.h"
+
+// LEDC source clocks this target can feed a low speed timer from, fastest
+// first. Faster clocks allow more duty bits at a given PWM frequency.
+struct LedcClockSource {
+    ledc_clk_cfg_t clk_cfg;
+    uint32_t hz;
+    const char* name;
+};
+
+inline constexpr LedcClockSource ledc_clock_sources[] = {
+#if SOC_LEDC_SUPPORT_PLL_DIV_CLOCK
+#if CONFIG_IDF_TARGET_ESP32H2
+    {LEDC_USE_PLL_DIV_CLK, 96000000, "PLL_DIV"},
+#else
+    {LEDC_USE_PLL_DIV_CLK, 80000000, "PLL_DIV"},
+#endif
+#endif
+#if SOC_LEDC_SUPPORT_APB_CLOCK
+    {LEDC_USE_APB_CLK, 80000000, "APB"},
+#endif
+#if SOC_LEDC_SUPPORT_XTAL_CLOCK
+    {LEDC_USE_XTAL_CLK, CONFIG_XTAL_FREQ * 1000000U, "XTAL"},
+#endif
+};
+
+// The timer divider is a 10.8 fixed point value that must lie in [1, 1024).
+inline constexpr uint32_t ledc_divider_frac_bits = 8;
+inline constexpr uint64_t ledc_divider_min = 1ULL << ledc_divider_frac_bits;
+inline constexpr uint64_t ledc_divider_max = (1ULL << (10 + ledc_divider_frac_bits)) - 1;
+
+// Divider LEDC programs for a frequency and resolution, in 1/256 steps.
+constexpr uint64_t ledcDividerFor(uint32_t clk_hz, uint32_t freq_hz, uint32_t bits) {
+    uint64_t counts = static_cast<uint64_t>(freq_hz) << bits;
+    return ((static_cast<uint64_t>(clk_hz) << ledc_divider_frac_bits) + counts / 2) / counts;
+}
+
+// Highest duty resolution the timer can run at `freq_hz` from `clk_hz`, or 0
+// if the frequency is out of range for that clock.
+constexpr uint32_t ledcMaxResolution(uint32_t clk_hz, uint32_t freq_hz) {
+    if (freq_hz == 0) {
+        return 0;
+    }
+    for (uint32_t bits = SOC_LEDC_TIMER_BIT_WIDTH; bits >= 1; --bits) {
+        uint64_t divider = ledcDividerFor(clk_hz, freq_hz, bits);
+        if (divider > ledc_divider_max) {
+            return 0;  // too slow even at full resolution
+        }
+        if (divider >= ledc_divider_min) {
+            return bits;
+        }
+    }
+    return 0;
+}
+
+// Whether the timer can run at `freq_hz` from `clk_hz` with `bits` of duty
+// resolution: the divider for it must lie in range.
+constexpr bool ledcResolutionFits(uint32_t clk_hz, uint32_t freq_hz, uint32_t bits) {
+    return bits >= 1 && ledcMaxResolution(clk_hz, freq_hz) >= bits &&
+           ledcDividerFor(clk_hz, freq_hz, bits) <= ledc_divider_max;
+}
+
+// Frequency the timer actually produces once the divider is rounded.
+constexpr uint32_t ledcAchievedFrequency(uint32_t clk_hz, uint32_t freq_hz, uint32_t bits) {
+    uint64_t divider = ledcDividerFor(clk_hz, freq_hz, bits);
+    uint64_t counts = divider << bits;
+    return static_cast<uint32_t>(((static_cast<uint64_t>(clk_hz) << ledc_divider_frac_bits) + counts / 2) / counts);
+}
+
+struct LedcTiming {
+    const LedcClockSource* clock;
+    uint32_t resolution_bits;
+    uint32_t achieved_hz;
+};
+
+// Picks the clock giving the most duty bits for `freq_hz`, or uses `only`
+// when the timers have to share one source; clock is null when no usable
+// source can reach the frequency.
+constexpr LedcTiming ledcSelectTiming(uint32_t freq_hz, const LedcClockSource* only = nullptr) {
+    LedcTiming best{nullptr, 0, 0};
+    for (const auto& source : ledc_clock_sources) {
+        if (only != nullptr && &source != only) {
+            continue;
+        }
+        uint32_t bits = ledcMaxResolution(source.hz, freq_hz);
+        if (bits > best.resolution_bits) {
+            best = {&source, bits, ledcAchievedFrequency(source.hz, freq_hz, bits)};
+        }
+    }
+    return best;
+}
+
+static_assert(ledcMaxResolution(80000000, 5000) == 13, "5 kHz from 80 MHz should allow 13 bits");
+static_assert(ledcMaxResolution(80000000, 40000000) == 1, "40 MHz from 80 MHz is a single bit");
+static_assert(ledcMaxResolution(80000000, 80000000) == 0, "the clock itself is out of range");
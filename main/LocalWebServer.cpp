@@ -1,9 +1,72 @@
 #include "LocalWebServer.h"
+#include "BootTimeline.h"
+#include "ControlProtocol.h"
+#include "FlatJson.h"
+#include "MemoryBudget.h"
+#include "Metrics.h"
+#include <esp_heap_caps.h>
 #include <esp_log.h>
-#include <vector>
+#include <algorithm>
+#include <cinttypes>
+#include <climits>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <string>
+#include <sys/socket.h>
 
 static const char* TAG_LOCAL = "LocalWebServer";
+static const char* RETRY_AFTER_SECONDS = "1";
+static const char* PUMP_URI_PREFIX = "/pump/";
+static const size_t RESPONSE_MAX_LEN = 320;
+static const size_t SETTINGS_RESPONSE_MAX_LEN = 1024;
+static const size_t BATCH_RESPONSE_MAX_LEN = 32 + RESPONSE_MAX_LEN * pwm_channel_count;
+static const int EVENTS_MIN_INTERVAL_MS = 50;
+static const int EVENTS_KEEPALIVE_MS = 15000;
+
+// Channel addressed by a /pump/<n> URI, else by an "id" body field, else 0.
+// Returns -1 if the id is present but not a configured channel.
+static int requestChannel(httpd_req_t* req, const FlatJson& json) {
+    int channel = 0;
+    size_t prefixLen = strlen(PUMP_URI_PREFIX);
+    if (strncmp(req->uri, PUMP_URI_PREFIX, prefixLen) == 0) {
+        char* end = nullptr;
+        channel = static_cast<int>(strtol(req->uri + prefixLen, &end, 10));
+        if (end == req->uri + prefixLen) {
+            return -1;
+        }
+    } else if (json.contains("id") && !json.getInt("id", channel)) {
+        return -1;
+    }
+    return PWMControl::validChannel(channel) ? channel : -1;
+}
+
+// Channel given by an "id" query parameter, else 0; -1 if not a channel
+static int queryChannel(httpd_req_t* req) {
+    char query[32];
+    char value[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK
+        || httpd_query_key_value(query, "id", value, sizeof(value)) != ESP_OK) {
+        return 0;
+    }
+    char* end = nullptr;
+    long channel = strtol(value, &end, 10);
+    if (end == value || *end != '\0') {
+        return -1;
+    }
+    return PWMControl::validChannel(static_cast<int>(channel)) ? static_cast<int>(channel) : -1;
+}
+
+// Registration fails once the server's max_uri_handlers is used up, which
+// would otherwise only show up as 404s
+static void registerUri(httpd_handle_t server, const httpd_uri_t& uri) {
+    esp_err_t err = httpd_register_uri_handler(server, &uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_LOCAL, "Failed to register %s: %s", uri.uri, esp_err_to_name(err));
+    }
+}
 
 LocalWebServer::LocalWebServer(LocalWebContext* context)
     : WebServer(context) {
@@ -18,39 +81,152 @@ esp_err_t LocalWebServer::start() {
         return result;
     }
 
-    httpd_uri_t pumpUri;
+    httpd_uri_t pumpUri = {};
     pumpUri.uri       = "/pump";
     pumpUri.method    = HTTP_POST;
     pumpUri.handler   = pump_handler;
     pumpUri.user_ctx  = this;
-    httpd_register_uri_handler(server, &pumpUri);
+    registerUri(server, pumpUri);
 
-    httpd_uri_t signalUri;
+    // One exact URI per channel, so no wildcard matcher is needed
+    static char pumpChannelUris[pwm_channel_count][16];
+    for (int i = 0; i < pwm_channel_count; ++i) {
+        snprintf(pumpChannelUris[i], sizeof(pumpChannelUris[i]), "%s%d", PUMP_URI_PREFIX, i);
+        httpd_uri_t channelUri = pumpUri;
+        channelUri.uri = pumpChannelUris[i];
+        registerUri(server, channelUri);
+    }
+
+    httpd_uri_t batchUri = {};
+    batchUri.uri      = "/pump/batch";
+    batchUri.method   = HTTP_POST;
+    batchUri.handler  = batch_handler;
+    batchUri.user_ctx = this;
+    registerUri(server, batchUri);
+
+    httpd_uri_t signalUri = {};
     signalUri.uri      = "/signal";
     signalUri.method   = HTTP_POST;
     signalUri.handler  = signal_handler;
     signalUri.user_ctx = this;
-    httpd_register_uri_handler(server, &signalUri);
+    registerUri(server, signalUri);
+
+    httpd_uri_t settingsUri = {};
+    settingsUri.uri      = "/settings";
+    settingsUri.method   = HTTP_GET;
+    settingsUri.handler  = settings_get_handler;
+    settingsUri.user_ctx = this;
+    registerUri(server, settingsUri);
+    settingsUri.method   = HTTP_PATCH;
+    settingsUri.handler  = settings_patch_handler;
+    registerUri(server, settingsUri);
 
-    httpd_uri_t otaUri;
+    httpd_uri_t otaUri = {};
     otaUri.uri         = "/ota";
     otaUri.method      = HTTP_POST;
     otaUri.handler     = ota_handler;
     otaUri.user_ctx    = this;
-    httpd_register_uri_handler(server, &otaUri);
+    registerUri(server, otaUri);
+    otaUri.uri         = "/ota/upload";
+    otaUri.handler     = ota_upload_handler;
+    registerUri(server, otaUri);
+    otaUri.uri         = "/ota/status";
+    otaUri.method      = HTTP_GET;
+    otaUri.handler     = ota_status_handler;
+    registerUri(server, otaUri);
+
+    httpd_uri_t wsUri = {};
+    wsUri.uri          = "/ws";
+    wsUri.method       = HTTP_GET;
+    wsUri.handler      = ws_handler;
+    wsUri.user_ctx     = this;
+    wsUri.is_websocket = true;
+    registerUri(server, wsUri);
+
+    httpd_uri_t programUri = {};
+    programUri.uri      = "/program";
+    programUri.method   = HTTP_POST;
+    programUri.handler  = program_post_handler;
+    programUri.user_ctx = this;
+    registerUri(server, programUri);
+    programUri.method   = HTTP_GET;
+    programUri.handler  = program_get_handler;
+    registerUri(server, programUri);
+    programUri.method   = HTTP_DELETE;
+    programUri.handler  = program_delete_handler;
+    registerUri(server, programUri);
+
+    httpd_uri_t calibrationUri = {};
+    calibrationUri.uri      = "/calibration";
+    calibrationUri.method   = HTTP_GET;
+    calibrationUri.handler  = calibration_get_handler;
+    calibrationUri.user_ctx = this;
+    registerUri(server, calibrationUri);
+    calibrationUri.method   = HTTP_PUT;
+    calibrationUri.handler  = calibration_put_handler;
+    registerUri(server, calibrationUri);
+    calibrationUri.method   = HTTP_DELETE;
+    calibrationUri.handler  = calibration_delete_handler;
+    registerUri(server, calibrationUri);
+
+    httpd_uri_t scheduleUri = {};
+    scheduleUri.uri      = "/schedule";
+    scheduleUri.method   = HTTP_GET;
+    scheduleUri.handler  = schedule_get_handler;
+    scheduleUri.user_ctx = this;
+    registerUri(server, scheduleUri);
+    scheduleUri.method   = HTTP_PUT;
+    scheduleUri.handler  = schedule_put_handler;
+    registerUri(server, scheduleUri);
+    scheduleUri.method   = HTTP_DELETE;
+    scheduleUri.handler  = schedule_delete_handler;
+    registerUri(server, scheduleUri);
+
+    httpd_uri_t eventsUri = {};
+    eventsUri.uri      = "/events";
+    eventsUri.method   = HTTP_GET;
+    eventsUri.handler  = events_handler;
+    eventsUri.user_ctx = this;
+    registerUri(server, eventsUri);
+
+#if CONFIG_METRICS
+    httpd_uri_t metricsUri = {};
+    metricsUri.uri      = "/metrics";
+    metricsUri.method   = HTTP_GET;
+    metricsUri.handler  = metrics_handler;
+    metricsUri.user_ctx = this;
+    registerUri(server, metricsUri);
+#endif
+
+    auto* localCtx = static_cast<LocalWebContext*>(webContext);
+    if (localCtx && localCtx->pump) {
+        TaskHandle_t eventsTask = nullptr;
+        if (xTaskCreate(events_task, "sse_events", events_task_stack, this, 3, &eventsTask) != pdPASS) {
+            ESP_LOGE(TAG_LOCAL, "Failed to create events task");
+        } else {
+            localCtx->pump->setStateListener(eventsTask);
+        }
+    }
 
     return ESP_OK;
 }
 
-esp_err_t LocalWebServer::readRequestBody(LocalWebServer* localServer, httpd_req_t* req, std::string& body) {
-    int contentLength = req->content_len;
-    if (contentLength <= 0) {
+esp_err_t LocalWebServer::readRequestBody(LocalWebServer* localServer, httpd_req_t* req, char*& body) {
+    size_t contentLength = req->content_len;
+    if (contentLength == 0) {
         return localServer->sendJsonError(req, 411, "Content-Length required");
     }
-    std::vector<char> buffer(contentLength + 1);
-    int received = 0;
+    if (contentLength > CONFIG_HTTP_BODY_MAX_LEN) {
+        ESP_LOGW(TAG_LOCAL, "Refusing %u byte body on %s", static_cast<unsigned>(contentLength), req->uri);
+        // The unread body would be taken for the next request, so close
+        httpd_resp_set_hdr(req, "Connection", "close");
+        localServer->sendJsonError(req, 413, "Request body too large");
+        return ESP_FAIL;
+    }
+    char* buffer = localServer->rxBuffer;
+    size_t received = 0;
     while (received < contentLength) {
-        int ret = httpd_req_recv(req, buffer.data() + received, contentLength - received);
+        int ret = httpd_req_recv(req, buffer + received, contentLength - received);
         if (ret <= 0) {
             if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
                 httpd_resp_send_408(req);
@@ -62,117 +238,1261 @@ esp_err_t LocalWebServer::readRequestBody(LocalWebServer* localServer, httpd_req
         received += ret;
     }
     buffer[contentLength] = '\0';
-    body = std::string(buffer.data());
+    body = buffer;
     return ESP_OK;
 }
 
+static esp_err_t sendJson(httpd_req_t* req, const char* json, size_t len) {
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+// snprintf at `len` into `buf`, returning the new length; output that does
+// not fit is truncated rather than overrunning.
+static size_t appendf(char* buf, size_t size, size_t len, const char* format, ...) {
+    if (len + 1 >= size) {
+        return len;
+    }
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buf + len, size - len, format, args);
+    va_end(args);
+    return written > 0 ? std::min(len + written, size - 1) : len;
+}
+
+// Formats the applied output, as published by the duty task, into `buf`
+// without touching the heap. `status` may be null. Leaves the object open
+// for extra fields and returns the length written.
+static size_t formatChannelState(char* buf, size_t size, const char* status, int channel,
+                                 const PwmChannelState& state) {
+    size_t len = 0;
+    if (status != nullptr) {
+        len = appendf(buf, size, len, "{\"status\":\"%s\",\"id\":%d", status, channel);
+    } else {
+        len = appendf(buf, size, len, "{\"id\":%d", channel);
+    }
+    len = appendf(buf, size, len,
+                  ",\"duty\":%.1f,\"target\":%.1f,\"frequency\":%" PRIu32 ",\"achieved_hz\":%" PRIu32
+                  ",\"resolution_bits\":%u,\"effective_bits\":%u,\"invert\":%s,\"ramping\":%s",
+                  state.duty, state.target, state.frequency, state.achieved_hz,
+                  static_cast<unsigned>(state.resolution_bits), static_cast<unsigned>(state.effective_bits),
+                  state.invert ? "true" : "false", state.ramping ? "true" : "false");
+    if (state.calibrated) {
+        len = appendf(buf, size, len, ",\"flow\":%.1f", state.flow);
+    }
+    if (state.pulse_active) {
+        int64_t remaining = std::max<int64_t>(0, state.pulse_deadline_us - esp_timer_get_time());
+        len = appendf(buf, size, len, ",\"pulse_remaining_ms\":%d", static_cast<int>(remaining / 1000));
+    }
+    return len;
+}
+
+// Why a duty or flow setpoint is refused, or null. Flow is a percentage of
+// full flow, so has the same range as duty.
+static const char* setpointError(float value, DutyUnit unit) {
+    if (SettingsManager::checkDuty(value) != nullptr) {
+        return unit == DutyUnit::Flow ? "'flow' out of range" : "'duty' out of range";
+    }
+    return nullptr;
+}
+
+// An explicit duty takes the channel back to open loop. setTarget returns
+// after the loop's last post, so a duty posted after this lands after it.
+static void releaseSpeedControl(LocalWebContext* localCtx, int channel) {
+    SpeedController* speed = localCtx->speed;
+    if (speed && speed->channel() == channel) {
+        speed->setTarget(0.0f);
+    }
+}
+
 esp_err_t LocalWebServer::pump_handler(httpd_req_t* req) {
+    RequestTimer timer(HttpEndpoint::Pump);
     auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
     auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
     if (!localCtx || !localCtx->pump || !localCtx->settings) {
         return localServer->sendJsonError(req, 500, "Invalid LocalWebContext / pump / settings");
     }
 
-    std::string requestBody;
+    char* requestBody = nullptr;
     esp_err_t readResult = readRequestBody(localServer, req, requestBody);
     if (readResult != ESP_OK) {
         return readResult;
     }
-    JsonWrapper json = JsonWrapper::Parse(requestBody.c_str());
+    FlatJson json;
+    if (!json.parse(requestBody)) {
+        return localServer->sendJsonError(req, 400, "Invalid JSON");
+    }
+
+    int channel = requestChannel(req, json);
+    if (channel < 0) {
+        return localServer->sendJsonError(req, 404, "Unknown pump channel");
+    }
 
+    SpeedController* speed = localCtx->speed;
+    bool speedChannel = speed && speed->channel() == channel;
+    if (json.contains("rpm")) {
+        float rpm = 0.0f;
+        if (!speedChannel) {
+            return localServer->sendJsonError(req, 400, "No speed control on this channel");
+        }
+        if (!json.getFloat("rpm", rpm) || rpm < 0.0f) {
+            return localServer->sendJsonError(req, 400, "Invalid 'rpm'");
+        }
+        speed->setTarget(rpm);
+        SpeedStatus status = speed->getStatus();
+        char response[RESPONSE_MAX_LEN];
+        size_t len = appendf(response, sizeof(response), 0,
+                             "{\"status\":\"OK\",\"channel\":%d,\"target_rpm\":%.1f,\"rpm\":%.1f,\"duty\":%.2f}",
+                             channel, rpm, status.rpm, status.duty);
+        return sendJson(req, response, len);
+    }
+
+    // "flow" is the same request in calibrated units
     float duty = 0.0f;
     int period = 0;
-    if (!json.GetField<float>("duty", duty)) {
+    DutyUnit unit = DutyUnit::Percent;
+    if (json.contains("flow")) {
+        if (!json.getFloat("flow", duty)) {
+            return localServer->sendJsonError(req, 400, "Invalid 'flow'");
+        }
+        unit = DutyUnit::Flow;
+    } else if (!json.getFloat("duty", duty)) {
         return localServer->sendJsonError(req, 400, "Missing or invalid 'duty'");
     }
 
-    if (json.ContainsField("period")) {
-        if (!json.GetField<int>("period", period) || period <= 0) {
+    int rampMs = 0;
+    if (json.contains("ramp_ms")) {
+        if (!json.getInt("ramp_ms", rampMs) || rampMs < 0) {
+            return localServer->sendJsonError(req, 400, "Invalid 'ramp_ms' field");
+        }
+    }
+    RampShape shape = RampShape::Linear;
+    if (json.contains("ramp")) {
+        const char* shapeName = "";
+        json.getString("ramp", shapeName);
+        if (strcmp(shapeName, "ease") == 0) {
+            shape = RampShape::Ease;
+        } else if (strcmp(shapeName, "linear") != 0) {
+            return localServer->sendJsonError(req, 400, "Invalid 'ramp', expected 'linear' or 'ease'");
+        }
+    }
+
+    if (const char* problem = setpointError(duty, unit)) {
+        return localServer->sendJsonError(req, 400, problem);
+    }
+
+    if (json.contains("period")) {
+        if (!json.getInt("period", period) || period <= 0) {
             return localServer->sendJsonError(req, 400, "Invalid 'period' field");
         }
-        localCtx->pump->setDutyCyclePercentage(duty, period);
-        localCtx->settings->duty = duty;
+    }
+    releaseSpeedControl(localCtx, channel);
+    uint32_t seq = localCtx->pump->setDutyCyclePercentage(channel, duty, period, rampMs, shape, unit);
+    if (seq == 0) {
+        httpd_resp_set_hdr(req, "Retry-After", RETRY_AFTER_SECONDS);
+        return localServer->sendJsonError(req, 503, "Pump command queue full");
+    }
+    if (period == 0 && unit == DutyUnit::Percent) {
+        localCtx->settings->storeDuty(channel, duty);
+    }
+
+    PwmChannelState state = localCtx->pump->waitApplied(channel, seq);
+    bool applied = static_cast<int32_t>(state.applied_seq - seq) >= 0;
+    if (period == 0 && unit == DutyUnit::Flow && applied) {
+        // Settings hold the drive duty, which only the duty task knows
+        localCtx->settings->storeDuty(channel, state.target);
+    }
+    char response[RESPONSE_MAX_LEN];
+    size_t len = formatChannelState(response, sizeof(response), applied ? "OK" : "PENDING", channel, state);
+    len = appendf(response, sizeof(response), len, "}");
+    return sendJson(req, response, len);
+}
+
+esp_err_t LocalWebServer::signal_handler(httpd_req_t* req) {
+    RequestTimer timer(HttpEndpoint::Signal);
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->pump || !localCtx->settings) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext / pump / settings");
+    }
+
+    char* requestBody = nullptr;
+    esp_err_t readResult = readRequestBody(localServer, req, requestBody);
+    if (readResult != ESP_OK) {
+        return readResult;
+    }
+    FlatJson json;
+    if (!json.parse(requestBody)) {
+        return localServer->sendJsonError(req, 400, "Invalid JSON");
+    }
+    int channel = requestChannel(req, json);
+    if (channel < 0) {
+        return localServer->sendJsonError(req, 404, "Unknown pump channel");
+    }
+
+    // The channel's settings fields, checked, stored and applied by the schema
+    SettingsPatch patch = localCtx->settings->patch(json, channel);
+    if (!patch.ok) {
+        return localServer->sendJsonError(req, 400, patch.error);
+    }
+    if (patch.failed > 0) {
+        httpd_resp_set_hdr(req, "Retry-After", RETRY_AFTER_SECONDS);
+        return localServer->sendJsonError(req, 503, "Pump command queue full");
+    }
+
+    PwmChannelState state = patch.changed > 0
+                                ? localCtx->pump->waitApplied(channel, localCtx->pump->getSettingsSeq(channel))
+                                : localCtx->pump->getState(channel);
+    char response[RESPONSE_MAX_LEN];
+    size_t len = formatChannelState(response, sizeof(response), "OK", channel, state);
+    if (json.contains("frequency")) {
+        len = appendf(response, sizeof(response), len, ",\"retune_us\":%d,\"gap_us\":%d",
+                      static_cast<int>(state.last_retune_us), static_cast<int>(state.last_retune_gap_us));
+    }
+    len = appendf(response, sizeof(response), len, "}");
+    return sendJson(req, response, len);
+}
+
+esp_err_t LocalWebServer::settings_get_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->settings) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext or settings");
+    }
+    char response[SETTINGS_RESPONSE_MAX_LEN];
+    size_t len = localCtx->settings->formatJson(response, sizeof(response));
+    if (len == 0) {
+        return localServer->sendJsonError(req, 500, "Settings too large to report");
+    }
+    return sendJson(req, response, len);
+}
+
+// Any subset of the settings in one body, e.g. {"tz": "UTC0", "frequency1": 2000}.
+// The whole body is checked before anything changes, and the result is
+// written to flash once.
+esp_err_t LocalWebServer::settings_patch_handler(httpd_req_t* req) {
+    RequestTimer timer(HttpEndpoint::Settings);
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->settings) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext or settings");
+    }
+
+    char* requestBody = nullptr;
+    esp_err_t readResult = readRequestBody(localServer, req, requestBody);
+    if (readResult != ESP_OK) {
+        return readResult;
+    }
+    FlatJson json;
+    if (!json.parse(requestBody)) {
+        return localServer->sendJsonError(req, 400, "Invalid JSON or too many fields");
+    }
+    SettingsPatch patch = localCtx->settings->patch(json);
+    if (!patch.ok) {
+        return localServer->sendJsonError(req, 400, patch.error);
+    }
+    if (patch.failed > 0) {
+        // What did change is kept; a retry only re-sends the rest
+        httpd_resp_set_hdr(req, "Retry-After", RETRY_AFTER_SECONDS);
+        return localServer->sendJsonError(req, 503, "Pump command queue full");
+    }
+
+    char response[SETTINGS_RESPONSE_MAX_LEN];
+    size_t len = appendf(response, sizeof(response), 0, "{\"status\":\"OK\",\"changed\":%u,\"settings\":",
+                         static_cast<unsigned>(patch.changed));
+    size_t settingsLen = localCtx->settings->formatJson(response + len, sizeof(response) - len - 1);
+    if (settingsLen == 0) {
+        return localServer->sendJsonError(req, 500, "Settings too large to report");
+    }
+    len = appendf(response, sizeof(response), len + settingsLen, "}");
+    return sendJson(req, response, len);
+}
+
+esp_err_t LocalWebServer::batch_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->pump || !localCtx->settings) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext / pump / settings");
+    }
+
+    char* requestBody = nullptr;
+    esp_err_t readResult = readRequestBody(localServer, req, requestBody);
+    if (readResult != ESP_OK) {
+        return readResult;
+    }
+
+    // The body holds an array, which FlatJson does not take, so walk it with cJSON
+    cJSON* root = cJSON_Parse(requestBody);
+    cJSON* list = root ? cJSON_GetObjectItem(root, "channels") : nullptr;
+    if (!cJSON_IsArray(list)) {
+        cJSON_Delete(root);
+        return localServer->sendJsonError(req, 400, "Missing or invalid 'channels'");
+    }
+
+    DutyBatchEntry entries[pwm_channel_count] = {};
+    size_t count = 0;
+    cJSON* item = nullptr;
+    cJSON_ArrayForEach(item, list) {
+        cJSON* id = cJSON_GetObjectItem(item, "id");
+        cJSON* duty = cJSON_GetObjectItem(item, "duty");
+        const char* problem = nullptr;
+        if (count == pwm_channel_count) {
+            problem = "Too many batch entries";
+        } else if (!cJSON_IsNumber(id) || !PWMControl::validChannel(id->valueint)) {
+            problem = "Invalid 'id' in batch entry";
+        } else if (!cJSON_IsNumber(duty)) {
+            problem = "Missing or invalid 'duty' in batch entry";
+        } else {
+            problem = setpointError(static_cast<float>(duty->valuedouble), DutyUnit::Percent);
+        }
+        if (problem != nullptr) {
+            cJSON_Delete(root);
+            return localServer->sendJsonError(req, 400, problem);
+        }
+        entries[count++] = {id->valueint, static_cast<float>(duty->valuedouble)};
+    }
+    cJSON_Delete(root);
+
+    // Checked as a whole before anything changes, then released and posted
+    // as /pump does for each channel
+    for (size_t i = 0; i < count; ++i) {
+        releaseSpeedControl(localCtx, entries[i].channel);
+    }
+    uint32_t seq = localCtx->pump->setBatch(entries, count);
+    if (seq == 0) {
+        return localServer->sendJsonError(req, 400, "Invalid batch");
+    }
+    for (size_t i = 0; i < count; ++i) {
+        localCtx->settings->storeDuty(entries[i].channel, entries[i].percentage);
+    }
+
+    // Each channel as applied by the duty task, as /pump answers for one
+    PwmChannelState states[pwm_channel_count];
+    bool applied = true;
+    for (size_t i = 0; i < count; ++i) {
+        states[i] = localCtx->pump->waitApplied(entries[i].channel, seq);
+        applied = applied && static_cast<int32_t>(states[i].applied_seq - seq) >= 0;
+    }
+    char response[BATCH_RESPONSE_MAX_LEN];
+    size_t len = appendf(response, sizeof(response), 0, "{\"status\":\"%s\",\"channels\":[",
+                         applied ? "OK" : "PENDING");
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            len = appendf(response, sizeof(response), len, ",");
+        }
+        bool channelApplied = static_cast<int32_t>(states[i].applied_seq - seq) >= 0;
+        len += formatChannelState(response + len, sizeof(response) - len, channelApplied ? "OK" : "PENDING",
+                                  entries[i].channel, states[i]);
+        len = appendf(response, sizeof(response), len, "}");
+    }
+    len = appendf(response, sizeof(response), len, "]}");
+    return sendJson(req, response, len);
+}
+
+static esp_err_t sendProgramState(httpd_req_t* req, int channel, const PwmChannelState& state) {
+    char response[RESPONSE_MAX_LEN];
+    size_t len = appendf(response, sizeof(response), 0,
+                         "{\"status\":\"OK\",\"id\":%d,\"active\":%s,\"step\":%u,\"steps\":%u,\"pass\":%u"
+                         ",\"max_late_us\":%d,\"duty\":%.1f}",
+                         channel, state.program_active ? "true" : "false",
+                         static_cast<unsigned>(state.program_step), static_cast<unsigned>(state.program_steps),
+                         static_cast<unsigned>(state.program_pass), static_cast<int>(state.program_max_late_us),
+                         state.duty);
+    return sendJson(req, response, len);
+}
+
+// Reads one {"duty", "hold_ms", "ramp_ms", "loop_to", "loop_count"} step
+static bool parseProgramStep(cJSON* item, ProgramStep& step) {
+    cJSON* duty = cJSON_GetObjectItem(item, "duty");
+    cJSON* hold = cJSON_GetObjectItem(item, "hold_ms");
+    cJSON* ramp = cJSON_GetObjectItem(item, "ramp_ms");
+    cJSON* loopTo = cJSON_GetObjectItem(item, "loop_to");
+    cJSON* loopCount = cJSON_GetObjectItem(item, "loop_count");
+    if (!cJSON_IsNumber(duty) || !cJSON_IsNumber(hold) || duty->valuedouble < 0 || duty->valuedouble > 100
+        || hold->valuedouble < 1 || hold->valuedouble > UINT32_MAX) {
+        return false;
+    }
+    step = {};
+    step.duty_centi = static_cast<uint16_t>(std::lround(duty->valuedouble * 100.0));
+    step.hold_ms = static_cast<uint32_t>(hold->valuedouble);
+    if (ramp != nullptr) {
+        if (!cJSON_IsNumber(ramp) || ramp->valueint < 0 || ramp->valueint > UINT16_MAX) {
+            return false;
+        }
+        step.ramp_ms = static_cast<uint16_t>(ramp->valueint);
+    }
+    if (loopCount != nullptr) {
+        if (!cJSON_IsNumber(loopCount) || !cJSON_IsNumber(loopTo)
+            || loopCount->valueint < 0 || loopCount->valueint > UINT8_MAX
+            || loopTo->valueint < 0 || loopTo->valueint >= program_max_steps) {
+            return false;
+        }
+        step.loop_count = static_cast<uint8_t>(loopCount->valueint);
+        step.loop_to = static_cast<uint8_t>(loopTo->valueint);
+    }
+    return true;
+}
+
+// Uploads and starts a program:
+// {"id": 0, "repeat": 0, "persist": true, "steps": [{"duty": 50, "hold_ms": 1000, "ramp_ms": 200}, ...]}
+esp_err_t LocalWebServer::program_post_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->pump || !localCtx->settings) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext / pump / settings");
+    }
+
+    char* requestBody = nullptr;
+    esp_err_t readResult = readRequestBody(localServer, req, requestBody);
+    if (readResult != ESP_OK) {
+        return readResult;
+    }
+
+    // Steps are an array, so this goes through cJSON like /pump/batch
+    cJSON* root = cJSON_Parse(requestBody);
+    cJSON* steps = root ? cJSON_GetObjectItem(root, "steps") : nullptr;
+    if (!cJSON_IsArray(steps)) {
+        cJSON_Delete(root);
+        return localServer->sendJsonError(req, 400, "Missing or invalid 'steps'");
+    }
+    cJSON* id = cJSON_GetObjectItem(root, "id");
+    cJSON* repeat = cJSON_GetObjectItem(root, "repeat");
+    int channel = cJSON_IsNumber(id) ? id->valueint : 0;
+    bool persist = cJSON_IsTrue(cJSON_GetObjectItem(root, "persist"));
+
+    PwmProgram program;
+    if (repeat != nullptr) {
+        if (!cJSON_IsNumber(repeat) || repeat->valueint < 0 || repeat->valueint > UINT16_MAX) {
+            cJSON_Delete(root);
+            return localServer->sendJsonError(req, 400, "Invalid 'repeat'");
+        }
+        program.repeat = static_cast<uint16_t>(repeat->valueint);
+    }
+    cJSON* item = nullptr;
+    cJSON_ArrayForEach(item, steps) {
+        if (program.step_count == program_max_steps || !parseProgramStep(item, program.steps[program.step_count])) {
+            cJSON_Delete(root);
+            return localServer->sendJsonError(req, 400, "Invalid program step");
+        }
+        ++program.step_count;
+    }
+    cJSON_Delete(root);
+
+    if (!PWMControl::validChannel(channel)) {
+        return localServer->sendJsonError(req, 404, "Unknown pump channel");
+    }
+    const char* problem = validateProgram(program);
+    if (problem != nullptr) {
+        return localServer->sendJsonError(req, 400, problem);
+    }
+    uint32_t seq = localCtx->pump->startProgram(channel, program);
+    if (seq == 0) {
+        httpd_resp_set_hdr(req, "Retry-After", RETRY_AFTER_SECONDS);
+        return localServer->sendJsonError(req, 503, "Pump command queue full");
+    }
+    if (persist) {
+        localCtx->settings->saveProgram(channel, program);
     } else {
-        localCtx->pump->setDutyCyclePercentage(duty);
-        localCtx->settings->duty = duty;
-        localCtx->settings->Store("duty", std::to_string(duty));
+        localCtx->settings->clearProgram(channel);
     }
+    return sendProgramState(req, channel, localCtx->pump->waitApplied(channel, seq));
+}
 
-    JsonWrapper response;
-    response.AddItem("status", "OK");
-    response.AddItem("duty", localCtx->settings->duty);
+esp_err_t LocalWebServer::program_get_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->pump) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext / pump");
+    }
+    int channel = queryChannel(req);
+    if (channel < 0) {
+        return localServer->sendJsonError(req, 404, "Unknown pump channel");
+    }
+    return sendProgramState(req, channel, localCtx->pump->getState(channel));
+}
 
-    std::string responseStr = response.ToString();
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, responseStr.c_str());
-    return ESP_OK;
+// Stops the channel's program and forgets any stored copy
+esp_err_t LocalWebServer::program_delete_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->pump || !localCtx->settings) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext / pump / settings");
+    }
+    int channel = queryChannel(req);
+    if (channel < 0) {
+        return localServer->sendJsonError(req, 404, "Unknown pump channel");
+    }
+    uint32_t seq = localCtx->pump->stopProgram(channel);
+    if (seq == 0) {
+        httpd_resp_set_hdr(req, "Retry-After", RETRY_AFTER_SECONDS);
+        return localServer->sendJsonError(req, 503, "Pump command queue full");
+    }
+    localCtx->settings->clearProgram(channel);
+    return sendProgramState(req, channel, localCtx->pump->waitApplied(channel, seq));
 }
 
-esp_err_t LocalWebServer::signal_handler(httpd_req_t* req) {
+static esp_err_t sendCalibration(httpd_req_t* req, int channel, const CalibrationCurve& curve) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "status", "OK");
+    cJSON_AddNumberToObject(root, "id", channel);
+    cJSON* points = cJSON_AddArrayToObject(root, "points");
+    for (int i = 0; i < curve.count; ++i) {
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "flow", curve.points[i].flow_centi / 100.0);
+        cJSON_AddNumberToObject(item, "duty", curve.points[i].duty_centi / 100.0);
+        cJSON_AddItemToArray(points, item);
+    }
+
+    char* text = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (text == nullptr) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+    esp_err_t err = sendJson(req, text, strlen(text));
+    cJSON_free(text);
+    return err;
+}
+
+esp_err_t LocalWebServer::calibration_get_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->pump) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext / pump");
+    }
+    int channel = queryChannel(req);
+    if (channel < 0) {
+        return localServer->sendJsonError(req, 404, "Unknown pump channel");
+    }
+    return sendCalibration(req, channel, localCtx->pump->getCalibration(channel));
+}
+
+// Replaces and stores a channel's curve:
+// {"id": 0, "points": [{"flow": 0, "duty": 25}, {"flow": 50, "duty": 45}, {"flow": 100, "duty": 100}]}
+esp_err_t LocalWebServer::calibration_put_handler(httpd_req_t* req) {
     auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
     auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
     if (!localCtx || !localCtx->pump || !localCtx->settings) {
         return localServer->sendJsonError(req, 500, "Invalid LocalWebContext / pump / settings");
     }
 
-    std::string requestBody;
+    char* requestBody = nullptr;
     esp_err_t readResult = readRequestBody(localServer, req, requestBody);
     if (readResult != ESP_OK) {
         return readResult;
     }
-    JsonWrapper json = JsonWrapper::Parse(requestBody.c_str());
+    cJSON* root = cJSON_Parse(requestBody);
+    cJSON* points = root ? cJSON_GetObjectItem(root, "points") : nullptr;
+    if (!cJSON_IsArray(points)) {
+        cJSON_Delete(root);
+        return localServer->sendJsonError(req, 400, "Missing or invalid 'points'");
+    }
+    cJSON* id = cJSON_GetObjectItem(root, "id");
+    int channel = cJSON_IsNumber(id) ? id->valueint : 0;
+
+    CalibrationCurve curve;
+    cJSON* item = nullptr;
+    cJSON_ArrayForEach(item, points) {
+        cJSON* flow = cJSON_GetObjectItem(item, "flow");
+        cJSON* duty = cJSON_GetObjectItem(item, "duty");
+        if (curve.count == calibration_max_points || !cJSON_IsNumber(flow) || !cJSON_IsNumber(duty)
+            || flow->valuedouble < 0 || flow->valuedouble > 100 || duty->valuedouble < 0 || duty->valuedouble > 100) {
+            cJSON_Delete(root);
+            return localServer->sendJsonError(req, 400, "Invalid calibration point");
+        }
+        CalibrationPoint& point = curve.points[curve.count++];
+        point.flow_centi = static_cast<uint16_t>(std::lround(flow->valuedouble * 100.0));
+        point.duty_centi = static_cast<uint16_t>(std::lround(duty->valuedouble * 100.0));
+    }
+    cJSON_Delete(root);
+
+    if (!PWMControl::validChannel(channel)) {
+        return localServer->sendJsonError(req, 404, "Unknown pump channel");
+    }
+    const char* problem = validateCalibration(curve);
+    if (problem != nullptr) {
+        return localServer->sendJsonError(req, 400, problem);
+    }
+    uint32_t seq = localCtx->pump->setCalibration(channel, curve);
+    if (seq == 0) {
+        httpd_resp_set_hdr(req, "Retry-After", RETRY_AFTER_SECONDS);
+        return localServer->sendJsonError(req, 503, "Pump command queue full");
+    }
+    if (!localCtx->settings->saveCalibration(channel, curve)) {
+        return localServer->sendJsonError(req, 500, "Failed to store calibration");
+    }
+    return sendCalibration(req, channel, curve);
+}
+
+// Back to uncalibrated: flow is drive duty again
+esp_err_t LocalWebServer::calibration_delete_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->pump || !localCtx->settings) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext / pump / settings");
+    }
+    int channel = queryChannel(req);
+    if (channel < 0) {
+        return localServer->sendJsonError(req, 404, "Unknown pump channel");
+    }
+    if (localCtx->pump->setCalibration(channel, CalibrationCurve{}) == 0) {
+        httpd_resp_set_hdr(req, "Retry-After", RETRY_AFTER_SECONDS);
+        return localServer->sendJsonError(req, 503, "Pump command queue full");
+    }
+    localCtx->settings->saveCalibration(channel, CalibrationCurve{});
+    return sendCalibration(req, channel, CalibrationCurve{});
+}
+
+static const char* const DAY_NAMES[] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
 
-    if (json.ContainsField("invert")) {
-        bool invertValue = false;
-        json.GetField<bool>("invert", invertValue);
-        localCtx->settings->Store("invert", invertValue ? "true" : "false");
-        localCtx->settings->invert = invertValue;
-        float currentDuty = localCtx->pump->getCurrentPercentage();
-        localCtx->pump->setDutyCyclePercentage(currentDuty);
+// "HH:MM" to minutes after midnight, or -1
+static int parseClockTime(const char* text) {
+    int hours = 0;
+    int minutes = 0;
+    char extra = 0;
+    if (text == nullptr || sscanf(text, "%2d:%2d%c", &hours, &minutes, &extra) != 2
+        || hours < 0 || hours > 23 || minutes < 0 || minutes > 59) {
+        return -1;
     }
+    return hours * 60 + minutes;
+}
 
-    if (json.ContainsField("frequency")) {
-        int frequencyValue = 0;
-        if (!json.GetField<int>("frequency", frequencyValue) || frequencyValue <= 0) {
-            return localServer->sendJsonError(req, 400, "Invalid 'frequency'");
+// Reads {"id": 0, "days": ["mon", ...], "start": "07:00", "end": "08:30", "duty": 60, "ramp_ms": 500}
+static bool parseScheduleEntry(cJSON* item, ScheduleEntry& entry) {
+    cJSON* id = cJSON_GetObjectItem(item, "id");
+    cJSON* days = cJSON_GetObjectItem(item, "days");
+    cJSON* duty = cJSON_GetObjectItem(item, "duty");
+    cJSON* ramp = cJSON_GetObjectItem(item, "ramp_ms");
+    int start = parseClockTime(cJSON_GetStringValue(cJSON_GetObjectItem(item, "start")));
+    int end = parseClockTime(cJSON_GetStringValue(cJSON_GetObjectItem(item, "end")));
+    if (!cJSON_IsArray(days) || !cJSON_IsNumber(duty) || duty->valuedouble < 0 || duty->valuedouble > 100
+        || start < 0 || end < 0 || (id != nullptr && (!cJSON_IsNumber(id) || !PWMControl::validChannel(id->valueint)))) {
+        return false;
+    }
+    entry = {};
+    entry.channel = id ? static_cast<uint8_t>(id->valueint) : 0;
+    entry.start_min = static_cast<uint16_t>(start);
+    entry.end_min = static_cast<uint16_t>(end);
+    entry.duty_centi = static_cast<uint16_t>(std::lround(duty->valuedouble * 100.0));
+    if (ramp != nullptr) {
+        if (!cJSON_IsNumber(ramp) || ramp->valueint < 0 || ramp->valueint > UINT16_MAX) {
+            return false;
+        }
+        entry.ramp_ms = static_cast<uint16_t>(ramp->valueint);
+    }
+    cJSON* day = nullptr;
+    cJSON_ArrayForEach(day, days) {
+        const char* name = cJSON_GetStringValue(day);
+        int index = 0;
+        while (index < 7 && (name == nullptr || strcmp(name, DAY_NAMES[index]) != 0)) {
+            ++index;
+        }
+        if (index == 7) {
+            return false;
         }
-        localCtx->pump->setFrequency(frequencyValue);
-        localCtx->settings->Store("frequency", std::to_string(frequencyValue));
+        entry.days |= 1 << index;
     }
+    return true;
+}
 
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, "{\"status\":\"OK\"}");
-    return ESP_OK;
+static void addLocalTime(cJSON* root, const char* key, time_t when) {
+    struct tm local;
+    char text[32];
+    localtime_r(&when, &local);
+    strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S%z", &local);
+    cJSON_AddStringToObject(root, key, text);
+}
+
+esp_err_t LocalWebServer::schedule_get_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->scheduler) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext / scheduler");
+    }
+    Scheduler* scheduler = localCtx->scheduler;
+    DutySchedule schedule = scheduler->getSchedule();
+
+    cJSON* root = cJSON_CreateObject();
+    bool clockValid = scheduler->clockValid();
+    cJSON_AddBoolToObject(root, "clock_valid", clockValid);
+    if (clockValid) {
+        addLocalTime(root, "now", time(nullptr));
+    }
+    time_t next = scheduler->nextTransition();
+    if (next != 0) {
+        addLocalTime(root, "next_change", next);
+    }
+    cJSON* entries = cJSON_AddArrayToObject(root, "entries");
+    for (int i = 0; i < schedule.count; ++i) {
+        const ScheduleEntry& entry = schedule.entries[i];
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "id", entry.channel);
+        cJSON* days = cJSON_AddArrayToObject(item, "days");
+        for (int day = 0; day < 7; ++day) {
+            if (entry.days & (1 << day)) {
+                cJSON_AddItemToArray(days, cJSON_CreateString(DAY_NAMES[day]));
+            }
+        }
+        char clock[8];
+        snprintf(clock, sizeof(clock), "%02d:%02d", entry.start_min / 60, entry.start_min % 60);
+        cJSON_AddStringToObject(item, "start", clock);
+        snprintf(clock, sizeof(clock), "%02d:%02d", entry.end_min / 60, entry.end_min % 60);
+        cJSON_AddStringToObject(item, "end", clock);
+        cJSON_AddNumberToObject(item, "duty", entry.duty_centi / 100.0);
+        cJSON_AddNumberToObject(item, "ramp_ms", entry.ramp_ms);
+        cJSON_AddItemToArray(entries, item);
+    }
+
+    char* text = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (text == nullptr) {
+        return localServer->sendJsonError(req, 500, "Out of memory");
+    }
+    esp_err_t err = sendJson(req, text, strlen(text));
+    cJSON_free(text);
+    return err;
 }
 
+// Replaces the whole schedule: {"entries": [...]}
+esp_err_t LocalWebServer::schedule_put_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->scheduler) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext / scheduler");
+    }
+
+    char* requestBody = nullptr;
+    esp_err_t readResult = readRequestBody(localServer, req, requestBody);
+    if (readResult != ESP_OK) {
+        return readResult;
+    }
+    cJSON* root = cJSON_Parse(requestBody);
+    cJSON* entries = root ? cJSON_GetObjectItem(root, "entries") : nullptr;
+    if (!cJSON_IsArray(entries)) {
+        cJSON_Delete(root);
+        return localServer->sendJsonError(req, 400, "Missing or invalid 'entries'");
+    }
+    DutySchedule schedule;
+    cJSON* item = nullptr;
+    cJSON_ArrayForEach(item, entries) {
+        if (schedule.count == schedule_max_entries || !parseScheduleEntry(item, schedule.entries[schedule.count])) {
+            cJSON_Delete(root);
+            return localServer->sendJsonError(req, 400, "Invalid schedule entry");
+        }
+        ++schedule.count;
+    }
+    cJSON_Delete(root);
+
+    const char* problem = localCtx->scheduler->setSchedule(schedule);
+    if (problem != nullptr) {
+        return localServer->sendJsonError(req, 400, problem);
+    }
+    return schedule_get_handler(req);
+}
+
+esp_err_t LocalWebServer::schedule_delete_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->scheduler) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext / scheduler");
+    }
+    localCtx->scheduler->setSchedule(DutySchedule{});
+    return schedule_get_handler(req);
+}
+
+// Starts a pull update in the background; progress is on /ota/status
 esp_err_t LocalWebServer::ota_handler(httpd_req_t* req) {
+    RequestTimer timer(HttpEndpoint::Ota);
     auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
     auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
-    if (!localCtx || !localCtx->ota) {
-        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext or OTA updater");
+    if (!localCtx || !localCtx->otaService) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext or OTA service");
     }
 
-    std::string requestBody;
+    char* requestBody = nullptr;
     esp_err_t readResult = readRequestBody(localServer, req, requestBody);
     if (readResult != ESP_OK) {
         return readResult;
     }
-    JsonWrapper json = JsonWrapper::Parse(requestBody.c_str());
-    std::string otaURL;
-    if (json.GetField("ota_url", otaURL, true)) {
-        localCtx->ota->perform_update(otaURL);
-        ESP_LOGI(TAG_LOCAL, "Flashed from '%s'", otaURL.c_str());
-    } else {
+    FlatJson json;
+    const char* otaURL = nullptr;
+    if (!json.parse(requestBody) || !json.getString("ota_url", otaURL) || otaURL[0] == '\0') {
         ESP_LOGW(TAG_LOCAL, "Missing or invalid 'ota_url'");
         return localServer->sendJsonError(req, 400, "Missing or invalid 'ota_url'");
     }
+    if (!localCtx->otaService->startPull(otaURL)) {
+        return localServer->sendJsonError(req, 409, "An update is already running");
+    }
+    ESP_LOGI(TAG_LOCAL, "Update from '%s' started", otaURL);
+    httpd_resp_set_status(req, "202 Accepted");
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, "{\"status\":\"OK\"}");
+    httpd_resp_sendstr(req, "{\"status\":\"ACCEPTED\"}");
     return ESP_OK;
 }
 
+// Streams the request body into the next OTA partition. The request is
+// handed to the OTA task, which answers it once the image is written, so
+// this httpd task goes straight back to serving other sockets.
+esp_err_t LocalWebServer::ota_upload_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->otaService) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext or OTA service");
+    }
+    if (req->content_len == 0) {
+        return localServer->sendJsonError(req, 411, "Content-Length required");
+    }
+    if (localCtx->otaService->busy()) {
+        httpd_resp_set_hdr(req, "Connection", "close");
+        return localServer->sendJsonError(req, 409, "An update is already running");
+    }
+
+    httpd_req_t* asyncReq = nullptr;
+    if (httpd_req_async_handler_begin(req, &asyncReq) != ESP_OK) {
+        return localServer->sendJsonError(req, 503, "Cannot hand off the upload");
+    }
+    if (!localCtx->otaService->startPush(asyncReq)) {
+        // Lost a race with another update
+        httpd_resp_set_status(asyncReq, "409 Conflict");
+        httpd_resp_set_hdr(asyncReq, "Connection", "close");
+        httpd_resp_set_type(asyncReq, "application/json");
+        httpd_resp_sendstr(asyncReq, "{\"status\":\"ERROR\",\"message\":\"An update is already running\"}");
+        httpd_req_async_handler_complete(asyncReq);
+    }
+    return ESP_OK;
+}
+
+esp_err_t LocalWebServer::ota_status_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->otaService) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext or OTA service");
+    }
+    static const char* const STATE_NAMES[] = {"idle", "pulling", "receiving", "done", "failed"};
+    static const char* const MODE_NAMES[] = {"none", "pull", "push"};
+    OtaStatus status = localCtx->otaService->getStatus();
+
+    int64_t end = status.finished_us ? status.finished_us : esp_timer_get_time();
+    int64_t elapsed_us = status.started_us ? end - status.started_us : 0;
+    uint32_t rate = elapsed_us > 0 ? static_cast<uint32_t>(int64_t{status.bytes} * 1000000 / elapsed_us) : 0;
+
+    char response[RESPONSE_MAX_LEN];
+    size_t len = appendf(response, sizeof(response), 0,
+                         "{\"state\":\"%s\",\"mode\":\"%s\",\"progress\":%d,\"bytes\":%" PRIu32
+                         ",\"total\":%" PRIu32 ",\"elapsed_ms\":%d,\"bytes_per_s\":%" PRIu32,
+                         STATE_NAMES[static_cast<int>(status.state)], MODE_NAMES[static_cast<int>(status.mode)],
+                         status.progress, status.bytes, status.total, static_cast<int>(elapsed_us / 1000), rate);
+    if (status.error[0] != '\0') {
+        len = appendf(response, sizeof(response), len, ",\"error\":\"%s\"", status.error);
+    }
+    len = appendf(response, sizeof(response), len, "}");
+    return sendJson(req, response, len);
+}
+
+// Applies one ControlCommandFrame and fills in the ack
+static void applyControlFrame(LocalWebContext* localCtx, const ControlCommandFrame& command, ControlAckFrame& ack) {
+    int64_t received = esp_timer_get_time();
+    ack.client_seq = command.client_seq;
+    ack.channel = command.channel;
+    if (!PWMControl::validChannel(command.channel)) {
+        ack.status = static_cast<uint8_t>(ControlStatus::BadChannel);
+        return;
+    }
+
+    uint32_t seq = 0;
+    switch (static_cast<ControlOp>(command.op)) {
+    case ControlOp::Duty: {
+        float duty = command.value / 100.0f;
+        if (SettingsManager::checkDuty(duty) != nullptr) {
+            ack.status = static_cast<uint8_t>(ControlStatus::BadValue);
+            return;
+        }
+        seq = localCtx->pump->setDutyCyclePercentage(command.channel, duty, 0, command.ramp_ms);
+        if (seq != 0) {
+            localCtx->settings->storeDuty(command.channel, duty);
+        }
+        break;
+    }
+    case ControlOp::Frequency:
+        if (command.value == 0 || command.value > INT32_MAX) {
+            ack.status = static_cast<uint8_t>(ControlStatus::BadValue);
+            return;
+        }
+        seq = localCtx->pump->setFrequency(command.channel, static_cast<int>(command.value));
+        if (seq == 0) {
+            // Out of range is far more likely than a full queue here
+            ack.status = static_cast<uint8_t>(ControlStatus::BadValue);
+            return;
+        }
+        localCtx->settings->storeFrequency(command.channel, static_cast<int>(command.value));
+        break;
+    default:
+        ack.status = static_cast<uint8_t>(ControlStatus::BadFrame);
+        return;
+    }
+    if (seq == 0) {
+        ack.status = static_cast<uint8_t>(ControlStatus::Busy);
+        return;
+    }
+
+    PwmChannelState state = localCtx->pump->waitApplied(command.channel, seq);
+    bool applied = static_cast<int32_t>(state.applied_seq - seq) >= 0;
+    ack.status = static_cast<uint8_t>(applied ? ControlStatus::Ok : ControlStatus::Pending);
+    ack.applied_seq = seq;
+    ack.duty_centi = static_cast<uint16_t>(std::lround(state.duty * 100.0f));
+    ack.frequency = state.frequency;
+    ack.achieved_hz = state.achieved_hz;
+    ack.apply_us = static_cast<uint32_t>(esp_timer_get_time() - received);
+}
+
+// Streaming control channel: one binary ControlCommandFrame per message,
+// each answered with a ControlAckFrame. Saves the HTTP and JSON overhead of
+// /pump for controllers that push setpoints many times a second.
+esp_err_t LocalWebServer::ws_handler(httpd_req_t* req) {
+    if (req->method == HTTP_GET) {
+        ESP_LOGI(TAG_LOCAL, "Control channel opened on socket %d", httpd_req_to_sockfd(req));
+        return ESP_OK;
+    }
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->pump || !localCtx->settings) {
+        return ESP_FAIL;
+    }
+
+    ControlCommandFrame command{};
+    httpd_ws_frame_t frame = {};
+    frame.payload = reinterpret_cast<uint8_t*>(&command);
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (frame.type != HTTPD_WS_TYPE_BINARY || frame.len != sizeof(command)) {
+        // Anything else is dropped unread, which would desync the socket
+        ESP_LOGW(TAG_LOCAL, "Closing control channel: %u byte frame of type %d",
+                 static_cast<unsigned>(frame.len), frame.type);
+        return ESP_FAIL;
+    }
+    err = httpd_ws_recv_frame(req, &frame, sizeof(command));
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    ControlAckFrame ack{};
+    applyControlFrame(localCtx, command, ack);
+
+    httpd_ws_frame_t reply = {};
+    reply.type = HTTPD_WS_TYPE_BINARY;
+    reply.payload = reinterpret_cast<uint8_t*>(&ack);
+    reply.len = sizeof(ack);
+    return httpd_ws_send_frame(req, &reply);
+}
+
+// Subscribes to state change events as a server-sent event stream. Each
+// event carries one channel's applied state, with the PWMControl state
+// version as its id; bursts are coalesced so a subscriber always converges
+// on the latest state.
+esp_err_t LocalWebServer::events_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->pump) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext / pump");
+    }
+
+    EventSubscriber* slot = nullptr;
+    for (auto& subscriber : localServer->subscribers) {
+        if (subscriber.fd < 0) {
+            slot = &subscriber;
+            break;
+        }
+    }
+    if (slot == nullptr) {
+        httpd_resp_set_hdr(req, "Retry-After", "10");
+        return localServer->sendJsonError(req, 503, "Too many event subscribers");
+    }
+
+    // The stream never ends, so write the headers ourselves and leave the
+    // socket with httpd; the session context frees the slot when it closes.
+    static const char header[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Access-Control-Allow-Origin: *\r\n\r\n";
+    int fd = httpd_req_to_sockfd(req);
+    if (httpd_socket_send(localServer->server, fd, header, sizeof(header) - 1, 0) != sizeof(header) - 1) {
+        return ESP_FAIL;
+    }
+    slot->owner = localServer;
+    slot->fd = fd;
+    slot->closing = false;
+    req->sess_ctx = slot;
+    req->free_ctx = release_subscriber;
+    ++localServer->subscriber_count;
+    ESP_LOGI(TAG_LOCAL, "Event subscriber on socket %d", fd);
+
+    // Start the new subscriber off with every channel's current state
+    char event[RESPONSE_MAX_LEN + 32];
+    uint32_t version = localCtx->pump->getStateVersion();
+    for (int i = 0; i < pwm_channel_count; ++i) {
+        size_t len = appendf(event, sizeof(event), 0, "event: state\nid: %" PRIu32 "\ndata: ", version);
+        len += formatChannelState(event + len, sizeof(event) - len, nullptr, i, localCtx->pump->getState(i));
+        len = appendf(event, sizeof(event), len, "}\n\n");
+        httpd_socket_send(localServer->server, fd, event, len, MSG_DONTWAIT);
+    }
+    return ESP_OK;
+}
+
+void LocalWebServer::release_subscriber(void* ctx) {
+    auto* slot = static_cast<EventSubscriber*>(ctx);
+    ESP_LOGI(TAG_LOCAL, "Event subscriber on socket %d closed", slot->fd);
+    slot->fd = -1;
+    slot->closing = false;
+    --slot->owner->subscriber_count;
+}
+
+// Sends to every subscriber without blocking; one that cannot keep up is
+// dropped rather than allowed to stall the httpd task.
+void LocalWebServer::broadcastEvent(const char* event, size_t len) {
+    for (auto& subscriber : subscribers) {
+        if (subscriber.fd < 0 || subscriber.closing) {
+            continue;
+        }
+        int sent = httpd_socket_send(server, subscriber.fd, event, len, MSG_DONTWAIT);
+        if (sent != static_cast<int>(len)) {
+            ESP_LOGW(TAG_LOCAL, "Dropping event subscriber on socket %d", subscriber.fd);
+            subscriber.closing = true;
+            httpd_sess_trigger_close(server, subscriber.fd);
+        }
+    }
+}
+
+// Runs on the httpd task via httpd_queue_work
+void LocalWebServer::send_events(void* arg) {
+    auto* localServer = static_cast<LocalWebServer*>(arg);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    localServer->events_work_queued = false;
+
+    char event[RESPONSE_MAX_LEN + 32];
+    bool sent = false;
+    uint32_t version = localCtx->pump->getStateVersion();
+    for (int i = 0; i < pwm_channel_count; ++i) {
+        PwmChannelState state = localCtx->pump->getState(i);
+        PwmChannelState& last = localServer->last_event_state[i];
+        if (state.applied_seq == last.applied_seq && state.duty == last.duty && state.target == last.target
+            && state.frequency == last.frequency && state.invert == last.invert
+            && state.pulse_active == last.pulse_active) {
+            continue;
+        }
+        last = state;
+        size_t len = appendf(event, sizeof(event), 0, "event: state\nid: %" PRIu32 "\ndata: ", version);
+        len += formatChannelState(event + len, sizeof(event) - len, nullptr, i, state);
+        len = appendf(event, sizeof(event), len, "}\n\n");
+        localServer->broadcastEvent(event, len);
+        sent = true;
+    }
+    if (localServer->keepalive_due.exchange(false) && !sent) {
+        // Comment line; lets both ends notice a dead connection
+        static const char keepalive[] = ": keepalive\n\n";
+        localServer->broadcastEvent(keepalive, sizeof(keepalive) - 1);
+    }
+}
+
+void LocalWebServer::events_task(void* arg) {
+    auto* localServer = static_cast<LocalWebServer*>(arg);
+    for (;;) {
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(EVENTS_KEEPALIVE_MS)) == 0) {
+            localServer->keepalive_due = true;
+        }
+        if (localServer->subscriber_count == 0 || localServer->events_work_queued.exchange(true)) {
+            continue;
+        }
+        if (httpd_queue_work(localServer->server, send_events, localServer) != ESP_OK) {
+            localServer->events_work_queued = false;
+        }
+        // Bursts of commands fold into one event per channel per interval
+        vTaskDelay(pdMS_TO_TICKS(EVENTS_MIN_INTERVAL_MS));
+    }
+}
+
+#if CONFIG_METRICS
+// Prometheus text goes out in chunks from a small buffer on the httpd
+// stack, so a scrape costs no heap however many series there are.
+class MetricsWriter {
+public:
+    explicit MetricsWriter(httpd_req_t* req) : req(req) {
+    }
+
+    void add(const char* format, ...) {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            va_list args;
+            va_start(args, format);
+            int written = vsnprintf(buffer + len, sizeof(buffer) - len, format, args);
+            va_end(args);
+            if (written < 0) {
+                return;
+            }
+            if (len + written < sizeof(buffer)) {
+                len += written;
+                return;
+            }
+            // Did not fit; send what is there and format again
+            flush();
+        }
+    }
+
+    void histogram(const char* name, const char* labels, const LatencyHistogram& histogram) {
+        const char* separator = labels[0] != '\0' ? "," : "";
+        uint32_t total = 0;
+        for (size_t i = 0; i < LatencyHistogram::bucket_count; ++i) {
+            total += histogram.hits(i);
+            add("%s_bucket{%s%sle=\"%g\"} %" PRIu32 "\n", name, labels, separator,
+                LatencyHistogram::bounds_us[i] / 1e6, total);
+        }
+        total += histogram.hits(LatencyHistogram::bucket_count);
+        add("%s_bucket{%s%sle=\"+Inf\"} %" PRIu32 "\n", name, labels, separator, total);
+        const char* open = labels[0] != '\0' ? "{" : "";
+        const char* close = labels[0] != '\0' ? "}" : "";
+        add("%s_sum%s%s%s %.6f\n", name, open, labels, close, histogram.sumMicros() / 1e6);
+        add("%s_count%s%s%s %" PRIu32 "\n", name, open, labels, close, total);
+    }
+
+    esp_err_t finish() {
+        flush();
+        return err == ESP_OK ? httpd_resp_send_chunk(req, nullptr, 0) : err;
+    }
+
+private:
+    void flush() {
+        if (len > 0 && err == ESP_OK) {
+            err = httpd_resp_send_chunk(req, buffer, len);
+        }
+        len = 0;
+    }
+
+    httpd_req_t* req;
+    char buffer[512];
+    size_t len = 0;
+    esp_err_t err = ESP_OK;
+};
+
+esp_err_t LocalWebServer::metrics_handler(httpd_req_t* req) {
+    auto* localServer = static_cast<LocalWebServer*>(req->user_ctx);
+    auto* localCtx = static_cast<LocalWebContext*>(localServer->webContext);
+    if (!localCtx || !localCtx->pump) {
+        return localServer->sendJsonError(req, 500, "Invalid LocalWebContext or pump");
+    }
+    static const char* const ENDPOINT_LABELS[] = {"handler=\"pump\"", "handler=\"signal\"", "handler=\"ota\"",
+                                                    "handler=\"settings\""};
+    static_assert(sizeof(ENDPOINT_LABELS) / sizeof(ENDPOINT_LABELS[0]) == static_cast<size_t>(HttpEndpoint::Count),
+                  "every endpoint needs a label");
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    MetricsWriter out(req);
+
+    out.add("# HELP pump_http_request_duration_seconds Handler time, from the first line of the handler to its return.\n"
+            "# TYPE pump_http_request_duration_seconds histogram\n");
+    for (size_t i = 0; i < static_cast<size_t>(HttpEndpoint::Count); ++i) {
+        out.histogram("pump_http_request_duration_seconds", ENDPOINT_LABELS[i], Metrics::requests[i]);
+    }
+
+    out.add("# HELP pump_command_latency_seconds Time from a duty command being posted to its output being written.\n"
+            "# TYPE pump_command_latency_seconds histogram\n");
+    out.histogram("pump_command_latency_seconds", "", Metrics::command_latency);
+    out.add("# HELP pump_pulse_start_delay_seconds Time from a pulse request being accepted to its duty being written.\n"
+            "# TYPE pump_pulse_start_delay_seconds histogram\n");
+    out.histogram("pump_pulse_start_delay_seconds", "", Metrics::pulse_start_late);
+    out.add("# HELP pump_pulse_end_delay_seconds Time from a pulse's deadline to its revert being written.\n"
+            "# TYPE pump_pulse_end_delay_seconds histogram\n");
+    out.histogram("pump_pulse_end_delay_seconds", "", Metrics::pulse_end_late);
+    out.add("# TYPE pump_command_queue_depth gauge\npump_command_queue_depth %" PRIu32 "\n",
+            localCtx->pump->getQueueDepth());
+    out.add("# TYPE pump_command_queue_high_water gauge\npump_command_queue_high_water %" PRIu32 "\n",
+            Metrics::queue_high_water.load(std::memory_order_relaxed));
+    out.add("# TYPE pump_command_queue_capacity gauge\npump_command_queue_capacity %d\n", QUEUE_SIZE);
+    out.add("# TYPE pump_command_queue_rejected_total counter\npump_command_queue_rejected_total %" PRIu32 "\n",
+            Metrics::queue_rejected.load(std::memory_order_relaxed));
+    out.add("# TYPE pump_setpoints_coalesced_total counter\npump_setpoints_coalesced_total %" PRIu32 "\n",
+            localCtx->pump->getCoalescedCount());
+    out.add("# TYPE pump_ledc_errors_total counter\npump_ledc_errors_total %" PRIu32 "\n",
+            Metrics::ledc_errors.load(std::memory_order_relaxed));
+
+    out.add("# HELP pump_nvs_write_duration_seconds NVS blob writes including the commit.\n"
+            "# TYPE pump_nvs_write_duration_seconds histogram\n");
+    out.histogram("pump_nvs_write_duration_seconds", "", Metrics::nvs_writes);
+    out.add("# TYPE pump_nvs_write_errors_total counter\npump_nvs_write_errors_total %" PRIu32 "\n",
+            Metrics::nvs_errors.load(std::memory_order_relaxed));
+
+    out.add("# TYPE pump_heap_free_bytes gauge\npump_heap_free_bytes %" PRIu32 "\n", esp_get_free_heap_size());
+    out.add("# TYPE pump_heap_min_free_bytes gauge\npump_heap_min_free_bytes %" PRIu32 "\n",
+            esp_get_minimum_free_heap_size());
+    out.add("# TYPE pump_heap_largest_free_block_bytes gauge\npump_heap_largest_free_block_bytes %u\n",
+            static_cast<unsigned>(heap_caps_get_largest_free_block(MALLOC_CAP_8BIT)));
+    // Tasks from the memory budget; ones not running are skipped
+    out.add("# HELP pump_task_stack_min_free_bytes Least stack a task has had left since it started.\n"
+            "# TYPE pump_task_stack_min_free_bytes gauge\n");
+    for (const TaskBudget& budget : task_budget) {
+        TaskHandle_t task = xTaskGetHandle(budget.name);
+        if (task != nullptr) {
+            out.add("pump_task_stack_min_free_bytes{task=\"%s\"} %u\n", budget.name,
+                    static_cast<unsigned>(uxTaskGetStackHighWaterMark(task)));
+        }
+    }
+    out.add("# TYPE pump_task_stack_size_bytes gauge\n");
+    for (const TaskBudget& budget : task_budget) {
+        if (xTaskGetHandle(budget.name) != nullptr) {
+            out.add("pump_task_stack_size_bytes{task=\"%s\"} %" PRIu32 "\n", budget.name, budget.stack_bytes);
+        }
+    }
+    out.add("# TYPE pump_uptime_seconds gauge\npump_uptime_seconds %" PRId64 "\n", esp_timer_get_time() / 1000000);
+    return out.finish();
+}
+#endif
+
 void LocalWebServer::populate_healthz_fields(WebContext* context, JsonWrapper& json) {
     auto* localContext = static_cast<LocalWebContext*>(context);
-    json.AddItem("duty", localContext->settings->duty);
+    for (int i = 0; i < pwm_channel_count; ++i) {
+        json.AddItem(SettingsManager::channelKey("duty", i), localContext->pump->getCurrentPercentage(i));
+    }
+    PersistStats persist = localContext->settings->getPersistStats();
+    json.AddItem("nvs_writes", static_cast<int>(persist.written));
+    json.AddItem("nvs_writes_avoided", static_cast<int>(persist.avoided));
+    json.AddItem("nvs_write_failures", static_cast<int>(persist.failed));
+    json.AddItem("nvs_flush_us", static_cast<int>(persist.last_flush_us));
+    json.AddItem("nvs_flush_max_us", static_cast<int>(persist.max_flush_us));
+    for (size_t i = 0; i < static_cast<size_t>(BootPhase::Count); ++i) {
+        BootPhase phase = static_cast<BootPhase>(i);
+        if (BootTimeline::at(phase) >= 0) {
+            json.AddItem(BootTimeline::name(phase), static_cast<int>(BootTimeline::at(phase)));
+        }
+    }
+    json.AddItem("coalesced", static_cast<int>(localContext->pump->getCoalescedCount()));
+    PulseJitterStats jitter = localContext->pump->getPulseJitter();
+    json.AddItem("pulse_starts", static_cast<int>(jitter.starts));
+    json.AddItem("pulse_start_late_us", static_cast<int>(jitter.start_late_avg_us));
+    json.AddItem("pulse_start_late_max_us", static_cast<int>(jitter.start_late_max_us));
+    json.AddItem("pulse_ends", static_cast<int>(jitter.ends));
+    json.AddItem("pulse_end_late_us", static_cast<int>(jitter.end_late_avg_us));
+    json.AddItem("pulse_end_late_max_us", static_cast<int>(jitter.end_late_max_us));
+    json.AddItem("control_core", controlTaskCoreId());
+    json.AddItem("duty_task_priority", static_cast<int>(duty_task_priority));
+    json.AddItem("event_subscribers", subscriber_count.load());
+#if CONFIG_PWM_DITHER
+    DitherStats dither = localContext->pump->getDitherStats();
+    json.AddItem("dither_period_us", static_cast<int>(dither.period_us));
+    json.AddItem("dither_ticks", static_cast<int>(dither.ticks));
+    json.AddItem("dither_cpu_permille", static_cast<int>(dither.cpu_permille));
+    json.AddItem("dither_tick_max_us", static_cast<int>(dither.max_tick_us));
+    json.AddItem("dither_backoffs", static_cast<int>(dither.backoffs));
+#endif
+    if (localContext->speed) {
+        SpeedStatus speed = localContext->speed->getStatus();
+        json.AddItem("speed_active", speed.active ? 1 : 0);
+        json.AddItem("target_rpm", speed.target_rpm);
+        json.AddItem("rpm", speed.rpm);
+        json.AddItem("speed_iterations", static_cast<int>(speed.iterations));
+        json.AddItem("speed_overruns", static_cast<int>(speed.overruns));
+        json.AddItem("speed_period_us", static_cast<int>(speed.period_us));
+        json.AddItem("speed_jitter_max_us", static_cast<int>(speed.max_jitter_us));
+        json.AddItem("speed_compute_us", static_cast<int>(speed.compute_us));
+        json.AddItem("speed_compute_max_us", static_cast<int>(speed.max_compute_us));
+    }
 }
 
@@ -3,21 +3,35 @@
 #include "PWMControl.h"
 #include "SettingsManager.h"
 #include "Ota.h"
+#include "OtaService.h"
+#include "Scheduler.h"
+#include "SpeedController.h"
+#include "sdkconfig.h"
+#include <atomic>
 #include <string>
 
 struct LocalWebContext : public WebContext {
     PWMControl* pump;
     SettingsManager* settings;
     OTAUpdater* ota;
+    OtaService* otaService;
+    Scheduler* scheduler;
+    SpeedController* speed;     // null unless CONFIG_SPEED_CONTROL
 
     LocalWebContext(WiFiManager* wifi,
                     PWMControl* pumpPtr,
                     SettingsManager* settingsPtr,
-                    OTAUpdater* otaPtr)
+                    OTAUpdater* otaPtr,
+                    OtaService* otaServicePtr,
+                    Scheduler* schedulerPtr,
+                    SpeedController* speedPtr = nullptr)
         : WebContext(wifi),
           pump(pumpPtr),
           settings(settingsPtr),
-          ota(otaPtr) {
+          ota(otaPtr),
+          otaService(otaServicePtr),
+          scheduler(schedulerPtr),
+          speed(speedPtr) {
     }
 };
 
@@ -29,11 +43,55 @@ public:
 
 private:
     static esp_err_t pump_handler(httpd_req_t* req);
+    static esp_err_t batch_handler(httpd_req_t* req);
     static esp_err_t signal_handler(httpd_req_t* req);
+    static esp_err_t settings_get_handler(httpd_req_t* req);
+    static esp_err_t settings_patch_handler(httpd_req_t* req);
     static esp_err_t ota_handler(httpd_req_t* req);
+    static esp_err_t ota_upload_handler(httpd_req_t* req);
+    static esp_err_t ota_status_handler(httpd_req_t* req);
+    static esp_err_t ws_handler(httpd_req_t* req);
+    static esp_err_t events_handler(httpd_req_t* req);
+    static esp_err_t program_post_handler(httpd_req_t* req);
+    static esp_err_t program_get_handler(httpd_req_t* req);
+    static esp_err_t program_delete_handler(httpd_req_t* req);
+    static esp_err_t calibration_get_handler(httpd_req_t* req);
+    static esp_err_t calibration_put_handler(httpd_req_t* req);
+    static esp_err_t calibration_delete_handler(httpd_req_t* req);
+    static esp_err_t schedule_get_handler(httpd_req_t* req);
+    static esp_err_t schedule_put_handler(httpd_req_t* req);
+    static esp_err_t schedule_delete_handler(httpd_req_t* req);
+#if CONFIG_METRICS
+    static esp_err_t metrics_handler(httpd_req_t* req);
+#endif
 
-    // Helper to read the POST body. Calls sendJsonError through the provided instance.
-    static esp_err_t readRequestBody(LocalWebServer* localServer, httpd_req_t* req, std::string& body);
+    // State change fan-out for /events. The duty task only notifies
+    // events_task, which hands the sending to the httpd task.
+    static void events_task(void* arg);
+    static void send_events(void* arg);
+    static void release_subscriber(void* ctx);
+    void broadcastEvent(const char* event, size_t len);
+
+    // Helper to read the POST body into rxBuffer. `body` is only valid until
+    // the next request. Calls sendJsonError through the provided instance.
+    static esp_err_t readRequestBody(LocalWebServer* localServer, httpd_req_t* req, char*& body);
+
+    // The httpd task runs one handler at a time, so a single buffer serves
+    // every connection and a body can never cost heap.
+    char rxBuffer[CONFIG_HTTP_BODY_MAX_LEN + 1];
+
+    // Only touched from the httpd task
+    struct EventSubscriber {
+        LocalWebServer* owner = nullptr;
+        int fd = -1;
+        bool closing = false;
+    };
+    EventSubscriber subscribers[CONFIG_SSE_MAX_SUBSCRIBERS];
+    PwmChannelState last_event_state[pwm_channel_count] = {};
+
+    std::atomic<int> subscriber_count{0};
+    std::atomic<bool> events_work_queued{false};
+    std::atomic<bool> keepalive_due{false};
 
 protected:
     virtual void populate_healthz_fields(WebContext* context, JsonWrapper& json);
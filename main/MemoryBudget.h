@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+// Stack sizes, in bytes as IDF counts them, of the tasks this firmware
+// creates. Creators take their size from here, so the budget report
+// compares each task's watermark against what it was really given.
+inline constexpr uint32_t duty_task_stack = 3072;
+inline constexpr uint32_t settings_flush_stack = 3072;
+inline constexpr uint32_t schedule_task_stack = 3072;   // mktime parses TZ rules
+inline constexpr uint32_t speed_task_stack = 3072;
+inline constexpr uint32_t events_task_stack = 3072;
+inline constexpr uint32_t ota_task_stack = 6144;
+inline constexpr uint32_t button_task_stack = 2048;
+inline constexpr uint32_t sntp_task_stack = 3072;
+inline constexpr uint32_t httpd_task_stack = 4096;      // HTTPD_DEFAULT_CONFIG, in the web server component
+
+struct TaskBudget {
+    const char* name;
+    uint32_t stack_bytes;
+    bool is_static;             // stack and TCB reserved at build time
+};
+
+// Tasks not running (no speed control, the SNTP task once synced) are
+// skipped by the report
+inline constexpr TaskBudget task_budget[] = {
+    {"main", CONFIG_ESP_MAIN_TASK_STACK_SIZE, false},
+    {"DutyCycleTask", duty_task_stack, true},
+    {"settings_flush", settings_flush_stack, true},
+    {"schedule", schedule_task_stack, true},
+    {"speed_ctrl", speed_task_stack, true},
+    {"esp_timer", CONFIG_ESP_TIMER_TASK_STACK_SIZE, false},
+    {"httpd", httpd_task_stack, false},
+    {"sse_events", events_task_stack, false},
+    {"ota", ota_task_stack, false},
+    {"button_task", button_task_stack, false},
+    {"sntp_task", sntp_task_stack, false},
+    {"tiT", CONFIG_LWIP_TCPIP_TASK_STACK_SIZE, false},
+};
+
+// Logs each task's stack use against its size, and where the heap stands.
+// Watermarks only count what has run so far, so this is worth calling once
+// the device has been serving for a while.
+inline void logMemoryBudget() {
+    ESP_LOGI("MemoryBudget", "%-15s %6s %6s %5s", "task", "stack", "peak", "used");
+    uint32_t total = 0;
+    for (const TaskBudget& budget : task_budget) {
+        TaskHandle_t task = xTaskGetHandle(budget.name);
+        if (task == nullptr) {
+            continue;
+        }
+        uint32_t free = uxTaskGetStackHighWaterMark(task);
+        uint32_t peak = budget.stack_bytes > free ? budget.stack_bytes - free : 0;
+        total += budget.stack_bytes;
+        ESP_LOGI("MemoryBudget", "%-15s %6lu %6lu %4lu%%%s", budget.name, static_cast<unsigned long>(budget.stack_bytes),
+                 static_cast<unsigned long>(peak), static_cast<unsigned long>(peak * 100 / budget.stack_bytes),
+                 budget.is_static ? " static" : "");
+    }
+    ESP_LOGI("MemoryBudget", "stacks %lu, heap free %lu, lowest %lu, largest block %u",
+             static_cast<unsigned long>(total), static_cast<unsigned long>(esp_get_free_heap_size()),
+             static_cast<unsigned long>(esp_get_minimum_free_heap_size()),
+             static_cast<unsigned>(heap_caps_get_largest_free_block(MALLOC_CAP_8BIT)));
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+// Handlers with a request histogram on /metrics
+enum class HttpEndpoint : uint8_t {
+    Pump,
+    Signal,
+    Ota,
+    Settings,
+    Count,
+};
+
+#if CONFIG_METRICS
+// Request or command latencies, counted into fixed buckets. Each bucket
+// holds only its own hits; the exporter accumulates them. The sum is in
+// microseconds and wraps after about 71 minutes of recorded time, which a
+// Prometheus rate() takes for a counter reset.
+class LatencyHistogram {
+public:
+    static constexpr uint32_t bounds_us[] = {100, 250, 500, 1000, 2500, 5000, 10000,
+                                             25000, 50000, 100000, 250000, 1000000};
+    static constexpr size_t bucket_count = sizeof(bounds_us) / sizeof(bounds_us[0]);
+
+    void record(int64_t elapsed_us) {
+        uint32_t us = elapsed_us < 0 ? 0 : elapsed_us > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(elapsed_us);
+        size_t i = 0;
+        while (i < bucket_count && us > bounds_us[i]) {
+            ++i;
+        }
+        buckets[i].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(us, std::memory_order_relaxed);
+    }
+
+    // Hits at or below bounds_us[i]; i == bucket_count is everything
+    uint32_t hits(size_t i) const {
+        return buckets[i].load(std::memory_order_relaxed);
+    }
+
+    uint32_t sumMicros() const {
+        return sum.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint32_t> buckets[bucket_count + 1] = {};
+    std::atomic<uint32_t> sum{0};
+};
+#endif
+
+// Counters for /metrics. Recording is a relaxed 32-bit atomic add, so it is
+// safe from any task or esp_timer callback and never blocks; a scrape may
+// see a histogram halfway through an update, which is harmless for
+// counters. With CONFIG_METRICS off the recorders are empty and the
+// counters do not exist.
+class Metrics {
+public:
+    static void recordRequest(HttpEndpoint endpoint, int64_t elapsed_us) {
+#if CONFIG_METRICS
+        requests[static_cast<size_t>(endpoint)].record(elapsed_us);
+#endif
+    }
+
+    // Time from a DutyCycleCommand being posted to its output being written
+    static void recordCommand(int64_t enqueued_us) {
+#if CONFIG_METRICS
+        command_latency.record(esp_timer_get_time() - enqueued_us);
+#endif
+    }
+
+    static void recordQueueDepth(uint32_t depth) {
+#if CONFIG_METRICS
+        uint32_t seen = queue_high_water.load(std::memory_order_relaxed);
+        while (depth > seen && !queue_high_water.compare_exchange_weak(seen, depth, std::memory_order_relaxed)) {
+        }
+#endif
+    }
+
+    static void recordQueueFull() {
+#if CONFIG_METRICS
+        queue_rejected.fetch_add(1, std::memory_order_relaxed);
+#endif
+    }
+
+    static void recordNvsWrite(int64_t elapsed_us, bool ok) {
+#if CONFIG_METRICS
+        nvs_writes.record(elapsed_us);
+        if (!ok) {
+            nvs_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+#endif
+    }
+
+    // Lateness of a pulse's first duty write after its request, and of its
+    // revert after its deadline
+    static void recordPulseStart(int64_t late_us) {
+#if CONFIG_METRICS
+        pulse_start_late.record(late_us);
+#endif
+    }
+
+    static void recordPulseEnd(int64_t late_us) {
+#if CONFIG_METRICS
+        pulse_end_late.record(late_us);
+#endif
+    }
+
+    static void recordLedcError() {
+#if CONFIG_METRICS
+        ledc_errors.fetch_add(1, std::memory_order_relaxed);
+#endif
+    }
+
+#if CONFIG_METRICS
+    static inline LatencyHistogram requests[static_cast<size_t>(HttpEndpoint::Count)];
+    static inline LatencyHistogram command_latency;
+    static inline LatencyHistogram nvs_writes;
+    static inline LatencyHistogram pulse_start_late;
+    static inline LatencyHistogram pulse_end_late;
+    static inline std::atomic<uint32_t> queue_high_water{0};
+    static inline std::atomic<uint32_t> queue_rejected{0};
+    static inline std::atomic<uint32_t> nvs_errors{0};
+    static inline std::atomic<uint32_t> ledc_errors{0};
+#endif
+};
+
+// Records the lifetime of a handler call into its request histogram
+class RequestTimer {
+public:
+    explicit RequestTimer(HttpEndpoint endpoint) {
+#if CONFIG_METRICS
+        this->endpoint = endpoint;
+        start_us = esp_timer_get_time();
+#endif
+    }
+
+    ~RequestTimer() {
+#if CONFIG_METRICS
+        Metrics::recordRequest(endpoint, esp_timer_get_time() - start_us);
+#endif
+    }
+
+    RequestTimer(const RequestTimer&) = delete;
+    RequestTimer& operator=(const RequestTimer&) = delete;
+
+private:
+#if CONFIG_METRICS
+    HttpEndpoint endpoint;
+    int64_t start_us;
+#endif
+};
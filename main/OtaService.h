@@ -0,0 +1,253 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "MemoryBudget.h"
+#include "Ota.h"
+#include "SeqLock.h"
+#include "SettingsManager.h"
+
+enum class OtaState : uint8_t {
+    Idle,
+    Pulling,        // OTAUpdater is downloading from a URL
+    Receiving,      // a pushed image is streaming in
+    Done,           // new image staged, restarting
+    Failed,
+};
+
+enum class OtaMode : uint8_t {
+    None,
+    Pull,
+    Push,
+};
+
+struct OtaStatus {
+    OtaState state;
+    OtaMode mode;
+    int progress;               // percent, -1 if unknown
+    uint32_t bytes;             // written to flash so far (push)
+    uint32_t total;             // image size, 0 if unknown
+    int64_t started_us;
+    int64_t finished_us;        // 0 while running
+    char error[48];
+};
+
+// Runs firmware updates on a task of their own, so the httpd task is never
+// held for the length of a download. Pull mode hands a URL to OTAUpdater;
+// push mode streams a POSTed image into the next OTA partition one chunk at
+// a time, so the image is never held in RAM. One update runs at a time.
+class OtaService {
+public:
+    static const size_t CHUNK_SIZE = 4096;      // one flash sector
+    static const int RECV_TIMEOUT_RETRIES = 5;
+    static const int RESTART_DELAY_MS = 1000;   // lets the last response out
+
+    OtaService(OTAUpdater& updater, SettingsManager& settings)
+        : updater(updater), settings(settings) {
+        OtaStatus idle{};
+        idle.progress = -1;
+        status.write(idle);
+        if (xTaskCreate(otaTask, "ota", ota_task_stack, this, 2, &task) != pdPASS) {
+            ESP_LOGE("OtaService", "Failed to create OTA task.");
+        }
+        instance = this;
+    }
+
+    OtaStatus getStatus() const {
+        return status.read();
+    }
+
+    bool busy() const {
+        return running.load();
+    }
+
+    // Queues a download from `url`; false if an update is already running
+    bool startPull(const char* url) {
+        if (strlen(url) >= sizeof(pull_url) || !claim()) {
+            return false;
+        }
+        strcpy(pull_url, url);
+        job = OtaMode::Pull;
+        xTaskNotifyGive(task);
+        return true;
+    }
+
+    // Takes over `req`, an async copy from httpd_req_async_handler_begin,
+    // and answers it once the image is in; false if an update is running
+    bool startPush(httpd_req_t* req) {
+        if (!claim()) {
+            return false;
+        }
+        push_req = req;
+        job = OtaMode::Push;
+        xTaskNotifyGive(task);
+        return true;
+    }
+
+    // OTAUpdater progress callback target
+    static void onProgress(int percent) {
+        if (instance && instance->job == OtaMode::Pull) {
+            OtaStatus current = instance->status.read();
+            current.progress = percent;
+            instance->status.write(current);
+        }
+    }
+
+private:
+    bool claim() {
+        bool expected = false;
+        return running.compare_exchange_strong(expected, true);
+    }
+
+    static void otaTask(void* pvParameter) {
+        OtaService* service = static_cast<OtaService*>(pvParameter);
+        for (;;) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            // Whatever write-behind has pending must not be lost to the restart
+            service->settings.flush();
+            if (service->job == OtaMode::Pull) {
+                service->pull();
+            } else if (service->job == OtaMode::Push) {
+                service->push();
+            }
+            service->job = OtaMode::None;
+            service->running = false;
+        }
+    }
+
+    void begin(OtaState state, OtaMode mode, uint32_t total) {
+        OtaStatus current{};
+        current.state = state;
+        current.mode = mode;
+        current.progress = total ? 0 : -1;
+        current.total = total;
+        current.started_us = esp_timer_get_time();
+        status.write(current);
+    }
+
+    void finish(OtaStatus current, OtaState state, const char* error) {
+        current.state = state;
+        current.finished_us = esp_timer_get_time();
+        if (error != nullptr) {
+            strncpy(current.error, error, sizeof(current.error) - 1);
+            ESP_LOGE("OtaService", "Update failed: %s", error);
+        }
+        status.write(current);
+    }
+
+    void pull() {
+        begin(OtaState::Pulling, OtaMode::Pull, 0);
+        ESP_LOGI("OtaService", "Pulling firmware from '%s'", pull_url);
+        const esp_partition_t* before = esp_ota_get_boot_partition();
+        updater.perform_update(pull_url);
+        // Back here means OTAUpdater did not restart; only a changed boot
+        // partition tells a staged image from a failure
+        OtaStatus current = status.read();
+        if (esp_ota_get_boot_partition() != before) {
+            finish(current, OtaState::Done, nullptr);
+            restart();
+        } else {
+            finish(current, OtaState::Failed, "Download or validation failed");
+        }
+    }
+
+    void push() {
+        httpd_req_t* req = push_req;
+        push_req = nullptr;
+        uint32_t total = static_cast<uint32_t>(req->content_len);
+        begin(OtaState::Receiving, OtaMode::Push, total);
+        OtaStatus current = status.read();
+
+        const esp_partition_t* partition = esp_ota_get_next_update_partition(nullptr);
+        esp_ota_handle_t handle = 0;
+        const char* error = nullptr;
+        esp_err_t err = ESP_OK;
+        if (partition == nullptr) {
+            error = "No OTA partition";
+        } else if (total > partition->size) {
+            error = "Image larger than the OTA partition";
+        } else if ((err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &handle)) != ESP_OK) {
+            error = esp_err_to_name(err);
+        }
+
+        int timeouts = 0;
+        while (error == nullptr && current.bytes < total) {
+            size_t want = total - current.bytes < CHUNK_SIZE ? total - current.bytes : CHUNK_SIZE;
+            int received = httpd_req_recv(req, reinterpret_cast<char*>(chunk), want);
+            if (received == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts <= RECV_TIMEOUT_RETRIES) {
+                continue;
+            }
+            if (received <= 0) {
+                error = "Upload interrupted";
+                break;
+            }
+            timeouts = 0;
+            // Sequential writes erase each sector just ahead of the data
+            if ((err = esp_ota_write(handle, chunk, received)) != ESP_OK) {
+                error = err == ESP_ERR_OTA_VALIDATE_FAILED ? "Not a firmware image" : esp_err_to_name(err);
+                break;
+            }
+            current.bytes += received;
+            current.progress = static_cast<int>(uint64_t{current.bytes} * 100 / total);
+            status.write(current);
+        }
+
+        if (error == nullptr) {
+            if ((err = esp_ota_end(handle)) != ESP_OK) {
+                error = err == ESP_ERR_OTA_VALIDATE_FAILED ? "Image failed validation" : esp_err_to_name(err);
+            } else if ((err = esp_ota_set_boot_partition(partition)) != ESP_OK) {
+                error = esp_err_to_name(err);
+            }
+        } else if (handle != 0) {
+            esp_ota_abort(handle);
+        }
+
+        finish(current, error ? OtaState::Failed : OtaState::Done, error);
+        char response[96];
+        int len = snprintf(response, sizeof(response), "{\"status\":\"%s\",\"bytes\":%lu%s%s%s}",
+                           error ? "ERROR" : "OK", static_cast<unsigned long>(current.bytes),
+                           error ? ",\"message\":\"" : "", error ? error : "", error ? "\"" : "");
+        if (error != nullptr) {
+            httpd_resp_set_status(req, "400 Bad Request");
+            httpd_resp_set_hdr(req, "Connection", "close");
+        }
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, response, len);
+        httpd_req_async_handler_complete(req);
+        if (error == nullptr) {
+            ESP_LOGI("OtaService", "Image of %lu bytes staged in %s", static_cast<unsigned long>(current.bytes),
+                     partition->label);
+            restart();
+        }
+    }
+
+    static void restart() {
+        vTaskDelay(pdMS_TO_TICKS(RESTART_DELAY_MS));
+        esp_restart();
+    }
+
+    OTAUpdater& updater;
+    SettingsManager& settings;
+    TaskHandle_t task = nullptr;
+    SeqLock<OtaStatus> status;      // written by the OTA task only
+    std::atomic<bool> running{false};
+
+    // Handed to the OTA task before it is notified
+    std::atomic<OtaMode> job{OtaMode::None};
+    char pull_url[160] = {};
+    httpd_req_t* push_req = nullptr;
+
+    uint8_t chunk[CHUNK_SIZE];
+
+    static inline OtaService* instance = nullptr;
+};
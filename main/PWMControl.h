@@ -1,186 +1,1528 @@
 #pragma once
 
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include "driver/ledc.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "sdkconfig.h"
 
+#include "Calibration.h"
+#include "LedcTiming.h"
+#include "MemoryBudget.h"
+#include "Metrics.h"
+#include "PwmProgram.h"
+#include "RtcState.h"
+#include "SeqLock.h"
 #include "SettingsManager.h"
+#include "TaskConfig.h"
 
 // Constants
 static const int default_frequency = 5000;
 static const int QUEUE_SIZE = 10;
+static const int ENQUEUE_TIMEOUT_MS = 50;
+static const int APPLY_WAIT_MS = 100;
+
+// Dithering resolves the duty to 1/256 of a raw step
+static const int DITHER_FRAC_BITS = 8;
+static const uint32_t DITHER_FRAC_MASK = (1u << DITHER_FRAC_BITS) - 1;
+static const int DITHER_MIN_PERIODS = 4;        // PWM periods each dithered code is held for
+static const int DITHER_MAX_PERIOD_US = 64000;  // backoff limit
+
+static_assert(pwm_channel_count <= LEDC_TIMER_MAX, "each PWM channel needs its own LEDC timer");
+
+// GPIO for each output channel, from Kconfig
+static const int pwm_channel_gpios[] = {
+    CONFIG_PWM_CHANNEL0_GPIO,
+#if CONFIG_PWM_CHANNEL_COUNT > 1
+    CONFIG_PWM_CHANNEL1_GPIO,
+#endif
+#if CONFIG_PWM_CHANNEL_COUNT > 2
+    CONFIG_PWM_CHANNEL2_GPIO,
+#endif
+#if CONFIG_PWM_CHANNEL_COUNT > 3
+    CONFIG_PWM_CHANNEL3_GPIO,
+#endif
+};
+
+// Set replaces the output (and cancels any pulse), Pulse applies a duty for
+// `period` ms and then reverts, PulseExpired is posted by the pulse timer.
+// Retune and Invert change the signal; like every other hardware change
+// they are carried out by the duty task. ProgramStep is posted by the
+// program timer at the end of each step. Calibrate swaps in the channel's
+// uploaded calibration curve.
+enum class DutyCommandKind : uint8_t {
+    Set,
+    Pulse,
+    PulseExpired,
+    Retune,
+    Invert,
+    ProgramStart,
+    ProgramStop,
+    ProgramStep,
+    Calibrate,
+};
+
+// What a Set or Pulse percentage means: Percent is the drive duty itself,
+// Flow goes through the channel's calibration curve first.
+enum class DutyUnit : uint8_t {
+    Percent,
+    Flow,
+};
+
+// Shape of a hardware fade. Ease follows a quadratic curve that moves slowly
+// near zero duty, which softens pump start-up; it needs gamma curve fade
+// support and falls back to Linear elsewhere.
+enum class RampShape : uint8_t {
+    Linear,
+    Ease,
+};
 
 // Struct to hold duty cycle and period
 struct DutyCycleCommand {
-    int duty;
+    float percentage;       // converted to a raw duty by the duty task
     int period;
+    uint32_t ramp_ms;       // 0 steps straight to the duty
+    uint32_t frequency;     // Retune only
+    RampShape shape;
+    DutyUnit unit;
+    DutyCommandKind kind;
+    uint8_t channel;
+    bool invert;            // Invert only
+    uint32_t timer_id;      // pulse or program a timer expiry belongs to
+    int64_t enqueued_us;
+    uint32_t seq;           // submission order across queue and mailbox, 0 for timer expiries
+};
+
+// One entry of a batched setpoint update
+struct DutyBatchEntry {
+    int channel;
+    float percentage;
+};
+
+// Consistent view of one channel as last applied by the duty task.
+// Percentages are as the user sees them, i.e. before inversion.
+struct PwmChannelState {
+    float duty;                 // where the output is, or is ramping to
+    float target;               // where it settles once any pulse ends
+    float flow;                 // duty through the calibration curve
+    bool calibrated;
+    uint32_t frequency;
+    uint32_t achieved_hz;
+    uint8_t resolution_bits;
+    uint8_t effective_bits;     // resolution_bits, plus the dithered fraction
+    bool invert;
+    bool ramping;
+    bool pulse_active;
+    int64_t pulse_deadline_us;  // esp_timer clock; 0 without a pulse
+    int64_t last_retune_us;
+    int64_t last_retune_gap_us;
+    uint32_t applied_seq;       // last command applied to this channel
+    bool program_active;
+    uint8_t program_step;
+    uint8_t program_steps;
+    uint16_t program_pass;
+    int32_t program_max_late_us;  // worst step start delay so far
+};
+
+// CPU use of the dither timer
+struct DitherStats {
+    uint32_t period_us;         // current tick period
+    uint32_t ticks;
+    uint32_t cpu_permille;      // share of one core over the last second
+    uint32_t max_tick_us;
+    uint32_t backoffs;          // times the period was doubled to stay in budget
+};
+
+// How far timed pulses landed from where they were asked for, in
+// microseconds. A start is late by the time from the request being accepted
+// to its duty being written; an end by the time from the pulse's deadline to
+// the revert being written, which is also how much longer than asked the
+// pulse ran.
+struct PulseJitterStats {
+    uint32_t starts;
+    uint32_t start_late_avg_us;
+    uint32_t start_late_max_us;
+    uint32_t ends;
+    uint32_t end_late_avg_us;
+    uint32_t end_late_max_us;
+};
+
+// Lateness of one kind of pulse edge. Only the duty task records; it keeps
+// the running sum and publishes the mean for other tasks to read.
+class EdgeLateness {
+public:
+    void record(int64_t late_us) {
+        uint32_t us = late_us < 0 ? 0 : late_us > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(late_us);
+        total_us += us;
+        uint32_t n = count.load(std::memory_order_relaxed) + 1;
+        mean_us.store(static_cast<uint32_t>(total_us / n), std::memory_order_relaxed);
+        if (us > max_us.load(std::memory_order_relaxed)) {
+            max_us.store(us, std::memory_order_relaxed);
+        }
+        count.store(n, std::memory_order_relaxed);
+    }
+
+    uint32_t samples() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    uint32_t meanMicros() const {
+        return mean_us.load(std::memory_order_relaxed);
+    }
+
+    uint32_t maxMicros() const {
+        return max_us.load(std::memory_order_relaxed);
+    }
+
+private:
+    uint64_t total_us = 0;
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> mean_us{0};
+    std::atomic<uint32_t> max_us{0};
+};
+
+class PWMControl;
+
+// Hardware and scheduling state of one output. Everything except the
+// mailbox is owned by the duty task.
+struct PwmChannel {
+    PWMControl* owner = nullptr;
+    uint8_t index = 0;
+    int gpio_num = GPIO_NUM_NC;
+    ledc_channel_t ledc_channel = LEDC_CHANNEL_0;
+    ledc_timer_t timer = LEDC_TIMER_0;
+    uint32_t frequency = default_frequency;
+    LedcTiming timing{};
+    ledc_timer_bit_t resolution_bits = LEDC_TIMER_1_BIT;
+    bool invert = false;
+    int duty = 0;
+    uint8_t duty_frac = 0;      // fraction of a step above `duty`, in 1/256
+    uint32_t applied_seq = 0;
+    int64_t last_retune_us = 0;
+    int64_t last_retune_gap_us = 0;
+
+    // Latest-wins slot for persistent setpoints, guarded by mailbox_lock
+    DutyCycleCommand mailbox{};
+    bool mailbox_full = false;
+
+    // Timed pulse state
+    esp_timer_handle_t pulse_timer = nullptr;
+    bool pulse_active = false;
+    int pulse_base_duty = 0;
+    uint8_t pulse_base_frac = 0;
+    int64_t pulse_deadline_us = 0;
+    int64_t pulse_deadline_wall_us = 0;
+    uint32_t pulse_ramp_ms = 0;
+    RampShape pulse_shape = RampShape::Linear;
+    std::atomic<uint32_t> pulse_id{0};
+
+    // Program state
+    esp_timer_handle_t program_timer = nullptr;
+    PwmProgram program{};
+    bool program_active = false;
+    uint8_t program_step = 0;
+    uint16_t program_pass = 0;
+    uint8_t loop_remaining[program_max_steps] = {};
+    int64_t step_deadline_us = 0;   // when the current step ends
+    int32_t program_max_late_us = 0;
+    std::atomic<uint32_t> program_id{0};
+
+    // Latest uploaded program waiting for the duty task, guarded by mailbox_lock
+    PwmProgram program_upload{};
+    bool program_upload_full = false;
+
+    // Calibration tables, owned by the duty task
+    CalibrationTable calibration;
+
+    // Latest accepted curve, guarded by mailbox_lock
+    CalibrationCurve calibration_curve{};
+
+    // Hardware fade state
+    int64_t fade_end_us = 0;
+
+    // Dither target as handed to the dither timer, guarded by dither_lock
+    bool dither_active = false;
+    uint32_t dither_fine = 0;           // duty << DITHER_FRAC_BITS | duty_frac
+    uint32_t dither_error = 0;          // sigma-delta accumulator
+    int64_t dither_hold_until_us = 0;   // no dithering while a fade runs
+
+    // Published to other tasks
+    SeqLock<PwmChannelState> state;
+
+    int maxDuty() const {
+        return (1 << resolution_bits) - 1;
+    }
 };
 
-class PWMControl {
+class PWMControl : public SettingsObserver {
 public:
-    PWMControl(SettingsManager &settings,
-               int gpio_num = GPIO_NUM_2,
-               ledc_timer_bit_t resolution_bits = LEDC_TIMER_13_BIT)
-        : settings(settings),
-		  gpio_num(gpio_num),
-          frequency(static_cast<uint32_t>(settings.frequency)),
-          resolution_bits(resolution_bits),
-          duty(settings.duty),
-          last_frequency(frequency),
-          last_duty(duty) {
+    // After a warm reset the outputs come back from the RTC mirror, pulse
+    // included; otherwise from the saved settings.
+    PWMControl(SettingsManager &settings)
+        : settings(settings) {
+        applied_events = xEventGroupCreateStatic(&applied_events_buffer);
 
-        if (!initializeLEDC()) {
-            ESP_LOGE("PWMControl", "LEDC initialization failed.");
+        bool warm = RtcMirror::warmStateValid();
+        for (int i = 0; i < pwm_channel_count; ++i) {
+            PwmChannel& ch = channels[i];
+            ch.owner = this;
+            ch.index = static_cast<uint8_t>(i);
+            ch.gpio_num = pwm_channel_gpios[i];
+            ch.ledc_channel = static_cast<ledc_channel_t>(LEDC_CHANNEL_0 + i);
+            ch.timer = static_cast<ledc_timer_t>(LEDC_TIMER_0 + i);
+            if (settings.loadCalibration(i, ch.calibration_curve)) {
+                ch.calibration.build(ch.calibration_curve);
+            }
+            if (warm) {
+                restoreFromRtc(ch);
+            } else {
+                ch.invert = settings.channels[i].invert;
+                ch.frequency = validFrequency(settings.channels[i].frequency);
+                ch.timing = ledcSelectTiming(ch.frequency, sharedClock());
+                ch.resolution_bits = static_cast<ledc_timer_bit_t>(ch.timing.resolution_bits);
+                ch.duty = percentageToDuty(ch, settings.channels[i].duty, DutyUnit::Percent, ch.duty_frac);
+            }
+
+            if (!initializeLEDC(ch)) {
+                ESP_LOGE("PWMControl", "LEDC initialization failed for channel %d.", i);
+            }
         }
+        alignTimers();
 
+        // The snapshots are written here only while nothing else can write
+        // them; once the task runs and the restored pulse timers are armed,
+        // the duty task is their single writer
+        for (PwmChannel& ch : channels) {
+            publish(ch);
+        }
         initializeQueueAndTask();
-        setDutyCyclePercentage(duty, 0);  // Start with initial duty cycle
+        settings.addObserver(this);
+        for (PwmChannel& ch : channels) {
+            armDither(ch);   // publish ran before the dither timer existed
+            if (ch.pulse_active) {
+                int64_t remaining = ch.pulse_deadline_us - esp_timer_get_time();
+                esp_timer_start_once(ch.pulse_timer, remaining > 0 ? static_cast<uint64_t>(remaining) : 1);
+            }
+        }
+        if (warm) {
+            ESP_LOGI("PWMControl", "Outputs restored from RTC state after warm reset.");
+        }
+
+        for (int i = 0; i < pwm_channel_count; ++i) {
+            PwmProgram program;
+            if (settings.loadProgram(i, program)) {
+                ESP_LOGI("PWMControl", "Starting stored program on channel %d", i);
+                startProgram(i, program);
+            }
+        }
     }
 
-    float getCurrentPercentage() const {
-        int max_duty = (1 << resolution_bits) - 1;
-        float percentage = (static_cast<float>(duty) / max_duty) * 100.0f;
-        return std::round(percentage * 10.0f) / 10.0f;
+    static constexpr int channelCount() {
+        return pwm_channel_count;
     }
 
-    void setDutyCyclePercentage(float percentage, int period = 0) {
-        if (percentage < 0.0f) percentage = 0.0f;
-        if (percentage > 100.0f) percentage = 100.0f;
+    static EventBits_t appliedBit(int channel) {
+        static_assert(pwm_channel_count <= 8, "one event bit per channel");
+        return static_cast<EventBits_t>(1) << channel;
+    }
 
-		if (settings.invert) {
-			percentage = 100.0f - percentage;
-		}
-        int max_duty = (1 << resolution_bits) - 1;
-        int newDuty = static_cast<int>((percentage / 100.0f) * max_duty);
+    static bool validChannel(int channel) {
+        return channel >= 0 && channel < pwm_channel_count;
+    }
 
-        DutyCycleCommand command = {newDuty, period};
-        if (xQueueSend(duty_cycle_queue, &command, portMAX_DELAY) != pdPASS) {
-            ESP_LOGE("PWMControl", "Failed to send duty cycle command.");
+    // Lock-free snapshot of what the duty task last applied; all zero for
+    // a channel that does not exist
+    PwmChannelState getState(int channel = 0) const {
+        if (!validChannel(channel)) {
+            return PwmChannelState{};
         }
+        return channels[channel].state.read();
     }
 
-    void setFrequency(int newFrequency) {
-        if (newFrequency <= 0) {
-            ESP_LOGE("PWMControl", "Invalid frequency, setting to 5000");
-            newFrequency = 5000;
+    // Waits (bounded) until the duty task has applied command `seq` on the
+    // channel and returns the state it left behind. The duty task sets the
+    // channel's event bit on every publish, so this wakes as soon as the
+    // command lands rather than on a tick. Another waiter on the channel can
+    // clear the bit in between, so the wait goes in one-tick slices.
+    PwmChannelState waitApplied(int channel, uint32_t seq) const {
+        if (!validChannel(channel)) {
+            return PwmChannelState{};
         }
+        const EventBits_t bit = appliedBit(channel);
+        PwmChannelState state = getState(channel);
+        TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(APPLY_WAIT_MS);
+        while (static_cast<int32_t>(state.applied_seq - seq) < 0
+               && static_cast<int32_t>(deadline - xTaskGetTickCount()) > 0) {
+            // Cleared before the state is read again, so a publish in
+            // between leaves the bit set
+            xEventGroupClearBits(applied_events, bit);
+            state = getState(channel);
+            if (static_cast<int32_t>(state.applied_seq - seq) >= 0) {
+                break;
+            }
+            xEventGroupWaitBits(applied_events, bit, pdFALSE, pdFALSE, 1);
+            state = getState(channel);
+        }
+        return state;
+    }
 
-        frequency = static_cast<uint32_t>(newFrequency);
-        last_frequency = newFrequency;
+    float getCurrentPercentage(int channel = 0) const {
+        return std::round(getState(channel).duty * 10.0f) / 10.0f;
+    }
 
-        int currentDuty = duty;  // Save the current duty cycle
+    // Persistent setpoints go to a latest-wins mailbox and never block; timed
+    // pulses are queued with a bounded wait. Returns the command's sequence
+    // number, or 0 if the queue stayed full so callers can push back.
+    uint32_t setDutyCyclePercentage(int channel, float percentage, int period = 0,
+                                    uint32_t ramp_ms = 0, RampShape shape = RampShape::Linear,
+                                    DutyUnit unit = DutyUnit::Percent) {
+        if (!validChannel(channel)) {
+            ESP_LOGE("PWMControl", "Invalid channel %d", channel);
+            return 0;
+        }
+        PwmChannel& ch = channels[channel];
 
-        if (!initializeLEDC()) {
-            ESP_LOGE("PWMControl", "LEDC reinitialization failed.");
-            return;
+        if (period <= 0) {
+            taskENTER_CRITICAL(&mailbox_lock);
+            uint32_t seq = nextSeq();
+            postSetpoint(ch, percentage, ramp_ms, shape, unit, seq);
+            taskEXIT_CRITICAL(&mailbox_lock);
+            xTaskNotifyGive(duty_task);
+            return seq;
         }
 
-        setDutyCycle(currentDuty);  // Reapply duty cycle
+        DutyCycleCommand command{};
+        command.percentage = percentage;
+        command.period = period;
+        command.ramp_ms = ramp_ms;
+        command.shape = shape;
+        command.unit = unit;
+        command.kind = DutyCommandKind::Pulse;
+        command.channel = ch.index;
+        return enqueue(command);
+    }
+
+    // Posts persistent setpoints for several channels at once. They share one
+    // sequence number, so the duty task picks them up together and latches
+    // them back to back, landing in the same PWM period on channels that run
+    // at the same frequency.
+    uint32_t setBatch(const DutyBatchEntry* entries, size_t count) {
+        if (count > static_cast<size_t>(pwm_channel_count)) {
+            ESP_LOGE("PWMControl", "Batch of %u exceeds %d channels", static_cast<unsigned>(count), pwm_channel_count);
+            return 0;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (!validChannel(entries[i].channel)) {
+                ESP_LOGE("PWMControl", "Invalid channel %d in batch", entries[i].channel);
+                return 0;
+            }
+        }
+
+        taskENTER_CRITICAL(&mailbox_lock);
+        uint32_t seq = nextSeq();
+        for (size_t i = 0; i < count; ++i) {
+            postSetpoint(channels[entries[i].channel], entries[i].percentage, 0, RampShape::Linear,
+                         DutyUnit::Percent, seq);
+        }
+        taskEXIT_CRITICAL(&mailbox_lock);
+        xTaskNotifyGive(duty_task);
+        return seq;
+    }
+
+    // Queues a frequency change; 0 if the frequency cannot be produced or
+    // the queue is full.
+    uint32_t setFrequency(int channel, int newFrequency) {
+        if (!validChannel(channel) || !frequencySupported(newFrequency)) {
+            ESP_LOGE("PWMControl", "Frequency %d Hz is out of range for channel %d.", newFrequency, channel);
+            return 0;
+        }
+        DutyCycleCommand command{};
+        command.frequency = static_cast<uint32_t>(newFrequency);
+        command.kind = DutyCommandKind::Retune;
+        command.channel = static_cast<uint8_t>(channel);
+        return enqueue(command);
+    }
+
+    // Whether some LEDC clock reaches `frequency` with the timers shared as
+    // they are
+    static bool frequencySupported(int frequency) {
+        return frequency > 0 && ledcSelectTiming(static_cast<uint32_t>(frequency), sharedClock()).clock != nullptr;
+    }
+
+    uint32_t setInvert(int channel, bool invert) {
+        if (!validChannel(channel)) {
+            ESP_LOGE("PWMControl", "Invalid channel %d", channel);
+            return 0;
+        }
+        DutyCycleCommand command{};
+        command.invert = invert;
+        command.kind = DutyCommandKind::Invert;
+        command.channel = static_cast<uint8_t>(channel);
+        return enqueue(command);
+    }
+
+    // Runs `program` on the channel from its first step, replacing any
+    // program, pulse or ramp already there. Any later Set or pulse on the
+    // channel stops the program.
+    uint32_t startProgram(int channel, const PwmProgram& program) {
+        const char* problem = validateProgram(program);
+        if (!validChannel(channel) || problem != nullptr) {
+            ESP_LOGE("PWMControl", "Program rejected: %s", problem ? problem : "invalid channel");
+            return 0;
+        }
+        PwmChannel& ch = channels[channel];
+        taskENTER_CRITICAL(&mailbox_lock);
+        ch.program_upload = program;
+        ch.program_upload_full = true;
+        taskEXIT_CRITICAL(&mailbox_lock);
+
+        DutyCycleCommand command{};
+        command.kind = DutyCommandKind::ProgramStart;
+        command.channel = ch.index;
+        return enqueue(command);
+    }
+
+    // Stops the program, leaving the output where the program had it
+    uint32_t stopProgram(int channel) {
+        if (!validChannel(channel)) {
+            ESP_LOGE("PWMControl", "Invalid channel %d", channel);
+            return 0;
+        }
+        DutyCycleCommand command{};
+        command.kind = DutyCommandKind::ProgramStop;
+        command.channel = static_cast<uint8_t>(channel);
+        return enqueue(command);
+    }
+
+    // Replaces the channel's calibration curve; an empty curve makes flow
+    // the same as drive again. The output stays at its drive duty, only the
+    // flow it reads back as changes.
+    uint32_t setCalibration(int channel, const CalibrationCurve& curve) {
+        const char* problem = validateCalibration(curve);
+        if (!validChannel(channel) || problem != nullptr) {
+            ESP_LOGE("PWMControl", "Calibration rejected: %s", problem ? problem : "invalid channel");
+            return 0;
+        }
+        PwmChannel& ch = channels[channel];
+        taskENTER_CRITICAL(&mailbox_lock);
+        ch.calibration_curve = curve;
+        taskEXIT_CRITICAL(&mailbox_lock);
+
+        DutyCycleCommand command{};
+        command.kind = DutyCommandKind::Calibrate;
+        command.channel = ch.index;
+        return enqueue(command);
+    }
+
+    CalibrationCurve getCalibration(int channel) {
+        if (!validChannel(channel)) {
+            return CalibrationCurve{};
+        }
+        taskENTER_CRITICAL(&mailbox_lock);
+        CalibrationCurve curve = channels[channel].calibration_curve;
+        taskEXIT_CRITICAL(&mailbox_lock);
+        return curve;
+    }
+
+    // Dither timer cost, zero unless CONFIG_PWM_DITHER
+    DitherStats getDitherStats() const {
+        DitherStats stats;
+        stats.period_us = dither_period_us.load();
+        stats.ticks = dither_ticks.load();
+        stats.cpu_permille = dither_cpu_permille.load();
+        stats.max_tick_us = dither_max_tick_us.load();
+        stats.backoffs = dither_backoffs.load();
+        return stats;
+    }
+
+    PulseJitterStats getPulseJitter() const {
+        PulseJitterStats stats;
+        stats.starts = pulse_start_late.samples();
+        stats.start_late_avg_us = pulse_start_late.meanMicros();
+        stats.start_late_max_us = pulse_start_late.maxMicros();
+        stats.ends = pulse_end_late.samples();
+        stats.end_late_avg_us = pulse_end_late.meanMicros();
+        stats.end_late_max_us = pulse_end_late.maxMicros();
+        return stats;
+    }
+
+    // Number of setpoints overwritten in the mailbox before being applied
+    uint32_t getCoalescedCount() const {
+        return mailbox_coalesced.load(std::memory_order_relaxed);
+    }
+
+    // Commands waiting for the duty task
+    uint32_t getQueueDepth() const {
+        return duty_cycle_queue ? uxQueueMessagesWaiting(duty_cycle_queue) : 0;
+    }
+
+    // Bumped every time any channel's state is published
+    uint32_t getStateVersion() const {
+        return state_version.load(std::memory_order_acquire);
+    }
+
+    // Frequencies the LEDC cannot produce are refused before anything is
+    // committed
+    const char* checkSetting(const SettingField& field, int channel, const SettingsValues& proposed) override {
+        if (field.id == SettingId::Frequency && !frequencySupported(proposed.channels[channel].frequency)) {
+            return "no LEDC clock reaches that frequency";
+        }
+        return nullptr;
+    }
+
+    // Settings patches reach the outputs through the command queue like any
+    // other request
+    bool settingChanged(const SettingField& field, int channel, const SettingsValues& values) override {
+        const ChannelSettings& saved = values.channels[channel];
+        uint32_t seq = 0;
+        switch (field.id) {
+        case SettingId::Frequency:
+            seq = setFrequency(channel, saved.frequency);
+            break;
+        case SettingId::Duty:
+            seq = setDutyCyclePercentage(channel, saved.duty);
+            break;
+        case SettingId::Invert:
+            seq = setInvert(channel, saved.invert);
+            break;
+        default:
+            return true;
+        }
+        if (seq != 0) {
+            settings_seq[channel].store(seq, std::memory_order_relaxed);
+        }
+        return seq != 0;
+    }
+
+    // Sequence number of the last command a settings change queued on the
+    // channel, for waitApplied
+    uint32_t getSettingsSeq(int channel) const {
+        if (!validChannel(channel)) {
+            return 0;
+        }
+        return settings_seq[channel].load(std::memory_order_relaxed);
+    }
+
+    // Task to notify (xTaskNotifyGive) after each publish. The duty task
+    // never waits on it, so the listener must tolerate coalesced wakeups.
+    void setStateListener(TaskHandle_t task) {
+        state_listener.store(task, std::memory_order_release);
     }
 
 private:
     void initializeQueueAndTask() {
-        duty_cycle_queue = xQueueCreate(QUEUE_SIZE, sizeof(DutyCycleCommand));
-        if (duty_cycle_queue == nullptr) {
-            ESP_LOGE("PWMControl", "Failed to create queue.");
-            return;
+        for (PwmChannel& ch : channels) {
+            esp_timer_create_args_t timer_args{};
+            timer_args.callback = pulseTimerCallback;
+            timer_args.arg = &ch;
+            timer_args.dispatch_method = ESP_TIMER_TASK;
+            timer_args.name = "pwm_pulse";
+            if (esp_timer_create(&timer_args, &ch.pulse_timer) != ESP_OK) {
+                ESP_LOGE("PWMControl", "Failed to create pulse timer.");
+            }
+
+            timer_args.callback = programTimerCallback;
+            timer_args.name = "pwm_program";
+            if (esp_timer_create(&timer_args, &ch.program_timer) != ESP_OK) {
+                ESP_LOGE("PWMControl", "Failed to create program timer.");
+            }
+        }
+
+#if CONFIG_PWM_DITHER
+        dither_lock = xSemaphoreCreateMutexStatic(&dither_lock_buffer);
+        esp_timer_create_args_t dither_args{};
+        dither_args.callback = ditherTimerCallback;
+        dither_args.arg = this;
+        dither_args.dispatch_method = ESP_TIMER_TASK;
+        dither_args.name = "pwm_dither";
+        dither_period_us = CONFIG_PWM_DITHER_PERIOD_US;
+        if (dither_lock == nullptr || esp_timer_create(&dither_args, &dither_timer) != ESP_OK
+            || esp_timer_start_periodic(dither_timer, dither_period_us) != ESP_OK) {
+            ESP_LOGE("PWMControl", "Failed to start dither timer.");
+        }
+#endif
+
+        // Storage for both is part of this object, so neither can fail
+        duty_cycle_queue = xQueueCreateStatic(QUEUE_SIZE, sizeof(DutyCycleCommand), queue_storage, &queue_buffer);
+        duty_task = xTaskCreateStaticPinnedToCore(dutyCycleTask, "DutyCycleTask", duty_task_stack, this,
+                                                  duty_task_priority, duty_stack, &duty_task_buffer,
+                                                  control_task_core);
+    }
+
+    // Caller holds mailbox_lock. Zero is kept free to mean "rejected".
+    uint32_t nextSeq() {
+        if (next_seq == 0) {
+            ++next_seq;
         }
+        return next_seq++;
+    }
 
-        BaseType_t result = xTaskCreate(dutyCycleTask, "DutyCycleTask", 2048, this, 5, nullptr);
-        if (result != pdPASS) {
-            ESP_LOGE("PWMControl", "Failed to create task.");
+    uint32_t enqueue(DutyCycleCommand& command) {
+        taskENTER_CRITICAL(&mailbox_lock);
+        command.seq = nextSeq();
+        taskEXIT_CRITICAL(&mailbox_lock);
+        command.enqueued_us = esp_timer_get_time();
+        if (xQueueSend(duty_cycle_queue, &command, pdMS_TO_TICKS(ENQUEUE_TIMEOUT_MS)) != pdPASS) {
+            ESP_LOGW("PWMControl", "Duty cycle queue full, rejecting command.");
+            Metrics::recordQueueFull();
+            return 0;
         }
+        Metrics::recordQueueDepth(uxQueueMessagesWaiting(duty_cycle_queue));
+        xTaskNotifyGive(duty_task);
+        return command.seq;
     }
 
+    // Caller holds mailbox_lock
+    void postSetpoint(PwmChannel& ch, float percentage, uint32_t ramp_ms, RampShape shape, DutyUnit unit,
+                      uint32_t seq) {
+        ch.mailbox = {};
+        ch.mailbox.percentage = percentage;
+        ch.mailbox.ramp_ms = ramp_ms;
+        ch.mailbox.shape = shape;
+        ch.mailbox.unit = unit;
+        ch.mailbox.kind = DutyCommandKind::Set;
+        ch.mailbox.channel = ch.index;
+        ch.mailbox.enqueued_us = esp_timer_get_time();
+        ch.mailbox.seq = seq;
+        if (ch.mailbox_full) {
+            mailbox_coalesced.fetch_add(1, std::memory_order_relaxed);
+        }
+        ch.mailbox_full = true;
+    }
 
 	static void dutyCycleTask(void* pvParameter) {
 		PWMControl* pwm = static_cast<PWMControl*>(pvParameter);
 		DutyCycleCommand command;
 
 		for (;;) {
-			if (xQueueReceive(pwm->duty_cycle_queue, &command, portMAX_DELAY)) {
-				ESP_LOGI("PWMControl", "Received duty: %d, period: %d", command.duty, command.period);
-
-				if (command.period == 0) {
-					// If period is 0, just set the duty cycle
-					pwm->setDutyCycle(command.duty);
-				} else {
-					int previousDuty = pwm->duty;
-					pwm->setDutyCycle(command.duty);
-					// Wait for the specified period (in milliseconds)
-					vTaskDelay(pdMS_TO_TICKS(command.period));
-					pwm->setDutyCycle(previousDuty);
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			while (xQueueReceive(pwm->duty_cycle_queue, &command, 0) == pdPASS) {
+				if (command.seq != 0) {
+					pwm->applyMailboxes(true, command.seq);
 				}
+				pwm->applyLogged(command);
+			}
+			pwm->applyMailboxes(false, 0);
+		}
+	}
+
+	// Applies pending mailbox setpoints; when `ordered`, only those submitted
+	// before `seq`, so setpoints and queued pulses keep their order. Step
+	// changes are written to every channel first and latched afterwards so a
+	// batch takes effect together.
+	void applyMailboxes(bool ordered, uint32_t seq) {
+		DutyCycleCommand pending[pwm_channel_count];
+		int count = 0;
+		taskENTER_CRITICAL(&mailbox_lock);
+		for (PwmChannel& ch : channels) {
+			if (ch.mailbox_full && (!ordered || static_cast<int32_t>(ch.mailbox.seq - seq) < 0)) {
+				pending[count++] = ch.mailbox;
+				ch.mailbox_full = false;
+			}
+		}
+		taskEXIT_CRITICAL(&mailbox_lock);
+
+		for (int i = 0; i < count; ++i) {
+			PwmChannel& ch = channels[pending[i].channel];
+			uint8_t frac = 0;
+			int newDuty = percentageToDuty(ch, pending[i].percentage, pending[i].unit, frac);
+			ESP_LOGI("PWMControl", "Received duty: %d on channel %d", newDuty, ch.index);
+			cancelPulse(ch);
+			cancelProgram(ch);
+			if (pending[i].ramp_ms > 0) {
+				transitionTo(ch, newDuty, pending[i].ramp_ms, pending[i].shape, frac);
+			} else {
+				stopFade(ch);
+				writeDuty(ch, newDuty);
+				ch.duty_frac = frac;
+			}
+		}
+		for (int i = 0; i < count; ++i) {
+			if (pending[i].ramp_ms == 0) {
+				latchDuty(channels[pending[i].channel]);
+			}
+		}
+		for (int i = 0; i < count; ++i) {
+			PwmChannel& ch = channels[pending[i].channel];
+			ch.applied_seq = pending[i].seq;
+			publish(ch);
+			Metrics::recordCommand(pending[i].enqueued_us);
+		}
+	}
+
+	void applyLogged(const DutyCycleCommand& command) {
+		ESP_LOGI("PWMControl", "Received %.1f%%, period: %d on channel %d",
+				 command.percentage, command.period, command.channel);
+		applyCommand(command);
+		Metrics::recordCommand(command.enqueued_us);
+		ESP_LOGD("PWMControl", "Applied after %lld us",
+				 static_cast<long long>(esp_timer_get_time() - command.enqueued_us));
+	}
+
+	// Pulse policy: a new pulse while one is active replaces its duty and
+	// deadline but keeps the original pre-pulse duty as the revert target; a
+	// persistent Set cancels the active pulse and takes effect immediately.
+	// Any command retargets a fade that is still running from wherever the
+	// output has got to. A pulse reverts with the same ramp it started with.
+	// Set and Pulse both stop a running program.
+	void applyCommand(const DutyCycleCommand& command) {
+		PwmChannel& ch = channels[command.channel];
+		switch (command.kind) {
+		case DutyCommandKind::Set: {
+			cancelPulse(ch);
+			cancelProgram(ch);
+			uint8_t frac = 0;
+			int newDuty = percentageToDuty(ch, command.percentage, command.unit, frac);
+			transitionTo(ch, newDuty, command.ramp_ms, command.shape, frac);
+			break;
+		}
+
+		case DutyCommandKind::Pulse: {
+			cancelProgram(ch);
+			if (!ch.pulse_active) {
+				ch.pulse_base_duty = ch.duty;
+				ch.pulse_base_frac = ch.duty_frac;
+				ch.pulse_active = true;
+			}
+			esp_timer_stop(ch.pulse_timer);
+			++ch.pulse_id;
+			ch.pulse_ramp_ms = command.ramp_ms;
+			ch.pulse_shape = command.shape;
+			uint8_t frac = 0;
+			int newDuty = percentageToDuty(ch, command.percentage, command.unit, frac);
+			transitionTo(ch, newDuty, command.ramp_ms, command.shape, frac);
+			recordPulseStart(command.enqueued_us);
+			ch.pulse_deadline_us = esp_timer_get_time() + static_cast<int64_t>(command.period) * 1000;
+			ch.pulse_deadline_wall_us = RtcMirror::wallClockMicros() + static_cast<int64_t>(command.period) * 1000;
+			if (esp_timer_start_once(ch.pulse_timer, static_cast<uint64_t>(command.period) * 1000) != ESP_OK) {
+				ESP_LOGE("PWMControl", "Failed to arm pulse timer, reverting now.");
+				cancelPulse(ch);
+				transitionTo(ch, ch.pulse_base_duty, 0, RampShape::Linear, ch.pulse_base_frac);
+			}
+			break;
+		}
+
+		case DutyCommandKind::PulseExpired:
+			// A stale expiry (the pulse was replaced or cancelled after the
+			// timer fired) carries an old id and is ignored.
+			if (ch.pulse_active && command.timer_id == ch.pulse_id) {
+				ch.pulse_active = false;
+				transitionTo(ch, ch.pulse_base_duty, ch.pulse_ramp_ms, ch.pulse_shape, ch.pulse_base_frac);
+				recordPulseEnd(ch.pulse_deadline_us);
+			}
+			break;
+
+		case DutyCommandKind::Retune:
+			retune(ch, command.frequency);
+			break;
+
+		case DutyCommandKind::Invert:
+			// Mirror the raw duties so every output keeps its meaning
+			if (ch.invert != command.invert) {
+				ch.invert = command.invert;
+				uint32_t full = static_cast<uint32_t>(ch.maxDuty()) << DITHER_FRAC_BITS;
+				if (ch.pulse_active) {
+					uint32_t base = full - fineDuty(ch.pulse_base_duty, ch.pulse_base_frac);
+					ch.pulse_base_duty = static_cast<int>(base >> DITHER_FRAC_BITS);
+					ch.pulse_base_frac = static_cast<uint8_t>(base & DITHER_FRAC_MASK);
+				}
+				uint32_t mirrored = full - fineDuty(ch.duty, ch.duty_frac);
+				transitionTo(ch, static_cast<int>(mirrored >> DITHER_FRAC_BITS), 0, RampShape::Linear,
+							 static_cast<uint8_t>(mirrored & DITHER_FRAC_MASK));
+			}
+			break;
+
+		case DutyCommandKind::ProgramStart:
+			beginProgram(ch);
+			break;
+
+		case DutyCommandKind::ProgramStop:
+			cancelProgram(ch);
+			break;
+
+		case DutyCommandKind::ProgramStep:
+			if (ch.program_active && command.timer_id == ch.program_id) {
+				advanceProgram(ch);
+			}
+			break;
+
+		case DutyCommandKind::Calibrate: {
+			taskENTER_CRITICAL(&mailbox_lock);
+			CalibrationCurve curve = ch.calibration_curve;
+			taskEXIT_CRITICAL(&mailbox_lock);
+			ch.calibration.build(curve);
+			break;
+		}
+		}
+		if (command.seq != 0) {
+			ch.applied_seq = command.seq;
+		}
+		publish(ch);
+	}
+
+	// Pulse edges are measured once their duty has been written
+	void recordPulseStart(int64_t requested_us) {
+		int64_t late = esp_timer_get_time() - requested_us;
+		pulse_start_late.record(late);
+		Metrics::recordPulseStart(late);
+	}
+
+	void recordPulseEnd(int64_t deadline_us) {
+		int64_t late = esp_timer_get_time() - deadline_us;
+		pulse_end_late.record(late);
+		Metrics::recordPulseEnd(late);
+	}
+
+	void beginProgram(PwmChannel& ch) {
+		taskENTER_CRITICAL(&mailbox_lock);
+		bool uploaded = ch.program_upload_full;
+		if (uploaded) {
+			ch.program = ch.program_upload;
+			ch.program_upload_full = false;
+		}
+		taskEXIT_CRITICAL(&mailbox_lock);
+		if (!uploaded) {
+			return;  // a later upload already took it
+		}
+
+		cancelPulse(ch);
+		cancelProgram(ch);
+		for (int i = 0; i < ch.program.step_count; ++i) {
+			ch.loop_remaining[i] = ch.program.steps[i].loop_count;
+		}
+		ch.program_active = true;
+		ch.program_step = 0;
+		ch.program_pass = 0;
+		ch.program_max_late_us = 0;
+		ch.step_deadline_us = esp_timer_get_time();
+		enterStep(ch);
+	}
+
+	// Steps are scheduled from the previous deadline rather than from when
+	// the timer was serviced, so timer and queue latency never accumulate.
+	void enterStep(PwmChannel& ch) {
+		const ProgramStep& step = ch.program.steps[ch.program_step];
+		uint8_t frac = 0;
+		int newDuty = percentageToDuty(ch, step.duty_centi / 100.0f, DutyUnit::Percent, frac);
+		transitionTo(ch, newDuty, step.ramp_ms, RampShape::Linear, frac);
+		ch.step_deadline_us += static_cast<int64_t>(step.hold_ms) * 1000;
+		int64_t remaining = ch.step_deadline_us - esp_timer_get_time();
+		if (esp_timer_start_once(ch.program_timer, remaining > 0 ? static_cast<uint64_t>(remaining) : 1) != ESP_OK) {
+			ESP_LOGE("PWMControl", "Failed to arm program timer, stopping program.");
+			cancelProgram(ch);
+		}
+	}
+
+	void advanceProgram(PwmChannel& ch) {
+		int32_t late = static_cast<int32_t>(esp_timer_get_time() - ch.step_deadline_us);
+		if (late > ch.program_max_late_us) {
+			ch.program_max_late_us = late;
+		}
+
+		const ProgramStep& step = ch.program.steps[ch.program_step];
+		int next = ch.program_step + 1;
+		if (step.loop_count > 0) {
+			if (ch.loop_remaining[ch.program_step] > 0) {
+				--ch.loop_remaining[ch.program_step];
+				next = step.loop_to;
+			} else {
+				// Re-arm, so an enclosing loop runs this one in full again
+				ch.loop_remaining[ch.program_step] = step.loop_count;
+			}
+		}
+		if (next >= ch.program.step_count) {
+			++ch.program_pass;
+			if (ch.program.repeat != 0 && ch.program_pass >= ch.program.repeat) {
+				ESP_LOGI("PWMControl", "Program on channel %d finished", ch.index);
+				ch.program_active = false;
+				return;
 			}
+			next = 0;
+		}
+		ch.program_step = static_cast<uint8_t>(next);
+		enterStep(ch);
+	}
+
+	void cancelProgram(PwmChannel& ch) {
+		if (ch.program_active) {
+			esp_timer_stop(ch.program_timer);
+			ch.program_active = false;
+			++ch.program_id;
+		}
+	}
+
+    // Retunes the timer in place with ledc_set_freq, which leaves the duty
+    // register alone so the output never drops. That is done whenever the
+    // current clock can still reach the new frequency at the current
+    // resolution, even if another setting would give more bits. Only when it
+    // cannot is LEDC reconfigured, and the duty rescaled so the output
+    // percentage is kept.
+    void retune(PwmChannel& ch, uint32_t requested) {
+        int64_t start = esp_timer_get_time();
+        LedcTiming newTiming = ledcSelectTiming(requested, sharedClock());
+        if (newTiming.clock == nullptr) {
+            ESP_LOGE("PWMControl", "Frequency %lu Hz is out of range.", static_cast<unsigned long>(requested));
+            return;
+        }
+
+        ch.frequency = requested;
+
+        if (ch.timing.clock != nullptr &&
+            ledcResolutionFits(ch.timing.clock->hz, requested, ch.timing.resolution_bits)) {
+            esp_err_t err = ledc_set_freq(LEDC_LOW_SPEED_MODE, ch.timer, ch.frequency);
+            if (err == ESP_OK) {
+                ch.timing.achieved_hz =
+                    ledcAchievedFrequency(ch.timing.clock->hz, requested, ch.timing.resolution_bits);
+                ch.last_retune_us = esp_timer_get_time() - start;
+                ch.last_retune_gap_us = 0;
+                ESP_LOGI("PWMControl", "Channel %d retuned to %lu Hz in %lld us", ch.index,
+                         static_cast<unsigned long>(ch.frequency), static_cast<long long>(ch.last_retune_us));
+                return;
+            }
+            ESP_LOGW("PWMControl", "ledc_set_freq failed (%s), reconfiguring.", esp_err_to_name(err));
+            Metrics::recordLedcError();
+        }
+
+        uint8_t currentFrac = 0;
+        int currentDuty = rescaleFine(ch.duty, ch.duty_frac, ch.resolution_bits, newTiming.resolution_bits, currentFrac);
+        if (ch.pulse_active) {
+            ch.pulse_base_duty = rescaleFine(ch.pulse_base_duty, ch.pulse_base_frac, ch.resolution_bits,
+                                             newTiming.resolution_bits, ch.pulse_base_frac);
+        }
+        ch.timing = newTiming;
+        ch.resolution_bits = static_cast<ledc_timer_bit_t>(newTiming.resolution_bits);
+        ch.duty = currentDuty;
+        ch.duty_frac = currentFrac;
+        ESP_LOGI("PWMControl", "Reconfiguring channel %d for %lu Hz at %d bits from %s", ch.index,
+                 static_cast<unsigned long>(ch.frequency), ch.resolution_bits, ch.timing.clock->name);
+
+        stopFade(ch);
+        holdDither(ch);
+        int64_t gap_start = esp_timer_get_time();
+        if (!initializeLEDC(ch)) {
+            ESP_LOGE("PWMControl", "LEDC reinitialization failed.");
+            return;
+        }
+
+        setDutyCycle(ch, currentDuty);  // Reapply duty cycle
+        int64_t end = esp_timer_get_time();
+        ch.last_retune_us = end - start;
+        ch.last_retune_gap_us = end - gap_start;
+    }
+
+	void cancelPulse(PwmChannel& ch) {
+		if (ch.pulse_active) {
+			esp_timer_stop(ch.pulse_timer);
+			ch.pulse_active = false;
+			++ch.pulse_id;
 		}
 	}
 
-    bool initializeLEDC() {
-        if (frequency == 0) {
-            ESP_LOGE("PWMControl", "Invalid frequency (0), setting to %d", default_frequency);
-            frequency = default_frequency;
+	// Timer callbacks run in the esp_timer task; they must not block, so the
+	// expiry goes to the front of the queue and is retried shortly if the
+	// queue is full.
+	static void postExpiry(PwmChannel* ch, DutyCommandKind kind, uint32_t id, esp_timer_handle_t timer) {
+		PWMControl* pwm = ch->owner;
+		DutyCycleCommand command{};
+		command.kind = kind;
+		command.channel = ch->index;
+		command.timer_id = id;
+		command.enqueued_us = esp_timer_get_time();
+		if (xQueueSendToFront(pwm->duty_cycle_queue, &command, 0) != pdPASS) {
+			ESP_LOGW("PWMControl", "Queue full at timer expiry, retrying.");
+			Metrics::recordQueueFull();
+			esp_timer_start_once(timer, 1000);
+			return;
+		}
+		Metrics::recordQueueDepth(uxQueueMessagesWaiting(pwm->duty_cycle_queue));
+		xTaskNotifyGive(pwm->duty_task);
+	}
+
+	static void pulseTimerCallback(void* arg) {
+		PwmChannel* ch = static_cast<PwmChannel*>(arg);
+		postExpiry(ch, DutyCommandKind::PulseExpired, ch->pulse_id.load(), ch->pulse_timer);
+	}
+
+	static void programTimerCallback(void* arg) {
+		PwmChannel* ch = static_cast<PwmChannel*>(arg);
+		postExpiry(ch, DutyCommandKind::ProgramStep, ch->program_id.load(), ch->program_timer);
+	}
+
+    void restoreFromRtc(PwmChannel& ch) {
+        const RtcChannelState& saved = RtcMirror::channel(ch.index);
+        ch.frequency = validFrequency(static_cast<int>(saved.frequency));
+        ch.timing = ledcSelectTiming(ch.frequency, sharedClock());
+        ch.resolution_bits = static_cast<ledc_timer_bit_t>(ch.timing.resolution_bits);
+        ch.duty = rescaleDuty(saved.duty, saved.resolution_bits, ch.resolution_bits);
+        int baseDuty = ch.duty;
+
+        if (saved.pulse_deadline_us != 0) {
+            baseDuty = rescaleDuty(saved.pulse_base_duty, saved.resolution_bits, ch.resolution_bits);
+            int64_t remaining = saved.pulse_deadline_us - RtcMirror::wallClockMicros();
+            if (remaining > 0) {
+                ch.pulse_active = true;
+                ch.pulse_base_duty = baseDuty;
+                ch.pulse_ramp_ms = saved.pulse_ramp_ms;
+                ch.pulse_shape = static_cast<RampShape>(saved.pulse_shape);
+                ch.pulse_deadline_us = esp_timer_get_time() + remaining;
+                ch.pulse_deadline_wall_us = saved.pulse_deadline_us;
+            } else {
+                ch.duty = baseDuty;  // the pulse ran out while we were down
+            }
+        }
+
+        // The mirror is newer than anything write-behind may have lost
+        ch.invert = saved.invert != 0;
+        ChannelSettings restored;
+        restored.frequency = static_cast<int>(ch.frequency);
+        restored.invert = ch.invert;
+        restored.duty = dutyToPercentage(ch, baseDuty);
+        settings.restoreChannel(ch.index, restored);
+    }
+
+    // Makes the channel's current state visible to other tasks and to the
+    // next warm restart. Only the duty task (or the constructor, before it
+    // starts) calls this.
+    void publish(PwmChannel& ch) {
+        PwmChannelState state{};
+        state.duty = dutyToPercentage(ch, ch.duty);
+        state.target = dutyToPercentage(ch, ch.pulse_active ? ch.pulse_base_duty : ch.duty);
+        state.flow = dutyToFlow(ch, ch.duty);
+        state.calibrated = ch.calibration.calibrated();
+        state.frequency = ch.frequency;
+        state.achieved_hz = ch.timing.achieved_hz;
+        state.resolution_bits = static_cast<uint8_t>(ch.resolution_bits);
+        state.effective_bits = static_cast<uint8_t>(ch.resolution_bits + (ditherable(ch) ? DITHER_FRAC_BITS : 0));
+        state.invert = ch.invert;
+        state.ramping = ch.fade_end_us > esp_timer_get_time();
+        state.pulse_active = ch.pulse_active;
+        state.pulse_deadline_us = ch.pulse_active ? ch.pulse_deadline_us : 0;
+        state.last_retune_us = ch.last_retune_us;
+        state.last_retune_gap_us = ch.last_retune_gap_us;
+        state.applied_seq = ch.applied_seq;
+        state.program_active = ch.program_active;
+        state.program_step = ch.program_step;
+        state.program_steps = ch.program.step_count;
+        state.program_pass = ch.program_pass;
+        state.program_max_late_us = ch.program_max_late_us;
+        ch.state.write(state);
+        armDither(ch);
+        mirrorToRtc(ch);
+        state_version.fetch_add(1, std::memory_order_release);
+        xEventGroupSetBits(applied_events, appliedBit(ch.index));
+        TaskHandle_t listener = state_listener.load(std::memory_order_acquire);
+        if (listener != nullptr) {
+            xTaskNotifyGive(listener);
+        }
+    }
+
+    void mirrorToRtc(const PwmChannel& ch) {
+        RtcChannelState state{};
+        state.frequency = ch.frequency;
+        state.duty = ch.duty;
+        state.resolution_bits = static_cast<uint8_t>(ch.resolution_bits);
+        state.invert = ch.invert ? 1 : 0;
+        if (ch.pulse_active) {
+            state.pulse_base_duty = ch.pulse_base_duty;
+            state.pulse_deadline_us = ch.pulse_deadline_wall_us;
+            state.pulse_ramp_ms = ch.pulse_ramp_ms;
+            state.pulse_shape = static_cast<uint8_t>(ch.pulse_shape);
+        }
+        RtcMirror::update(ch.index, state);
+    }
+
+    // Low speed timers on most targets share one clock mux, so with several
+    // channels every timer stays on the fastest source.
+    static const LedcClockSource* sharedClock() {
+        return pwm_channel_count > 1 ? &ledc_clock_sources[0] : nullptr;
+    }
+
+    bool initializeLEDC(PwmChannel& ch) {
+        if (ch.timing.clock == nullptr) {
+            ESP_LOGE("PWMControl", "No LEDC clock reaches %lu Hz, using %d Hz",
+                     static_cast<unsigned long>(ch.frequency), default_frequency);
+            ch.frequency = default_frequency;
+            ch.timing = ledcSelectTiming(ch.frequency, sharedClock());
+            ch.duty = rescaleDuty(ch.duty, ch.resolution_bits, ch.timing.resolution_bits);
+            ch.resolution_bits = static_cast<ledc_timer_bit_t>(ch.timing.resolution_bits);
         }
 
         ledc_timer_config_t ledc_timer{};
         ledc_timer.speed_mode = LEDC_LOW_SPEED_MODE;
-        ledc_timer.timer_num = LEDC_TIMER_0;
-        ledc_timer.duty_resolution = resolution_bits;
-        ledc_timer.freq_hz = frequency;
-        ledc_timer.clk_cfg = LEDC_AUTO_CLK;
+        ledc_timer.timer_num = ch.timer;
+        ledc_timer.duty_resolution = ch.resolution_bits;
+        ledc_timer.freq_hz = ch.frequency;
+        ledc_timer.clk_cfg = ch.timing.clock->clk_cfg;
 
         esp_err_t err = ledc_timer_config(&ledc_timer);
         if (err != ESP_OK) {
             ESP_LOGE("PWMControl", "Failed to configure timer: %s", esp_err_to_name(err));
+            Metrics::recordLedcError();
             return false;
         }
 
         ledc_channel_config_t ledc_channel{};
         ledc_channel.speed_mode = LEDC_LOW_SPEED_MODE;
-        ledc_channel.channel = LEDC_CHANNEL_0;
-        ledc_channel.timer_sel = LEDC_TIMER_0;
+        ledc_channel.channel = ch.ledc_channel;
+        ledc_channel.timer_sel = ch.timer;
         ledc_channel.intr_type = LEDC_INTR_DISABLE;
-        ledc_channel.gpio_num = gpio_num;
-        ledc_channel.duty = 0;
+        ledc_channel.gpio_num = ch.gpio_num;
+        ledc_channel.duty = ch.duty;  // keep the output at its duty across a reconfig
         ledc_channel.hpoint = 0;
 
         err = ledc_channel_config(&ledc_channel);
         if (err != ESP_OK) {
             ESP_LOGE("PWMControl", "Failed to configure channel: %s", esp_err_to_name(err));
+            Metrics::recordLedcError();
             return false;
         }
 
+        if (!fade_ready) {
+            err = ledc_fade_func_install(0);
+            if (err == ESP_OK || err == ESP_ERR_INVALID_STATE) {
+                fade_ready = true;
+            } else {
+                ESP_LOGW("PWMControl", "Fade unavailable, ramps will step: %s", esp_err_to_name(err));
+            }
+        }
+
         return true;
     }
 
-    void setDutyCycle(int newDuty) {
-        duty = newDuty;
-        last_duty = newDuty;
+    // Restarts all timer counters back to back so channels at the same
+    // frequency share period boundaries.
+    void alignTimers() {
+        for (PwmChannel& ch : channels) {
+            ledc_timer_rst(LEDC_LOW_SPEED_MODE, ch.timer);
+        }
+    }
 
-        esp_err_t err = ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, duty);
+    // Moves the output to `newDuty`, either at once or by handing a fade to
+    // the LEDC hardware so no CPU time is spent during the ramp. `frac` is
+    // left to the dither timer once the output gets there.
+    void transitionTo(PwmChannel& ch, int newDuty, uint32_t ramp_ms, RampShape shape, uint8_t frac = 0) {
+        stopFade(ch);
+        ch.duty_frac = frac;
+        if (ramp_ms == 0 || !fade_ready) {
+            setDutyCycle(ch, newDuty);
+            return;
+        }
+
+        uint32_t from = ledc_get_duty(LEDC_LOW_SPEED_MODE, ch.ledc_channel);
+        ch.duty = newDuty;
+        if (from == static_cast<uint32_t>(newDuty)) {
+            return;
+        }
+
+        holdDither(ch);
+        esp_err_t err = startFade(ch, from, newDuty, ramp_ms, shape);
+        if (err != ESP_OK) {
+            ESP_LOGE("PWMControl", "Failed to start fade: %s", esp_err_to_name(err));
+            Metrics::recordLedcError();
+            setDutyCycle(ch, newDuty);
+            return;
+        }
+        ch.fade_end_us = esp_timer_get_time() + static_cast<int64_t>(ramp_ms) * 1000;
+    }
+
+    esp_err_t startFade(PwmChannel& ch, uint32_t from, uint32_t to, uint32_t ramp_ms, RampShape shape) {
+#if SOC_LEDC_GAMMA_CURVE_FADE_SUPPORTED
+        if (shape == RampShape::Ease) {
+            ease_full_scale = ch.maxDuty();
+            ledc_fade_param_config_t params[SOC_LEDC_GAMMA_CURVE_FADE_RANGE_MAX];
+            uint32_t count = 0;
+            esp_err_t err = ledc_fill_multi_fade_param_list(
+                LEDC_LOW_SPEED_MODE, ch.ledc_channel, easeInverse(from), easeInverse(to),
+                SOC_LEDC_GAMMA_CURVE_FADE_RANGE_MAX, ramp_ms, easeCurve,
+                SOC_LEDC_GAMMA_CURVE_FADE_RANGE_MAX, params, &count);
+            if (err != ESP_OK) {
+                return err;
+            }
+            return ledc_set_multi_fade_and_start(LEDC_LOW_SPEED_MODE, ch.ledc_channel, from,
+                                                 params, count, LEDC_FADE_NO_WAIT);
+        }
+#endif
+        return ledc_set_fade_time_and_start(LEDC_LOW_SPEED_MODE, ch.ledc_channel, to,
+                                            ramp_ms, LEDC_FADE_NO_WAIT);
+    }
+
+    // A running fade holds the channel's fade lock until it finishes, so it
+    // has to be stopped before the duty can be changed again.
+    void stopFade(PwmChannel& ch) {
+        if (ch.fade_end_us == 0) {
+            return;
+        }
+        if (esp_timer_get_time() < ch.fade_end_us) {
+#if SOC_LEDC_SUPPORT_FADE_STOP
+            esp_err_t err = ledc_fade_stop(LEDC_LOW_SPEED_MODE, ch.ledc_channel);
+            if (err != ESP_OK) {
+                ESP_LOGE("PWMControl", "Failed to stop fade: %s", esp_err_to_name(err));
+                Metrics::recordLedcError();
+            }
+#endif
+        }
+        ch.fade_end_us = 0;
+    }
+
+    static uint32_t easeCurve(uint32_t linear) {
+        return static_cast<uint32_t>(static_cast<uint64_t>(linear) * linear / ease_full_scale);
+    }
+
+    static uint32_t easeInverse(uint32_t shaped) {
+        return static_cast<uint32_t>(std::lround(std::sqrt(static_cast<double>(shaped) * ease_full_scale)));
+    }
+
+    static uint32_t validFrequency(int requested) {
+        if (requested <= 0) {
+            ESP_LOGE("PWMControl", "Invalid frequency, setting to %d", default_frequency);
+            return default_frequency;
+        }
+        return static_cast<uint32_t>(requested);
+    }
+
+    // Maps a raw duty between resolutions, keeping the same fraction of full scale
+    static int rescaleDuty(int rawDuty, uint32_t fromBits, uint32_t toBits) {
+        if (fromBits == toBits || fromBits == 0) {
+            return rawDuty;
+        }
+        int64_t fromMax = (int64_t{1} << fromBits) - 1;
+        int64_t toMax = (int64_t{1} << toBits) - 1;
+        return static_cast<int>((rawDuty * toMax + fromMax / 2) / fromMax);
+    }
+
+    // Percentages become a level out of level_full_scale once, on the way
+    // in; calibration, inversion and scaling to the timer resolution are
+    // integer from there.
+    static int percentageToDuty(const PwmChannel& ch, float percentage, DutyUnit unit, uint8_t& frac) {
+        if (percentage < 0.0f) percentage = 0.0f;
+        if (percentage > 100.0f) percentage = 100.0f;
+
+        uint32_t level = static_cast<uint32_t>(std::lround(percentage * (level_full_scale / 100.0f)));
+        if (unit == DutyUnit::Flow) {
+            level = ch.calibration.flowToDrive(level);
+        }
+		if (ch.invert) {
+			level = level_full_scale - level;
+		}
+        uint64_t maxDuty = static_cast<uint64_t>(ch.maxDuty()) << DITHER_FRAC_BITS;
+        return splitFine(static_cast<uint32_t>((level * maxDuty + level_full_scale / 2) / level_full_scale), frac);
+    }
+
+    static uint32_t fineDuty(int duty, uint8_t frac) {
+        return (static_cast<uint32_t>(duty) << DITHER_FRAC_BITS) | frac;
+    }
+
+    // Whole steps of a fine duty. With dithering the rest is kept in `frac`;
+    // without it the duty is rounded to the nearest step.
+    static int splitFine(uint32_t fine, uint8_t& frac) {
+#if CONFIG_PWM_DITHER
+        frac = static_cast<uint8_t>(fine & DITHER_FRAC_MASK);
+        return static_cast<int>(fine >> DITHER_FRAC_BITS);
+#else
+        frac = 0;
+        return static_cast<int>((fine + (DITHER_FRAC_MASK + 1) / 2) >> DITHER_FRAC_BITS);
+#endif
+    }
+
+    // rescaleDuty for a duty with a fraction
+    static int rescaleFine(int rawDuty, uint8_t frac, uint32_t fromBits, uint32_t toBits, uint8_t& newFrac) {
+        if (fromBits == toBits || fromBits == 0) {
+            newFrac = frac;
+            return rawDuty;
+        }
+        uint64_t fromMax = (uint64_t{1} << fromBits) - 1;
+        uint64_t toMax = (uint64_t{1} << toBits) - 1;
+        uint64_t fine = (fineDuty(rawDuty, frac) * toMax + fromMax / 2) / fromMax;
+        return splitFine(static_cast<uint32_t>(fine), newFrac);
+    }
+
+    // Drive level of a raw duty, before inversion
+    static uint32_t dutyToLevel(const PwmChannel& ch, int rawDuty) {
+        uint32_t maxDuty = static_cast<uint32_t>(ch.maxDuty());
+        uint32_t level = static_cast<uint32_t>((static_cast<uint64_t>(rawDuty) * level_full_scale + maxDuty / 2) / maxDuty);
+        if (level > level_full_scale) {
+            level = level_full_scale;
+        }
+        return ch.invert ? level_full_scale - level : level;
+    }
+
+    static float dutyToPercentage(const PwmChannel& ch, int rawDuty) {
+        return dutyToLevel(ch, rawDuty) * (100.0f / level_full_scale);
+    }
+
+    static float dutyToFlow(const PwmChannel& ch, int rawDuty) {
+        return ch.calibration.driveToFlow(dutyToLevel(ch, rawDuty)) * (100.0f / level_full_scale);
+    }
+
+    // Dithering only averages out if every code lasts several PWM periods
+    bool ditherable(const PwmChannel& ch) const {
+#if CONFIG_PWM_DITHER
+        return static_cast<uint64_t>(ch.timing.achieved_hz) * dither_period_us.load()
+               >= static_cast<uint64_t>(DITHER_MIN_PERIODS) * 1000000;
+#else
+        return false;
+#endif
+    }
+
+    // Keeps the dither timer off the channel while the duty task changes
+    // it; armDither hands it back once the new state is published. The
+    // lock is held across the timer's LEDC writes, so once this returns no
+    // stale code can land on top of the duty task's.
+    void holdDither(PwmChannel& ch) {
+#if CONFIG_PWM_DITHER
+        if (dither_lock == nullptr) {
+            return;
+        }
+        xSemaphoreTake(dither_lock, portMAX_DELAY);
+        ch.dither_active = false;
+        xSemaphoreGive(dither_lock);
+#endif
+    }
+
+    void armDither(PwmChannel& ch) {
+#if CONFIG_PWM_DITHER
+        if (dither_lock == nullptr) {
+            return;
+        }
+        xSemaphoreTake(dither_lock, portMAX_DELAY);
+        ch.dither_fine = fineDuty(ch.duty, ch.duty_frac);
+        // LEDC holds the channel until a fade has finished
+        ch.dither_hold_until_us = ch.fade_end_us != 0 ? ch.fade_end_us + dither_period_us.load() : 0;
+        ch.dither_active = ch.duty_frac != 0 && ch.duty < ch.maxDuty() && ditherable(ch);
+        xSemaphoreGive(dither_lock);
+#endif
+    }
+
+#if CONFIG_PWM_DITHER
+    // First order sigma-delta: each tick outputs `duty` or `duty + 1` so the
+    // running mean tracks the fine duty, exact over 256 ticks. Runs in the
+    // esp_timer task and skips a tick rather than wait for the duty task.
+    static void ditherTimerCallback(void* arg) {
+        PWMControl* pwm = static_cast<PWMControl*>(arg);
+        int64_t start = esp_timer_get_time();
+        if (xSemaphoreTake(pwm->dither_lock, 0) == pdTRUE) {
+            for (PwmChannel& ch : pwm->channels) {
+                if (!ch.dither_active || start < ch.dither_hold_until_us) {
+                    continue;
+                }
+                ch.dither_error += ch.dither_fine & DITHER_FRAC_MASK;
+                uint32_t code = ch.dither_fine >> DITHER_FRAC_BITS;
+                if (ch.dither_error > DITHER_FRAC_MASK) {
+                    ch.dither_error -= DITHER_FRAC_MASK + 1;
+                    ++code;
+                }
+                ledc_set_duty(LEDC_LOW_SPEED_MODE, ch.ledc_channel, code);
+                ledc_update_duty(LEDC_LOW_SPEED_MODE, ch.ledc_channel);
+            }
+            xSemaphoreGive(pwm->dither_lock);
+        }
+        pwm->accountDither(start, esp_timer_get_time());
+    }
+
+    // Keeps the timer within CONFIG_PWM_DITHER_MAX_CPU_PERMILLE of one core
+    // by doubling its period whenever a second's worth of ticks costs more
+    void accountDither(int64_t start, int64_t end) {
+        uint32_t tick_us = static_cast<uint32_t>(end - start);
+        dither_busy_us += tick_us;
+        dither_ticks.fetch_add(1, std::memory_order_relaxed);
+        if (tick_us > dither_max_tick_us.load(std::memory_order_relaxed)) {
+            dither_max_tick_us.store(tick_us, std::memory_order_relaxed);
+        }
+        if (dither_window_start_us == 0) {
+            dither_window_start_us = start;
+        }
+        int64_t window_us = end - dither_window_start_us;
+        if (window_us < 1000000) {
+            return;
+        }
+        uint32_t permille = static_cast<uint32_t>(dither_busy_us * 1000 / window_us);
+        dither_cpu_permille.store(permille, std::memory_order_relaxed);
+        dither_busy_us = 0;
+        dither_window_start_us = end;
+        uint32_t period = dither_period_us.load();
+        if (permille > CONFIG_PWM_DITHER_MAX_CPU_PERMILLE && period < DITHER_MAX_PERIOD_US) {
+            period *= 2;
+            dither_period_us.store(period);
+            dither_backoffs.fetch_add(1, std::memory_order_relaxed);
+            esp_timer_restart(dither_timer, period);
+            ESP_LOGW("PWMControl", "Dithering used %lu permille of the CPU, tick now %lu us",
+                     static_cast<unsigned long>(permille), static_cast<unsigned long>(period));
+        }
+    }
+#endif
+
+    void setDutyCycle(PwmChannel& ch, int newDuty) {
+        writeDuty(ch, newDuty);
+        latchDuty(ch);
+    }
+
+    void writeDuty(PwmChannel& ch, int newDuty) {
+        holdDither(ch);
+        ch.duty = newDuty;
+
+        esp_err_t err = ledc_set_duty(LEDC_LOW_SPEED_MODE, ch.ledc_channel, ch.duty);
         if (err != ESP_OK) {
             ESP_LOGE("PWMControl", "Failed to set duty: %s", esp_err_to_name(err));
+            Metrics::recordLedcError();
         }
+    }
 
-        err = ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+    void latchDuty(PwmChannel& ch) {
+        esp_err_t err = ledc_update_duty(LEDC_LOW_SPEED_MODE, ch.ledc_channel);
         if (err != ESP_OK) {
             ESP_LOGE("PWMControl", "Failed to update duty: %s", esp_err_to_name(err));
+            Metrics::recordLedcError();
         }
     }
 
 private:
 	SettingsManager &settings;
-    int gpio_num;
-    uint32_t frequency;
-    ledc_timer_bit_t resolution_bits;
-    int duty;
+    PwmChannel channels[pwm_channel_count];
 
-    uint32_t last_frequency;
-    int last_duty;
+    QueueHandle_t duty_cycle_queue = nullptr;
+    TaskHandle_t duty_task = nullptr;
+    StaticQueue_t queue_buffer;
+    uint8_t queue_storage[QUEUE_SIZE * sizeof(DutyCycleCommand)];
+    StaticTask_t duty_task_buffer;
+    StackType_t duty_stack[duty_task_stack];
 
-    QueueHandle_t duty_cycle_queue;
-};
+    portMUX_TYPE mailbox_lock = portMUX_INITIALIZER_UNLOCKED;
+    uint32_t next_seq = 1;
+    // Counted under mailbox_lock, read without it by the status handlers
+    std::atomic<uint32_t> mailbox_coalesced{0};
 
+    std::atomic<uint32_t> state_version{0};
+    // One bit per channel, set whenever its snapshot is published
+    EventGroupHandle_t applied_events = nullptr;
+    StaticEventGroup_t applied_events_buffer;
+    std::atomic<uint32_t> settings_seq[pwm_channel_count] = {};
+
+    // Written by the duty task only
+    EdgeLateness pulse_start_late;
+    EdgeLateness pulse_end_late;
+    std::atomic<TaskHandle_t> state_listener{nullptr};
+
+    bool fade_ready = false;
+    static inline uint32_t ease_full_scale = 1;
+
+    // Dither timer and its accounting; the counters are written by the
+    // esp_timer task only
+    SemaphoreHandle_t dither_lock = nullptr;
+    StaticSemaphore_t dither_lock_buffer;
+    esp_timer_handle_t dither_timer = nullptr;
+    int64_t dither_busy_us = 0;
+    int64_t dither_window_start_us = 0;
+    std::atomic<uint32_t> dither_period_us{0};
+    std::atomic<uint32_t> dither_ticks{0};
+    std::atomic<uint32_t> dither_cpu_permille{0};
+    std::atomic<uint32_t> dither_max_tick_us{0};
+    std::atomic<uint32_t> dither_backoffs{0};
+};
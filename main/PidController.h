@@ -0,0 +1,92 @@
+#pragma once
+
+// Discrete PID controller with output limits and anti-windup. Deliberately
+// free of ESP-IDF dependencies, so it can be exercised against a plant
+// model on the host.
+//
+// The derivative acts on the measurement, not the error, so setpoint steps
+// do not kick the output, and is low-pass filtered because tach readings
+// are quantised. The integral only moves while the output is inside its
+// limits, or when the error would pull it back in (conditional integration);
+// a step that would cross a limit takes the output to the limit and stops.
+struct PidGains {
+    float kp = 0.0f;
+    float ki = 0.0f;            // per second
+    float kd = 0.0f;            // seconds
+    float out_min = 0.0f;
+    float out_max = 100.0f;
+    float d_filter = 0.2f;      // 0..1 weight of the newest derivative sample
+};
+
+class PidController {
+public:
+    explicit PidController(const PidGains& gains = {}) : gains(gains) {}
+
+    void setGains(const PidGains& newGains) {
+        gains = newGains;
+        integral = clamp(integral);
+    }
+
+    const PidGains& getGains() const {
+        return gains;
+    }
+
+    // Starts from `output` without a bump, e.g. the duty the loop took over
+    void reset(float output, float measurement) {
+        integral = clamp(output);
+        last_measurement = measurement;
+        derivative = 0.0f;
+        primed = true;
+    }
+
+    // One step of `dt` seconds; returns the new output
+    float update(float setpoint, float measurement, float dt) {
+        if (dt <= 0.0f) {
+            return last_output;
+        }
+        if (!primed) {
+            reset(last_output, measurement);
+        }
+        float error = setpoint - measurement;
+
+        float rawDerivative = -(measurement - last_measurement) / dt;
+        derivative += gains.d_filter * (rawDerivative - derivative);
+        last_measurement = measurement;
+
+        float proportional = gains.kp * error;
+        float candidate = integral + gains.ki * error * dt;
+        float unclamped = proportional + candidate + gains.kd * derivative;
+        bool saturatedHigh = unclamped > gains.out_max;
+        bool saturatedLow = unclamped < gains.out_min;
+        if ((!saturatedHigh || error < 0.0f) && (!saturatedLow || error > 0.0f)) {
+            integral = clamp(candidate);
+        } else if (saturatedHigh) {
+            // Integrate up to the limit, not short of it, or the output
+            // stalls just below it with the error still positive
+            float limit = gains.out_max - proportional - gains.kd * derivative;
+            integral = clamp(integral > limit ? integral : limit);
+        } else {
+            float limit = gains.out_min - proportional - gains.kd * derivative;
+            integral = clamp(integral < limit ? integral : limit);
+        }
+
+        last_output = clamp(proportional + integral + gains.kd * derivative);
+        return last_output;
+    }
+
+    float getIntegral() const {
+        return integral;
+    }
+
+private:
+    float clamp(float value) const {
+        return value < gains.out_min ? gains.out_min : (value > gains.out_max ? gains.out_max : value);
+    }
+
+    PidGains gains;
+    float integral = 0.0f;
+    float derivative = 0.0f;
+    float last_measurement = 0.0f;
+    float last_output = 0.0f;
+    bool primed = false;
+};
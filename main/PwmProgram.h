@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+inline constexpr int program_max_steps = 16;
+
+// One step of a duty program: move to `duty_centi` (hundredths of a percent)
+// over `ramp_ms`, and start the next step `hold_ms` after this one started.
+// A step with a loop_count jumps back to step `loop_to` that many times
+// before falling through, so loops nest.
+struct ProgramStep {
+    uint32_t hold_ms;
+    uint16_t duty_centi;
+    uint16_t ramp_ms;
+    uint8_t loop_to;
+    uint8_t loop_count;
+};
+
+struct PwmProgram {
+    uint16_t repeat = 1;        // passes through the whole program, 0 = forever
+    uint8_t step_count = 0;
+    ProgramStep steps[program_max_steps] = {};
+};
+
+static_assert(sizeof(ProgramStep) == 12, "ProgramStep is stored in NVS as is");
+
+// Reason the program cannot run, or null if it is fine
+inline const char* validateProgram(const PwmProgram& program) {
+    if (program.step_count == 0 || program.step_count > program_max_steps) {
+        return "A program needs 1 to 16 steps";
+    }
+    for (int i = 0; i < program.step_count; ++i) {
+        const ProgramStep& step = program.steps[i];
+        if (step.duty_centi > 10000) {
+            return "Step duty must be 0 to 100";
+        }
+        if (step.hold_ms == 0) {
+            return "Step hold_ms must be at least 1";
+        }
+        if (step.loop_count > 0 && step.loop_to > i) {
+            return "A loop can only jump back";
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,4 @@
+#include "RtcState.h"
+#include "esp_attr.h"
+
+RTC_NOINIT_ATTR RtcOutputState rtc_output_state;
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <sys/time.h>
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+
+#include "SettingsManager.h"
+
+// Live output of one channel as last applied by the duty task
+struct RtcChannelState {
+    uint32_t frequency;
+    int32_t duty;
+    int32_t pulse_base_duty;
+    int64_t pulse_deadline_us;  // wall clock; 0 when no pulse is running
+    uint32_t pulse_ramp_ms;
+    uint8_t resolution_bits;
+    uint8_t invert;
+    uint8_t pulse_shape;
+};
+
+// Mirror of the live outputs in RTC no-init memory. It survives software,
+// panic and watchdog resets (including the restart after an OTA update) but
+// not a power cycle, so PWMControl can put the outputs back exactly as they
+// were, including a pulse that was still running.
+struct RtcOutputState {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t channel_count;
+    RtcChannelState channels[pwm_channel_count];
+    uint32_t crc;   // CRC32 of everything before this field
+};
+
+extern RtcOutputState rtc_output_state;
+
+class RtcMirror {
+public:
+    static constexpr uint32_t magic = 0x52544f31;  // "RTO1"
+    static constexpr uint16_t version = 1;
+
+    // True when this boot is a warm reset and the mirror is intact
+    static bool warmStateValid() {
+        switch (esp_reset_reason()) {
+        case ESP_RST_SW:
+        case ESP_RST_PANIC:
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT:
+            break;
+        default:
+            return false;
+        }
+        const RtcOutputState& state = rtc_output_state;
+        return state.magic == magic && state.version == version
+            && state.channel_count == pwm_channel_count && state.crc == crc(state);
+    }
+
+    static const RtcChannelState& channel(int index) {
+        return rtc_output_state.channels[index];
+    }
+
+    static void update(int index, const RtcChannelState& channel) {
+        RtcOutputState& state = rtc_output_state;
+        if (state.magic != magic || state.version != version || state.channel_count != pwm_channel_count) {
+            state = {};
+            state.magic = magic;
+            state.version = version;
+            state.channel_count = pwm_channel_count;
+        }
+        state.channels[index] = channel;
+        state.crc = crc(state);
+    }
+
+    // System time keeps running across software resets, unlike esp_timer,
+    // so pulse deadlines are kept on this clock.
+    static int64_t wallClockMicros() {
+        struct timeval tv;
+        gettimeofday(&tv, nullptr);
+        return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+    }
+
+private:
+    static uint32_t crc(const RtcOutputState& state) {
+        return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&state), offsetof(RtcOutputState, crc));
+    }
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include "sdkconfig.h"
+
+inline constexpr int schedule_max_entries = 16;
+inline constexpr uint16_t minutes_per_day = 24 * 60;
+
+// A weekly window: on each day in `days` (bit 0 Sunday .. bit 6 Saturday,
+// as tm_wday) the channel runs at `duty_centi` from `start_min` until
+// `end_min`, both minutes after local midnight. A window whose end is not
+// after its start runs on past midnight into the next day. Outside every
+// window a channel runs at its stored duty.
+struct ScheduleEntry {
+    uint8_t channel;
+    uint8_t days;
+    uint16_t start_min;
+    uint16_t end_min;
+    uint16_t duty_centi;
+    uint16_t ramp_ms;
+    uint16_t reserved;
+};
+
+struct DutySchedule {
+    uint8_t count = 0;
+    ScheduleEntry entries[schedule_max_entries] = {};
+};
+
+static_assert(sizeof(ScheduleEntry) == 12, "ScheduleEntry is stored in NVS as is");
+
+// Reason the schedule cannot be used, or null if it is fine
+inline const char* validateSchedule(const DutySchedule& schedule) {
+    if (schedule.count > schedule_max_entries) {
+        return "At most 16 schedule entries";
+    }
+    for (int i = 0; i < schedule.count; ++i) {
+        const ScheduleEntry& entry = schedule.entries[i];
+        if (entry.channel >= CONFIG_PWM_CHANNEL_COUNT) {
+            return "Schedule entry for an unknown channel";
+        }
+        if ((entry.days & 0x7f) == 0 || (entry.days & 0x80) != 0) {
+            return "Schedule entry has no valid days";
+        }
+        if (entry.start_min >= minutes_per_day || entry.end_min >= minutes_per_day) {
+            return "Schedule times must be 00:00 to 23:59";
+        }
+        if (entry.duty_centi > 10000) {
+            return "Schedule duty must be 0 to 100";
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <ctime>
+#include <sys/time.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "MemoryBudget.h"
+#include "PWMControl.h"
+#include "Schedule.h"
+#include "SettingsManager.h"
+#include "TaskConfig.h"
+
+// Anything earlier means the clock was never set
+inline constexpr time_t schedule_min_valid_time = 1700000000;  // Nov 2023
+
+// Applies the weekly duty windows. One esp_timer sleeps until the next
+// window edge; the schedule task then works out which window (if any) each
+// channel is in and arms the timer again. Edges are found with mktime in
+// local time, so DST changes in the POSIX TZ string move them correctly.
+//
+// Until the clock is valid (no NTP sync, and no time carried over from
+// before a software reset) windows are not applied and every channel stays
+// at its stored duty. A sync or clock step calls timeChanged().
+class Scheduler : public SettingsObserver {
+public:
+    Scheduler(PWMControl& pump, SettingsManager& settings)
+        : pump(pump), settings(settings) {
+        lock = xSemaphoreCreateMutexStatic(&lock_buffer);
+        settings.loadSchedule(schedule);
+
+        esp_timer_create_args_t timer_args{};
+        timer_args.callback = [](void* arg) {
+            xTaskNotifyGive(static_cast<Scheduler*>(arg)->task);
+        };
+        timer_args.arg = this;
+        timer_args.dispatch_method = ESP_TIMER_TASK;
+        timer_args.name = "schedule";
+        if (esp_timer_create(&timer_args, &timer) != ESP_OK) {
+            ESP_LOGE("Scheduler", "Failed to create schedule timer.");
+        }
+
+        instance = this;
+        settings.addObserver(this);
+
+        // Last, as the task evaluates straight away. mktime parses the TZ
+        // rules on every call, which wants more stack than the esp_timer
+        // task should give up.
+        task = xTaskCreateStaticPinnedToCore(scheduleTask, "schedule", schedule_task_stack, this,
+                                             schedule_task_priority, stack, &task_buffer, control_task_core);
+    }
+
+    bool clockValid() const {
+        return time(nullptr) >= schedule_min_valid_time;
+    }
+
+    // Replaces, stores and immediately applies the schedule
+    const char* setSchedule(const DutySchedule& newSchedule) {
+        const char* problem = validateSchedule(newSchedule);
+        if (problem != nullptr) {
+            return problem;
+        }
+        xSemaphoreTake(lock, portMAX_DELAY);
+        schedule = newSchedule;
+        xSemaphoreGive(lock);
+        if (!settings.saveSchedule(newSchedule)) {
+            return "Failed to store schedule";
+        }
+        timeChanged();
+        return nullptr;
+    }
+
+    DutySchedule getSchedule() {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        DutySchedule copy = schedule;
+        xSemaphoreGive(lock);
+        return copy;
+    }
+
+    // Next window edge, or 0 if none is armed
+    time_t nextTransition() const {
+        return next_transition;
+    }
+
+    // Re-evaluates after the clock or TZ changed
+    void timeChanged() {
+        // Before the task exists its first pass is still to come
+        if (task != nullptr) {
+            xTaskNotifyGive(task);
+        }
+    }
+
+    // A new TZ moves the window edges. This runs on the caller's task (the
+    // httpd one for PATCH /settings), so the TZ is only handed over here; the
+    // schedule task sets it, between its own mktime calls, and re-arms.
+    bool settingChanged(const SettingField& field, int channel, const SettingsValues& values) override {
+        if (field.id == SettingId::Tz) {
+            xSemaphoreTake(lock, portMAX_DELAY);
+            pending_tz = values.tz;
+            tz_pending = true;
+            xSemaphoreGive(lock);
+            timeChanged();
+        }
+        return true;
+    }
+
+    // sntp_set_time_sync_notification_cb target
+    static void onTimeSync(struct timeval*) {
+        if (instance) {
+            instance->timeChanged();
+        }
+    }
+
+private:
+    static void scheduleTask(void* pvParameter) {
+        Scheduler* scheduler = static_cast<Scheduler*>(pvParameter);
+        for (;;) {
+            scheduler->evaluate();
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+
+    // Takes a TZ handed over by settingChanged
+    void applyPendingTz() {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        bool changed = tz_pending;
+        tz_pending = false;
+        if (changed) {
+            setenv("TZ", pending_tz.c_str(), 1);
+            tzset();
+        }
+        xSemaphoreGive(lock);
+    }
+
+    void evaluate() {
+        applyPendingTz();
+        esp_timer_stop(timer);
+        next_transition = 0;
+        time_t now = time(nullptr);
+        if (now < schedule_min_valid_time) {
+            ESP_LOGW("Scheduler", "Clock not set, schedule held until time sync.");
+            return;
+        }
+
+        xSemaphoreTake(lock, portMAX_DELAY);
+        DutySchedule current = schedule;
+        xSemaphoreGive(lock);
+
+        struct tm local;
+        localtime_r(&now, &local);
+        for (int ch = 0; ch < pwm_channel_count; ++ch) {
+            applyChannel(ch, activeEntry(current, ch, local), hasEntries(current, ch));
+        }
+
+        time_t next = nextEdge(current, now, local);
+        if (next == 0) {
+            return;
+        }
+        next_transition = next;
+        // esp_timer keeps counting through clock steps, so a sync that moves
+        // the clock calls timeChanged() to re-arm from the new time
+        int64_t delay_us = static_cast<int64_t>(next - now) * 1000000;
+        esp_timer_start_once(timer, static_cast<uint64_t>(delay_us));
+        ESP_LOGI("Scheduler", "Next schedule change in %lld s", static_cast<long long>(next - now));
+    }
+
+    // First entry (in list order) whose window covers `local` on `channel`
+    static const ScheduleEntry* activeEntry(const DutySchedule& schedule, int channel, const struct tm& local) {
+        int minute = local.tm_hour * 60 + local.tm_min;
+        int yesterday = (local.tm_wday + 6) % 7;
+        for (int i = 0; i < schedule.count; ++i) {
+            const ScheduleEntry& entry = schedule.entries[i];
+            if (entry.channel != channel) {
+                continue;
+            }
+            bool today = entry.days & (1 << local.tm_wday);
+            if (entry.start_min < entry.end_min) {
+                if (today && minute >= entry.start_min && minute < entry.end_min) {
+                    return &entry;
+                }
+            } else if ((today && minute >= entry.start_min)
+                       || ((entry.days & (1 << yesterday)) && minute < entry.end_min)) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    static bool hasEntries(const DutySchedule& schedule, int channel) {
+        for (int i = 0; i < schedule.count; ++i) {
+            if (schedule.entries[i].channel == channel) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Windows only change on entering or leaving one; in between the output
+    // is left alone, so /pump requests still work inside a window.
+    void applyChannel(int channel, const ScheduleEntry* entry, bool scheduled) {
+        if (!settled[channel]) {
+            // After a warm reset the output may still be at a window's duty,
+            // so the first pass sets every scheduled channel either way
+            settled[channel] = true;
+            in_window[channel] = scheduled;
+            window_duty[channel] = UINT16_MAX;
+        }
+        if (entry != nullptr) {
+            if (!in_window[channel] || window_duty[channel] != entry->duty_centi) {
+                ESP_LOGI("Scheduler", "Channel %d entering window at %.2f%%", channel, entry->duty_centi / 100.0f);
+                pump.setDutyCyclePercentage(channel, entry->duty_centi / 100.0f, 0, entry->ramp_ms);
+                in_window[channel] = true;
+                window_duty[channel] = entry->duty_centi;
+                window_ramp[channel] = entry->ramp_ms;
+            }
+        } else if (in_window[channel]) {
+            ESP_LOGI("Scheduler", "Channel %d leaving window", channel);
+            pump.setDutyCyclePercentage(channel, settings.channelSettings(channel).duty, 0, window_ramp[channel]);
+            in_window[channel] = false;
+        }
+    }
+
+    // Earliest window start or end after `now`, looking a week ahead
+    static time_t nextEdge(const DutySchedule& schedule, time_t now, const struct tm& local) {
+        time_t best = 0;
+        // Start from yesterday for windows that run on past midnight
+        for (int day = -1; day <= 7; ++day) {
+            int wday = (local.tm_wday + day + 7) % 7;
+            for (int i = 0; i < schedule.count; ++i) {
+                const ScheduleEntry& entry = schedule.entries[i];
+                if (!(entry.days & (1 << wday))) {
+                    continue;
+                }
+                // A window past midnight ends on the following day
+                int endDay = entry.start_min < entry.end_min ? day : day + 1;
+                time_t edges[] = {localTime(local, day, entry.start_min), localTime(local, endDay, entry.end_min)};
+                for (time_t edge : edges) {
+                    if (edge > now && (best == 0 || edge < best)) {
+                        best = edge;
+                    }
+                }
+            }
+        }
+        return best;
+    }
+
+    // `minute` past local midnight, `days` after the date in `local`. A time
+    // skipped by a DST change comes out just after the change.
+    static time_t localTime(const struct tm& local, int days, int minute) {
+        struct tm when = {};
+        when.tm_year = local.tm_year;
+        when.tm_mon = local.tm_mon;
+        when.tm_mday = local.tm_mday + days;
+        when.tm_hour = minute / 60;
+        when.tm_min = minute % 60;
+        when.tm_isdst = -1;
+        return mktime(&when);
+    }
+
+    PWMControl& pump;
+    SettingsManager& settings;
+
+    SemaphoreHandle_t lock;
+    StaticSemaphore_t lock_buffer;
+    DutySchedule schedule;
+    FixedString<sizeof(SettingsBlob::tz)> pending_tz;  // under lock
+    bool tz_pending = false;                            // under lock
+    esp_timer_handle_t timer = nullptr;
+    TaskHandle_t task = nullptr;
+    StaticTask_t task_buffer;
+    StackType_t stack[schedule_task_stack];
+    std::atomic<time_t> next_transition{0};
+
+    // Owned by the schedule task
+    bool settled[pwm_channel_count] = {};
+    bool in_window[pwm_channel_count] = {};
+    uint16_t window_duty[pwm_channel_count] = {};
+    uint16_t window_ramp[pwm_channel_count] = {};
+
+    static inline Scheduler* instance = nullptr;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include "freertos/FreeRTOS.h"
+
+// Single-writer sequence lock. Readers never block or take a lock: they copy
+// the value and retry if the writer was part way through. The writer copies
+// inside a critical section, so on a single core a reader can never observe
+// an odd sequence and spin behind a preempted writer.
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable_v<T>, "SeqLock values are copied byte-wise");
+
+public:
+    void write(const T& value) {
+        taskENTER_CRITICAL(&lock);
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        data = value;
+        std::atomic_thread_fence(std::memory_order_release);
+        sequence.store(seq + 2, std::memory_order_release);
+        taskEXIT_CRITICAL(&lock);
+    }
+
+    T read() const {
+        T copy;
+        uint32_t before;
+        uint32_t after;
+        do {
+            before = sequence.load(std::memory_order_acquire);
+            copy = data;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) != 0 || before != after);
+        return copy;
+    }
+
+private:
+    std::atomic<uint32_t> sequence{0};
+    T data{};
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+};
@@ -1,125 +1,751 @@
 #pragma once
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
 #include <string>
-#include <type_traits>
-#include <vector>
-#include <utility>
 
 #include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "sdkconfig.h"
 
 #include "NvsStorageManager.h"
-#include "JsonWrapper.h"
+#include "Calibration.h"
+#include "FlatJson.h"
+#include "MemoryBudget.h"
+#include "Metrics.h"
+#include "PwmProgram.h"
+#include "Schedule.h"
+#include "SettingsSchema.h"
 
-class SettingsManager {
+inline constexpr uint16_t settings_blob_magic = 0x5057;  // "PW"
+inline constexpr uint16_t settings_blob_version = 1;
+inline constexpr const char* settings_blob_namespace = "pwmsettings";
+inline constexpr const char* settings_blob_key = "blob";
+inline constexpr int settings_blob_max_channels = 4;     // PWM_CHANNEL_COUNT's range
+
+static_assert(pwm_channel_count <= settings_blob_max_channels, "settings blob buffer is too small");
+
+// Programs, calibration curves and schedules are stored as a header, only
+// the items in use and a CRC32, in the settings namespace: programs under
+// channelKey("program", channel), curves under channelKey("calib",
+// channel), the schedule under "schedule".
+struct StoredListHeader {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t count;
+    uint16_t extra;     // program repeat count; unused for schedules
+    uint16_t reserved;
+};
+
+inline constexpr uint16_t program_blob_magic = 0x5047;  // "PG"
+inline constexpr uint8_t program_blob_version = 1;
+inline constexpr uint16_t calibration_blob_magic = 0x4341;  // "CA"
+inline constexpr uint8_t calibration_blob_version = 1;
+inline constexpr uint16_t schedule_blob_magic = 0x5343;  // "SC"
+inline constexpr uint8_t schedule_blob_version = 1;
+inline constexpr const char* schedule_blob_key = "schedule";
+
+// Write-behind persistence counters
+struct PersistStats {
+    uint32_t requested = 0;     // save calls
+    uint32_t written = 0;       // blobs actually written to NVS
+    uint32_t avoided = 0;       // save calls absorbed by a pending write
+    uint32_t flushes = 0;
+    uint32_t failed = 0;        // flushes whose write failed and is retried
+    int64_t last_flush_us = 0;
+    int64_t max_flush_us = 0;
+};
+
+// What a patch did. A refused patch changes nothing.
+struct SettingsPatch {
+    bool ok = true;
+    uint8_t changed = 0;    // fields that took a new value
+    uint8_t failed = 0;     // new values an observer could not carry out, left as they were
+    char error[96] = {};
+};
+
+// The values are written by patch(), the store and restore setters and the
+// constructor, and read by the flush task, so after boot other tasks read
+// them through snapshot() or channelSettings() rather than directly.
+class SettingsManager : public SettingsValues {
     NvsStorageManager nvs;
 public:
-    using ChangeList = std::vector<std::pair<std::string, std::string>>;
+    static const int MAX_OBSERVERS = 4;
 
     SettingsManager(NvsStorageManager& nvs) : nvs(nvs) {
+        values_lock = xSemaphoreCreateMutexStatic(&values_lock_buffer);
         loadSettings();
+        initializeWriteBehind();
     }
 
-    std::string tz = "AEST-10AEDT,M10.1.0,M4.1.0/3";
-    std::string ntpServer = "time.google.com";
-    int frequency = 1000;
-    float duty = 10;
-    bool invert = false;
-    std::string otaUrl = "http://ota.mianos.com";
-
-    std::string convertChangesToJson(const SettingsManager::ChangeList& changes) {
-        cJSON *root = cJSON_CreateObject();
-        for (const auto& [key, value] : changes) {
-            cJSON_AddStringToObject(root, key.c_str(), value.c_str());
+    // One blob read; falls back to migrating the per-key string entries
+    // written by earlier firmware, saves them as a blob and erases them.
+    // Runs before anything else can see the values.
+    void loadSettings() {
+        int64_t start = esp_timer_get_time();
+        int storedChannels = 0;
+        if (loadBlob(storedChannels)) {
+            ESP_LOGI("SettingsManager", "Loaded settings blob in %lld us",
+                     static_cast<long long>(esp_timer_get_time() - start));
+            // Rewritten at the new size; added channels have their defaults
+            if (storedChannels != pwm_channel_count && writeBlob() == ESP_OK) {
+                ESP_LOGI("SettingsManager", "Settings blob resized from %d to %d channels",
+                         storedChannels, pwm_channel_count);
+            }
+            return;
+        }
+        LegacyKey found[legacy_key_max];
+        int count = loadLegacySettings(found);
+        if (writeBlob() == ESP_OK) {
+            eraseLegacySettings(found, count);
+            ESP_LOGI("SettingsManager", "Migrated string settings to blob v%u", settings_blob_version);
         }
-        char *rawJson = cJSON_Print(root);
-        std::string jsonResponse(rawJson);
-        cJSON_Delete(root);
-        free(rawJson); // cJSON_Print allocates memory that must be freed
-        return jsonResponse;
     }
 
-    void loadSettings() {
-        std::string value;
+    // A string entry loadLegacySettings found: its schema field and channel
+    struct LegacyKey {
+        uint8_t field;
+        uint8_t channel;
+    };
+    static constexpr size_t legacy_key_max = std::size(settings_schema) * pwm_channel_count;
 
-        nvs.retrieve("tz", tz);
-        nvs.retrieve("ntpServer", ntpServer);
-        if (nvs.retrieve("frequency", value))
-            frequency = std::stoi(value);
-        if (nvs.retrieve("duty", value))
-            duty = std::stof(value);
-        if (nvs.retrieve("invert", value)) {
-            invert = (value == "t");
+    // Reads the per-key string entries through NvsStorageManager; lists the
+    // ones it found in `found`, which holds legacy_key_max, and returns how
+    // many there were
+    int loadLegacySettings(LegacyKey* found) {
+        int count = 0;
+        std::string value;
+        for (size_t f = 0; f < std::size(settings_schema); ++f) {
+            const SettingField& field = settings_schema[f];
+            int channels = field.per_channel ? pwm_channel_count : 1;
+            for (int i = 0; i < channels; ++i) {
+                if (!nvs.retrieve(channelKey(field.name, i), value)) {
+                    continue;
+                }
+                found[count++] = {static_cast<uint8_t>(f), static_cast<uint8_t>(i)};
+                if (!parseLegacySetting(*this, value.c_str(), field, i)) {
+                    ESP_LOGW("SettingsManager", "Ignoring stored %s '%s'", field.name, value.c_str());
+                }
+            }
         }
-        nvs.retrieve("otaUrl", otaUrl);
+        return count;
     }
 
-    std::string toJson() const {
-        JsonWrapper json;
-        json.AddItem("tz", tz);
-        json.AddItem("ntpServer", ntpServer);
-        json.AddItem("frequency", std::to_string(frequency));
-        json.AddItem("duty", std::to_string(duty));
-        json.AddItem("invert", invert ? "true" : "false");
-        json.AddItem("otaUrl", otaUrl);
-        return json.ToString();
+    // Consistent copy of every value
+    SettingsValues snapshot() const {
+        xSemaphoreTake(values_lock, portMAX_DELAY);
+        SettingsValues copy = *this;
+        xSemaphoreGive(values_lock);
+        return copy;
     }
 
-    void Store(const std::string key, std::string value) {
-        nvs.store(key, value);
+    ChannelSettings channelSettings(int channel) const {
+        xSemaphoreTake(values_lock, portMAX_DELAY);
+        ChannelSettings copy = channels[channel];
+        xSemaphoreGive(values_lock);
+        return copy;
     }
 
-    ChangeList updateFromJson(const std::string& jsonString) {
-        ChangeList changes;
-        JsonWrapper json = JsonWrapper::Parse(jsonString);
-        updateFieldIfChanged(json, "tz", tz, changes);
-        updateFieldIfChanged(json, "ntpServer", ntpServer, changes);
-        updateFieldIfChanged(json, "frequency", frequency, changes);
-        updateFieldIfChanged(json, "duty", duty, changes);
-        updateFieldIfChanged(json, "invert", invert, changes);
-        updateFieldIfChanged(json, "otaUrl", otaUrl, changes);
+    // Removes the string entries loadLegacySettings found, once the blob
+    // holds their values, so a later fallback cannot bring them back.
+    // NvsStorageManager can only store and retrieve, so its namespace is
+    // taken to be the one holding every found key with the value it
+    // returned. Only those keys are erased, and nothing is if no namespace,
+    // or more than one, matches: other components may use the same names.
+    void eraseLegacySettings(const LegacyKey* found, int count) {
+        if (count == 0) {
+            return;
+        }
+        std::string first = legacyKeyName(found[0]);
+        char candidates[4][NVS_NS_NAME_MAX_SIZE];
+        int candidateCount = 0;
+        nvs_iterator_t it = nullptr;
+        esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, nullptr, NVS_TYPE_STR, &it);
+        while (err == ESP_OK) {
+            nvs_entry_info_t info;
+            nvs_entry_info(it, &info);
+            if (candidateCount < static_cast<int>(std::size(candidates)) && first == info.key
+                && strcmp(info.namespace_name, settings_blob_namespace) != 0) {
+                snprintf(candidates[candidateCount++], NVS_NS_NAME_MAX_SIZE, "%s", info.namespace_name);
+            }
+            err = nvs_entry_next(&it);
+        }
+        nvs_release_iterator(it);
 
-        // Save any changes to NVRAM
-        for (const auto& [key, value] : changes) {
-            nvs.store(key, value);
+        const char* owner = nullptr;
+        for (int c = 0; c < candidateCount; ++c) {
+            if (!holdsLegacyValues(candidates[c], found, count)) {
+                continue;
+            }
+            if (owner != nullptr) {
+                ESP_LOGW("SettingsManager", "String settings match in %s and %s, leaving both", owner, candidates[c]);
+                return;
+            }
+            owner = candidates[c];
+        }
+        nvs_handle_t handle;
+        if (owner == nullptr || nvs_open(owner, NVS_READWRITE, &handle) != ESP_OK) {
+            ESP_LOGW("SettingsManager", "Could not place the string settings, leaving them");
+            return;
         }
-        return changes;
+        int erased = 0;
+        for (int i = 0; i < count; ++i) {
+            erased += nvs_erase_key(handle, legacyKeyName(found[i]).c_str()) == ESP_OK;
+        }
+        nvs_commit(handle);
+        nvs_close(handle);
+        ESP_LOGI("SettingsManager", "Erased %d string settings from %s", erased, owner);
     }
 
-private:
-    template <typename T>
-    void updateFieldIfChanged(JsonWrapper& json, const std::string& key, T& field, SettingsManager::ChangeList& changes) {
-        if (json.ContainsField(key)) {  // Only proceed if the key exists in the JSON
-            T newValue;
-            if (json.GetField(key, newValue)) {  // Successfully retrieved new value
-                if (newValue != field) {
-                    field = newValue;
-
-                    // Log the change for response
-                    if constexpr (std::is_same_v<T, std::string>) {
-                        changes.emplace_back(key, field);
-                    } else {
-                        changes.emplace_back(key, std::to_string(field));
-                    }
-                }
+    // Every setting as a JSON object; 0 if it does not fit
+    size_t formatJson(char* out, size_t size) const {
+        SettingsValues values = snapshot();
+        return formatSettingsJson(out, size, values);
+    }
+
+    // Channel 0 keeps the original key names; channel n appends n
+    static std::string channelKey(const char* base, int channel) {
+        if (channel == 0) {
+            return base;
+        }
+        return std::string(base) + std::to_string(channel);
+    }
+
+    // Observers hear about every change a patch commits. Register them
+    // before the web server starts; the list is not locked.
+    void addObserver(SettingsObserver* observer) {
+        if (observer_count == MAX_OBSERVERS) {
+            ESP_LOGE("SettingsManager", "No room for another settings observer.");
+            return;
+        }
+        observers[observer_count++] = observer;
+    }
+
+    // Applies every field of `json` in one go. All keys and values are
+    // checked, by the schema and then by the observers, before anything
+    // changes, so one bad field refuses the whole patch. Each changed value
+    // is then committed and handed to the observers, and the lot is saved
+    // as one blob write. With `channel` set, keys are the plain per-channel
+    // names and address that channel; "id" is skipped, as it chose the
+    // channel. Observers are handed the patched values. Only the httpd task
+    // patches.
+    SettingsPatch patch(const FlatJson& json, int channel = -1) {
+        SettingsPatch result;
+        const SettingsValues current = snapshot();
+        SettingsValues proposed = current;
+        struct Change {
+            const SettingField* field;
+            int channel;
+        };
+        Change changes[FlatJson::MAX_FIELDS];
+        int count = 0;
+
+        for (int i = 0; i < json.size(); ++i) {
+            const char* key = json.keyAt(i);
+            int fieldChannel = channel;
+            const SettingField* field = nullptr;
+            if (channel < 0) {
+                field = findSetting(key, fieldChannel);
+            } else if (strcmp(key, "id") == 0) {
+                continue;
+            } else {
+                field = findChannelSetting(key);
+            }
+            if (field == nullptr) {
+                return refuse(result, key, "unknown setting");
+            }
+            const char* problem = readSetting(json, key, proposed, *field, fieldChannel);
+            for (int o = 0; problem == nullptr && o < observer_count; ++o) {
+                problem = observers[o]->checkSetting(*field, fieldChannel, proposed);
+            }
+            if (problem != nullptr) {
+                return refuse(result, key, problem);
+            }
+            bool listed = false;
+            for (int c = 0; c < count; ++c) {
+                listed = listed || (changes[c].field == field && changes[c].channel == fieldChannel);
+            }
+            if (!listed && !settingEquals(current, proposed, *field, fieldChannel)) {
+                changes[count++] = {field, fieldChannel};
+            }
+        }
+
+        for (int c = 0; c < count; ++c) {
+            const SettingField& field = *changes[c].field;
+            xSemaphoreTake(values_lock, portMAX_DELAY);
+            copySetting(*this, proposed, field, changes[c].channel);
+            xSemaphoreGive(values_lock);
+            bool carried = true;
+            for (int o = 0; o < observer_count; ++o) {
+                carried = observers[o]->settingChanged(field, changes[c].channel, proposed) && carried;
+            }
+            if (carried) {
+                ++result.changed;
             } else {
-                ESP_LOGE("SettingsUpdate", "Failed to retrieve new value for %s", key.c_str());
+                xSemaphoreTake(values_lock, portMAX_DELAY);
+                copySetting(*this, current, field, changes[c].channel);
+                xSemaphoreGive(values_lock);
+                ++result.failed;
+                ESP_LOGW("SettingsManager", "%s on channel %d could not be applied", field.name, changes[c].channel);
             }
         }
+        if (result.changed > 0) {
+            save();
+        }
+        return result;
+    }
+
+    // Why `duty` could not be stored, or null. Handlers check with this
+    // before they send a duty to the pump.
+    static const char* checkDuty(float duty) {
+        return checkSettingRange(*findChannelSetting("duty"), duty);
+    }
+
+    // Store a value a handler has already sent to the pump, for the next
+    // boot. Checked against the schema like a patch, but the observers are
+    // not told, as the pump has the value already. Returns why it was
+    // refused, or null.
+    const char* storeDuty(int channel, float duty) {
+        const char* problem = checkChannelValue("duty", channel, duty);
+        if (problem == nullptr) {
+            xSemaphoreTake(values_lock, portMAX_DELAY);
+            channels[channel].duty = duty;
+            xSemaphoreGive(values_lock);
+            save();
+        }
+        return problem;
+    }
+
+    const char* storeFrequency(int channel, int frequency) {
+        const char* problem = checkChannelValue("frequency", channel, frequency);
+        if (problem == nullptr) {
+            xSemaphoreTake(values_lock, portMAX_DELAY);
+            channels[channel].frequency = frequency;
+            xSemaphoreGive(values_lock);
+            save();
+        }
+        return problem;
     }
 
-    // Specialized template to handle the bool `invert` field
-    void updateFieldIfChanged(JsonWrapper& json, const std::string& key, bool& field, SettingsManager::ChangeList& changes) {
-        if (json.ContainsField(key)) {
-            std::string newValueStr;
-            if (json.GetField(key, newValueStr)) {
-                bool newValue = (newValueStr == "true");
-                if (newValue != field) {
-                    field = newValue;
-                    changes.emplace_back(key, field ? "t" : "f");
+    // Takes a channel's values from the warm restart mirror. Not saved: the
+    // next save carries them.
+    void restoreChannel(int channel, const ChannelSettings& restored) {
+        xSemaphoreTake(values_lock, portMAX_DELAY);
+        channels[channel] = restored;
+        xSemaphoreGive(values_lock);
+    }
+
+    // Schedules the current settings to be written as one blob. Saves that
+    // arrive before the write collapse into it. The write runs once no save
+    // has arrived for the quiet period, and at the latest the max delay
+    // after the first pending save.
+    void save() {
+        xSemaphoreTake(pending_lock, portMAX_DELAY);
+        ++stats.requested;
+        if (dirty) {
+            ++stats.avoided;
+        } else {
+            dirty = true;
+            first_pending_us = esp_timer_get_time();
+        }
+        int64_t waited_us = esp_timer_get_time() - first_pending_us;
+        int64_t max_us = static_cast<int64_t>(CONFIG_SETTINGS_FLUSH_MAX_DELAY_MS) * 1000;
+        int64_t delay_us = static_cast<int64_t>(CONFIG_SETTINGS_FLUSH_QUIET_MS) * 1000;
+        if (delay_us > max_us - waited_us) {
+            delay_us = max_us - waited_us > 0 ? max_us - waited_us : 0;
+        }
+        esp_timer_stop(flush_timer);
+        esp_timer_start_once(flush_timer, static_cast<uint64_t>(delay_us));
+        xSemaphoreGive(pending_lock);
+    }
+
+    // Writes pending settings now; called on shutdown and before OTA
+    void flush() {
+        xSemaphoreTake(flush_lock, portMAX_DELAY);
+        xSemaphoreTake(pending_lock, portMAX_DELAY);
+        bool write = dirty;
+        dirty = false;
+        esp_timer_stop(flush_timer);
+        xSemaphoreGive(pending_lock);
+
+        if (write) {
+            int64_t start = esp_timer_get_time();
+            esp_err_t err = writeBlob();
+            int64_t elapsed = esp_timer_get_time() - start;
+
+            xSemaphoreTake(pending_lock, portMAX_DELAY);
+            if (err == ESP_OK) {
+                ++stats.written;
+            } else {
+                // Pending again, so the timer, or the next flush on
+                // shutdown or OTA, retries it; a save since then has
+                // already armed the timer
+                ++stats.failed;
+                if (!dirty) {
+                    dirty = true;
+                    first_pending_us = esp_timer_get_time();
+                    esp_timer_stop(flush_timer);
+                    esp_timer_start_once(flush_timer, static_cast<uint64_t>(CONFIG_SETTINGS_FLUSH_QUIET_MS) * 1000);
                 }
+            }
+            ++stats.flushes;
+            stats.last_flush_us = elapsed;
+            if (elapsed > stats.max_flush_us) {
+                stats.max_flush_us = elapsed;
+            }
+            xSemaphoreGive(pending_lock);
+            if (err == ESP_OK) {
+                ESP_LOGI("SettingsManager", "Flushed settings in %lld us", static_cast<long long>(elapsed));
             } else {
-                ESP_LOGE("SettingsUpdate", "Failed to retrieve new value for %s", key.c_str());
+                ESP_LOGE("SettingsManager", "Settings flush failed after %lld us, will retry",
+                         static_cast<long long>(elapsed));
             }
         }
+        xSemaphoreGive(flush_lock);
+    }
+
+    PersistStats getPersistStats() {
+        xSemaphoreTake(pending_lock, portMAX_DELAY);
+        PersistStats copy = stats;
+        xSemaphoreGive(pending_lock);
+        return copy;
     }
+
+    // Programs and schedules are written straight away; they change rarely
+    // and are only worth keeping if they survive the next reset.
+    bool saveProgram(int channel, const PwmProgram& program) {
+        StoredListHeader header{program_blob_magic, program_blob_version, program.step_count, program.repeat, 0};
+        return writeList(channelKey("program", channel), header, program.steps, sizeof(ProgramStep));
+    }
+
+    bool loadProgram(int channel, PwmProgram& program) {
+        StoredListHeader header{};
+        PwmProgram loaded;
+        if (!readList(channelKey("program", channel), header, program_blob_magic, program_blob_version,
+                      loaded.steps, sizeof(ProgramStep), program_max_steps)) {
+            return false;
+        }
+        loaded.repeat = header.extra;
+        loaded.step_count = header.count;
+        if (validateProgram(loaded) != nullptr) {
+            return false;
+        }
+        program = loaded;
+        return true;
+    }
+
+    void clearProgram(int channel) {
+        eraseKey(channelKey("program", channel));
+    }
+
+    // An empty curve removes the stored one
+    bool saveCalibration(int channel, const CalibrationCurve& curve) {
+        if (curve.count == 0) {
+            eraseKey(channelKey("calib", channel));
+            return true;
+        }
+        StoredListHeader header{calibration_blob_magic, calibration_blob_version, curve.count, 0, 0};
+        return writeList(channelKey("calib", channel), header, curve.points, sizeof(CalibrationPoint));
+    }
+
+    bool loadCalibration(int channel, CalibrationCurve& curve) {
+        StoredListHeader header{};
+        CalibrationCurve loaded;
+        if (!readList(channelKey("calib", channel), header, calibration_blob_magic, calibration_blob_version,
+                      loaded.points, sizeof(CalibrationPoint), calibration_max_points)) {
+            return false;
+        }
+        loaded.count = header.count;
+        if (validateCalibration(loaded) != nullptr) {
+            return false;
+        }
+        curve = loaded;
+        return true;
+    }
+
+    bool saveSchedule(const DutySchedule& schedule) {
+        if (schedule.count == 0) {
+            eraseKey(schedule_blob_key);
+            return true;
+        }
+        StoredListHeader header{schedule_blob_magic, schedule_blob_version, schedule.count, 0, 0};
+        return writeList(schedule_blob_key, header, schedule.entries, sizeof(ScheduleEntry));
+    }
+
+    bool loadSchedule(DutySchedule& schedule) {
+        StoredListHeader header{};
+        DutySchedule loaded;
+        if (!readList(schedule_blob_key, header, schedule_blob_magic, schedule_blob_version,
+                      loaded.entries, sizeof(ScheduleEntry), schedule_max_entries)) {
+            return false;
+        }
+        loaded.count = header.count;
+        if (validateSchedule(loaded) != nullptr) {
+            return false;
+        }
+        schedule = loaded;
+        return true;
+    }
+
+private:
+    static SettingsPatch refuse(SettingsPatch& result, const char* key, const char* problem) {
+        result.ok = false;
+        snprintf(result.error, sizeof(result.error), "Invalid '%s': %s", key, problem);
+        return result;
+    }
+
+    static const char* checkChannelValue(const char* name, int channel, double value) {
+        if (channel < 0 || channel >= pwm_channel_count) {
+            return "no such channel";
+        }
+        return checkSettingRange(*findChannelSetting(name), value);
+    }
+
+    static uint32_t blobCrc(const SettingsBlob& blob) {
+        return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&blob), offsetof(SettingsBlob, crc));
+    }
+
+    static std::string legacyKeyName(const LegacyKey& key) {
+        return channelKey(settings_schema[key.field].name, key.channel);
+    }
+
+    // Whether namespace `ns` holds each found key with the value
+    // NvsStorageManager returns for it
+    bool holdsLegacyValues(const char* ns, const LegacyKey* found, int count) {
+        nvs_handle_t handle;
+        if (nvs_open(ns, NVS_READONLY, &handle) != ESP_OK) {
+            return false;
+        }
+        bool holds = true;
+        std::string expected;
+        std::string stored;
+        for (int i = 0; holds && i < count; ++i) {
+            std::string key = legacyKeyName(found[i]);
+            size_t length = 0;
+            holds = nvs.retrieve(key, expected) && nvs_get_str(handle, key.c_str(), nullptr, &length) == ESP_OK;
+            if (holds) {
+                stored.resize(length);
+                holds = nvs_get_str(handle, key.c_str(), stored.data(), &length) == ESP_OK
+                        && strcmp(stored.c_str(), expected.c_str()) == 0;
+            }
+        }
+        nvs_close(handle);
+        return holds;
+    }
+
+    // A blob written with another channel count only differs in the length
+    // of the channel array, so its magic, version and CRC still hold. The
+    // channels both counts have are loaded and `storedChannels` says how
+    // many the blob had.
+    bool loadBlob(int& storedChannels) {
+        nvs_handle_t handle;
+        if (nvs_open(settings_blob_namespace, NVS_READONLY, &handle) != ESP_OK) {
+            return false;
+        }
+        constexpr size_t header = offsetof(SettingsBlob, channels);
+        uint8_t buffer[header + settings_blob_max_channels * sizeof(StoredChannelSettings) + sizeof(uint32_t)];
+        size_t size = sizeof(buffer);
+        esp_err_t err = nvs_get_blob(handle, settings_blob_key, buffer, &size);
+        nvs_close(handle);
+        if (err != ESP_OK) {
+            if (err != ESP_ERR_NVS_NOT_FOUND) {
+                ESP_LOGW("SettingsManager", "Settings blob unreadable: %s", esp_err_to_name(err));
+            }
+            return false;
+        }
+
+        SettingsBlob blob{};
+        uint32_t crc = 0;
+        size_t channelBytes = 0;
+        if (size >= header + sizeof(crc)) {
+            memcpy(&blob, buffer, header);
+            memcpy(&crc, buffer + size - sizeof(crc), sizeof(crc));
+            channelBytes = size - header - sizeof(crc);
+        }
+        storedChannels = static_cast<int>(channelBytes / sizeof(StoredChannelSettings));
+        if (storedChannels == 0 || channelBytes % sizeof(StoredChannelSettings) != 0
+            || blob.magic != settings_blob_magic || blob.version != settings_blob_version
+            || crc != esp_rom_crc32_le(0, buffer, size - sizeof(crc))) {
+            ESP_LOGW("SettingsManager", "Settings blob rejected (size %u, version %u)",
+                     static_cast<unsigned>(size), blob.version);
+            return false;
+        }
+
+        int common = storedChannels < pwm_channel_count ? storedChannels : pwm_channel_count;
+        memcpy(blob.channels, buffer + header, common * sizeof(StoredChannelSettings));
+        for (const SettingField& field : settings_schema) {
+            int channels = field.per_channel ? common : 1;
+            for (int i = 0; i < channels; ++i) {
+                loadSetting(*this, blob, field, i);
+            }
+        }
+        return true;
+    }
+
+    // The blob is built under values_lock and written outside it, so a
+    // slow commit never holds up the writers
+    esp_err_t writeBlob() {
+        SettingsBlob blob{};
+        blob.magic = settings_blob_magic;
+        blob.version = settings_blob_version;
+        xSemaphoreTake(values_lock, portMAX_DELAY);
+        for (const SettingField& field : settings_schema) {
+            int channels = field.per_channel ? pwm_channel_count : 1;
+            for (int i = 0; i < channels; ++i) {
+                storeSetting(blob, *this, field, i);
+            }
+        }
+        xSemaphoreGive(values_lock);
+        blob.crc = blobCrc(blob);
+
+        int64_t start = esp_timer_get_time();
+        nvs_handle_t handle;
+        esp_err_t err = nvs_open(settings_blob_namespace, NVS_READWRITE, &handle);
+        if (err == ESP_OK) {
+            err = nvs_set_blob(handle, settings_blob_key, &blob, sizeof(blob));
+            if (err == ESP_OK) {
+                err = nvs_commit(handle);
+            }
+            nvs_close(handle);
+        }
+        Metrics::recordNvsWrite(esp_timer_get_time() - start, err == ESP_OK);
+        if (err != ESP_OK) {
+            ESP_LOGE("SettingsManager", "Failed to write settings blob: %s", esp_err_to_name(err));
+        }
+        return err;
+    }
+
+    bool writeList(const std::string& key, const StoredListHeader& header, const void* items, size_t itemSize) {
+        uint8_t buffer[sizeof(StoredListHeader) + max_list_bytes + sizeof(uint32_t)];
+        size_t itemBytes = header.count * itemSize;
+        if (itemBytes > max_list_bytes) {
+            return false;
+        }
+        memcpy(buffer, &header, sizeof(header));
+        memcpy(buffer + sizeof(header), items, itemBytes);
+        uint32_t crc = esp_rom_crc32_le(0, buffer, sizeof(header) + itemBytes);
+        memcpy(buffer + sizeof(header) + itemBytes, &crc, sizeof(crc));
+
+        int64_t start = esp_timer_get_time();
+        nvs_handle_t handle;
+        esp_err_t err = nvs_open(settings_blob_namespace, NVS_READWRITE, &handle);
+        if (err == ESP_OK) {
+            err = nvs_set_blob(handle, key.c_str(), buffer, sizeof(header) + itemBytes + sizeof(crc));
+            if (err == ESP_OK) {
+                err = nvs_commit(handle);
+            }
+            nvs_close(handle);
+        }
+        Metrics::recordNvsWrite(esp_timer_get_time() - start, err == ESP_OK);
+        if (err != ESP_OK) {
+            ESP_LOGE("SettingsManager", "Failed to store %s: %s", key.c_str(), esp_err_to_name(err));
+        }
+        return err == ESP_OK;
+    }
+
+    // Reads a list written by writeList into `items` (room for maxItems)
+    bool readList(const std::string& key, StoredListHeader& header, uint16_t magic, uint8_t version,
+                  void* items, size_t itemSize, size_t maxItems) {
+        nvs_handle_t handle;
+        if (nvs_open(settings_blob_namespace, NVS_READONLY, &handle) != ESP_OK) {
+            return false;
+        }
+        uint8_t buffer[sizeof(StoredListHeader) + max_list_bytes + sizeof(uint32_t)];
+        size_t size = sizeof(buffer);
+        esp_err_t err = nvs_get_blob(handle, key.c_str(), buffer, &size);
+        nvs_close(handle);
+        if (err != ESP_OK) {
+            return false;
+        }
+
+        uint32_t crc = 0;
+        if (size >= sizeof(header) + sizeof(crc)) {
+            memcpy(&header, buffer, sizeof(header));
+            memcpy(&crc, buffer + size - sizeof(crc), sizeof(crc));
+        }
+        size_t itemBytes = header.count * itemSize;
+        if (header.magic != magic || header.version != version || header.count > maxItems
+            || size != sizeof(header) + itemBytes + sizeof(crc)
+            || crc != esp_rom_crc32_le(0, buffer, sizeof(header) + itemBytes)) {
+            ESP_LOGW("SettingsManager", "Stored %s rejected", key.c_str());
+            return false;
+        }
+        memcpy(items, buffer + sizeof(header), itemBytes);
+        return true;
+    }
+
+    void eraseKey(const std::string& key) {
+        nvs_handle_t handle;
+        if (nvs_open(settings_blob_namespace, NVS_READWRITE, &handle) != ESP_OK) {
+            return;
+        }
+        if (nvs_erase_key(handle, key.c_str()) == ESP_OK) {
+            nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    void initializeWriteBehind() {
+        pending_lock = xSemaphoreCreateMutexStatic(&pending_lock_buffer);
+        flush_lock = xSemaphoreCreateMutexStatic(&flush_lock_buffer);
+
+        esp_timer_create_args_t timer_args{};
+        timer_args.callback = [](void* arg) {
+            xTaskNotifyGive(static_cast<SettingsManager*>(arg)->flush_task);
+        };
+        timer_args.arg = this;
+        timer_args.dispatch_method = ESP_TIMER_TASK;
+        timer_args.name = "settings_flush";
+        if (esp_timer_create(&timer_args, &flush_timer) != ESP_OK) {
+            ESP_LOGE("SettingsManager", "Failed to create flush timer.");
+        }
+
+        // NVS commits can take tens of milliseconds, so they run in their own
+        // low priority task rather than holding up the esp_timer task.
+        flush_task = xTaskCreateStatic(flushTask, "settings_flush", settings_flush_stack, this, 2,
+                                       flush_stack, &flush_task_buffer);
+
+        instance = this;
+        esp_register_shutdown_handler([] {
+            if (instance) {
+                instance->flush();
+            }
+        });
+    }
+
+    static void flushTask(void* pvParameter) {
+        SettingsManager* settings = static_cast<SettingsManager*>(pvParameter);
+        for (;;) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            settings->flush();
+        }
+    }
+
+    SemaphoreHandle_t values_lock = nullptr;
+    SemaphoreHandle_t pending_lock = nullptr;
+    SemaphoreHandle_t flush_lock = nullptr;
+    esp_timer_handle_t flush_timer = nullptr;
+    TaskHandle_t flush_task = nullptr;
+    StaticSemaphore_t values_lock_buffer;
+    StaticSemaphore_t pending_lock_buffer;
+    StaticSemaphore_t flush_lock_buffer;
+    StaticTask_t flush_task_buffer;
+    StackType_t flush_stack[settings_flush_stack];
+    bool dirty = false;
+    int64_t first_pending_us = 0;
+    PersistStats stats;
+    SettingsObserver* observers[MAX_OBSERVERS] = {};
+    int observer_count = 0;
+    static inline SettingsManager* instance = nullptr;
+
+    static constexpr size_t max_list_bytes = sizeof(PwmProgram::steps) > sizeof(DutySchedule::entries)
+                                                 ? sizeof(PwmProgram::steps) : sizeof(DutySchedule::entries);
 };
 
@@ -0,0 +1,405 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "sdkconfig.h"
+
+#include "FixedString.h"
+#include "FlatJson.h"
+
+inline constexpr int pwm_channel_count = CONFIG_PWM_CHANNEL_COUNT;
+
+// Signal settings of one PWM output
+struct ChannelSettings {
+    int frequency = 1000;
+    float duty = 10;
+    bool invert = false;
+};
+
+// One channel as it is laid out in the settings blob
+struct StoredChannelSettings {
+    int32_t frequency;
+    float duty;
+    uint8_t invert;
+};
+
+// On-flash layout of all settings, written as one NVS blob. Bump
+// settings_blob_version when the layout changes; a blob with another
+// version is ignored and the legacy string keys are migrated. The channels
+// come last before the CRC, so a blob written with another channel count
+// differs only in length and is read by SettingsManager::loadBlob.
+struct SettingsBlob {
+    uint16_t magic;
+    uint16_t version;
+    char tz[64];
+    char ntpServer[64];
+    char otaUrl[128];
+    StoredChannelSettings channels[pwm_channel_count];
+    uint32_t crc;   // CRC32 of everything before this field
+};
+
+// Every value settings_schema describes. SettingsManager holds the live
+// set; a patch checks its changes against a copy first.
+struct SettingsValues {
+    // Sized to the blob, so whatever is held can be stored
+    FixedString<sizeof(SettingsBlob::tz)> tz = "AEST-10AEDT,M10.1.0,M4.1.0/3";
+    FixedString<sizeof(SettingsBlob::ntpServer)> ntpServer = "time.google.com";
+    FixedString<sizeof(SettingsBlob::otaUrl)> otaUrl = "http://ota.mianos.com";
+    std::array<ChannelSettings, pwm_channel_count> channels{};
+};
+
+enum class SettingId : uint8_t {
+    Tz,
+    NtpServer,
+    OtaUrl,
+    Frequency,
+    Duty,
+    Invert,
+};
+
+enum class SettingType : uint8_t {
+    Text,
+    Int,
+    Float,
+    Bool,
+};
+
+// Where one setting lives and what it may hold. Per-channel offsets are
+// within ChannelSettings and StoredChannelSettings.
+struct SettingField {
+    SettingId id;
+    const char* name;       // channel n > 0 appends n, as SettingsManager::channelKey does
+    SettingType type;
+    bool per_channel;
+    double min;             // inclusive range of Int and Float values
+    double max;
+    size_t offset;          // in SettingsValues
+    size_t stored_offset;   // in SettingsBlob
+    size_t size;            // of the value; Text includes the terminator
+};
+
+// Load, store, JSON output and patching all walk this table, so a new
+// setting is one row here plus its members above.
+inline constexpr SettingField settings_schema[] = {
+    {SettingId::Tz, "tz", SettingType::Text, false, 0, 0,
+     offsetof(SettingsValues, tz), offsetof(SettingsBlob, tz), sizeof(SettingsBlob::tz)},
+    {SettingId::NtpServer, "ntpServer", SettingType::Text, false, 0, 0,
+     offsetof(SettingsValues, ntpServer), offsetof(SettingsBlob, ntpServer), sizeof(SettingsBlob::ntpServer)},
+    {SettingId::OtaUrl, "otaUrl", SettingType::Text, false, 0, 0,
+     offsetof(SettingsValues, otaUrl), offsetof(SettingsBlob, otaUrl), sizeof(SettingsBlob::otaUrl)},
+    {SettingId::Frequency, "frequency", SettingType::Int, true, 1, 40000000,
+     offsetof(ChannelSettings, frequency), offsetof(StoredChannelSettings, frequency), sizeof(int)},
+    {SettingId::Duty, "duty", SettingType::Float, true, 0, 100,
+     offsetof(ChannelSettings, duty), offsetof(StoredChannelSettings, duty), sizeof(float)},
+    {SettingId::Invert, "invert", SettingType::Bool, true, 0, 1,
+     offsetof(ChannelSettings, invert), offsetof(StoredChannelSettings, invert), sizeof(bool)},
+};
+
+inline constexpr size_t settings_field_max_size = sizeof(SettingsBlob::otaUrl);
+
+static_assert(sizeof(SettingsValues::tz) == sizeof(SettingsBlob::tz)
+              && sizeof(SettingsValues::ntpServer) == sizeof(SettingsBlob::ntpServer)
+              && sizeof(SettingsValues::otaUrl) == sizeof(SettingsBlob::otaUrl),
+              "text settings are copied byte for byte to and from the blob");
+static_assert(sizeof(int) == sizeof(int32_t), "frequency is stored as int32_t");
+
+// Told about the changes a SettingsManager patch makes, so they reach the
+// hardware. checkSetting can refuse a value that is within the schema's
+// range but cannot be produced; settingChanged carries a committed change
+// out and returns false if it cannot right now (the queue is full, say),
+// in which case the old value is put back.
+class SettingsObserver {
+public:
+    virtual ~SettingsObserver() = default;
+
+    virtual const char* checkSetting(const SettingField& field, int channel, const SettingsValues& proposed) {
+        return nullptr;
+    }
+
+    virtual bool settingChanged(const SettingField& field, int channel, const SettingsValues& values) = 0;
+};
+
+// Resolves a key such as "tz", "duty" or "frequency2". Null if no field
+// or channel matches.
+inline const SettingField* findSetting(const char* key, int& channel) {
+    for (const SettingField& field : settings_schema) {
+        size_t len = strlen(field.name);
+        if (strncmp(key, field.name, len) != 0) {
+            continue;
+        }
+        const char* suffix = key + len;
+        if (*suffix == '\0') {
+            channel = 0;
+            return &field;
+        }
+        if (!field.per_channel || *suffix < '1' || *suffix > '9') {
+            continue;
+        }
+        char* end = nullptr;
+        long n = strtol(suffix, &end, 10);
+        if (*end == '\0' && n < pwm_channel_count) {
+            channel = static_cast<int>(n);
+            return &field;
+        }
+    }
+    return nullptr;
+}
+
+// A per-channel field by its plain name, as /signal takes them
+inline const SettingField* findChannelSetting(const char* key) {
+    for (const SettingField& field : settings_schema) {
+        if (field.per_channel && strcmp(key, field.name) == 0) {
+            return &field;
+        }
+    }
+    return nullptr;
+}
+
+inline size_t formatSettingKey(char* out, size_t size, const SettingField& field, int channel) {
+    int len = channel == 0 ? snprintf(out, size, "%s", field.name) : snprintf(out, size, "%s%d", field.name, channel);
+    return len < 0 ? 0 : static_cast<size_t>(len);
+}
+
+inline void* settingAddress(SettingsValues& values, const SettingField& field, int channel) {
+    char* base = field.per_channel ? reinterpret_cast<char*>(&values.channels[channel])
+                                   : reinterpret_cast<char*>(&values);
+    return base + field.offset;
+}
+
+inline const void* settingAddress(const SettingsValues& values, const SettingField& field, int channel) {
+    return settingAddress(const_cast<SettingsValues&>(values), field, channel);
+}
+
+inline void* storedAddress(SettingsBlob& blob, const SettingField& field, int channel) {
+    char* base = field.per_channel ? reinterpret_cast<char*>(&blob.channels[channel])
+                                   : reinterpret_cast<char*>(&blob);
+    return base + field.stored_offset;
+}
+
+// Text settings are FixedStrings, whose characters start at their address
+inline bool settingEquals(const SettingsValues& a, const SettingsValues& b, const SettingField& field, int channel) {
+    const void* x = settingAddress(a, field, channel);
+    const void* y = settingAddress(b, field, channel);
+    switch (field.type) {
+    case SettingType::Text:
+        return strcmp(static_cast<const char*>(x), static_cast<const char*>(y)) == 0;
+    case SettingType::Int:
+        return *static_cast<const int*>(x) == *static_cast<const int*>(y);
+    case SettingType::Float:
+        return *static_cast<const float*>(x) == *static_cast<const float*>(y);
+    case SettingType::Bool:
+        return *static_cast<const bool*>(x) == *static_cast<const bool*>(y);
+    }
+    return false;
+}
+
+inline void copySetting(SettingsValues& to, const SettingsValues& from, const SettingField& field, int channel) {
+    memcpy(settingAddress(to, field, channel), settingAddress(from, field, channel), field.size);
+}
+
+inline void storeSetting(SettingsBlob& blob, const SettingsValues& values, const SettingField& field, int channel) {
+    const void* value = settingAddress(values, field, channel);
+    void* stored = storedAddress(blob, field, channel);
+    if (field.type == SettingType::Bool) {
+        *static_cast<uint8_t*>(stored) = *static_cast<const bool*>(value) ? 1 : 0;
+    } else {
+        memcpy(stored, value, field.size);
+    }
+}
+
+inline void loadSetting(SettingsValues& values, const SettingsBlob& blob, const SettingField& field, int channel) {
+    void* value = settingAddress(values, field, channel);
+    const void* stored = storedAddress(const_cast<SettingsBlob&>(blob), field, channel);
+    if (field.type == SettingType::Bool) {
+        *static_cast<bool*>(value) = *static_cast<const uint8_t*>(stored) != 0;
+    } else {
+        memcpy(value, stored, field.size);
+        if (field.type == SettingType::Text) {
+            static_cast<char*>(value)[field.size - 1] = '\0';
+        }
+    }
+}
+
+// Parses a string written by firmware that stored each setting under its
+// own NVS key. Both "t" and "true" were written for booleans.
+inline bool parseLegacySetting(SettingsValues& values, const char* text, const SettingField& field, int channel) {
+    void* value = settingAddress(values, field, channel);
+    char* end = nullptr;
+    switch (field.type) {
+    case SettingType::Text: {
+        size_t len = strlen(text);
+        if (len >= field.size) {
+            return false;
+        }
+        memcpy(value, text, len + 1);
+        return true;
+    }
+    case SettingType::Int: {
+        long number = strtol(text, &end, 10);
+        if (end == text) {
+            return false;
+        }
+        *static_cast<int*>(value) = static_cast<int>(number);
+        return true;
+    }
+    case SettingType::Float: {
+        float number = strtof(text, &end);
+        if (end == text) {
+            return false;
+        }
+        *static_cast<float*>(value) = number;
+        return true;
+    }
+    case SettingType::Bool:
+        *static_cast<bool*>(value) = strcmp(text, "t") == 0 || strcmp(text, "true") == 0;
+        return true;
+    }
+    return false;
+}
+
+// Range check of an Int or Float value; null if it is within the field's
+// limits
+inline const char* checkSettingRange(const SettingField& field, double value) {
+    if (value < field.min || value > field.max) {
+        return "out of range";
+    }
+    return nullptr;
+}
+
+// Reads `key` from `json` into `values`, within the field's range. Returns
+// why the value was refused, or null.
+inline const char* readSetting(const FlatJson& json, const char* key, SettingsValues& values,
+                               const SettingField& field, int channel) {
+    void* value = settingAddress(values, field, channel);
+    switch (field.type) {
+    case SettingType::Text: {
+        const char* text = nullptr;
+        if (!json.getString(key, text)) {
+            return "expected a string";
+        }
+        size_t len = strlen(text);
+        if (len >= field.size) {
+            return "too long";
+        }
+        memcpy(value, text, len + 1);
+        return nullptr;
+    }
+    case SettingType::Int: {
+        int number = 0;
+        if (!json.getInt(key, number)) {
+            return "expected an integer";
+        }
+        if (const char* problem = checkSettingRange(field, number)) {
+            return problem;
+        }
+        *static_cast<int*>(value) = number;
+        return nullptr;
+    }
+    case SettingType::Float: {
+        float number = 0.0f;
+        if (!json.getFloat(key, number)) {
+            return "expected a number";
+        }
+        if (const char* problem = checkSettingRange(field, number)) {
+            return problem;
+        }
+        *static_cast<float*>(value) = number;
+        return nullptr;
+    }
+    case SettingType::Bool: {
+        bool flag = false;
+        if (!json.getBool(key, flag)) {
+            return "expected true or false";
+        }
+        *static_cast<bool*>(value) = flag;
+        return nullptr;
+    }
+    }
+    return "unsupported type";
+}
+
+// Appends `"key":value` to out[len..size). Returns the new length, or
+// `size` once it no longer fits.
+inline size_t appendSettingJson(char* out, size_t size, size_t len, const SettingsValues& values,
+                                const SettingField& field, int channel) {
+    char key[24];
+    formatSettingKey(key, sizeof(key), field, channel);
+    const void* value = settingAddress(values, field, channel);
+    int written = 0;
+    switch (field.type) {
+    case SettingType::Text: {
+        written = snprintf(out + len, size - len, "\"%s\":\"", key);
+        if (written < 0 || static_cast<size_t>(written) >= size - len) {
+            return size;
+        }
+        len += written;
+        for (const char* p = static_cast<const char*>(value); *p != '\0'; ++p) {
+            unsigned char c = static_cast<unsigned char>(*p);
+            if (c == '"' || c == '\\') {
+                written = snprintf(out + len, size - len, "\\%c", c);
+            } else if (c < 0x20) {
+                written = snprintf(out + len, size - len, "\\u%04x", c);
+            } else {
+                written = snprintf(out + len, size - len, "%c", c);
+            }
+            if (written < 0 || static_cast<size_t>(written) >= size - len) {
+                return size;
+            }
+            len += written;
+        }
+        written = snprintf(out + len, size - len, "\"");
+        break;
+    }
+    case SettingType::Int:
+        written = snprintf(out + len, size - len, "\"%s\":%d", key, *static_cast<const int*>(value));
+        break;
+    case SettingType::Float:
+        written = snprintf(out + len, size - len, "\"%s\":%g", key, static_cast<double>(*static_cast<const float*>(value)));
+        break;
+    case SettingType::Bool:
+        written = snprintf(out + len, size - len, "\"%s\":%s", key, *static_cast<const bool*>(value) ? "true" : "false");
+        break;
+    }
+    if (written < 0 || static_cast<size_t>(written) >= size - len) {
+        return size;
+    }
+    return len + written;
+}
+
+// Every setting as one JSON object with native value types. Returns its
+// length, or 0 if it does not fit in `size`.
+inline size_t formatSettingsJson(char* out, size_t size, const SettingsValues& values) {
+    if (size < 3) {
+        return 0;
+    }
+    size_t len = 0;
+    out[len++] = '{';
+    bool first = true;
+    for (const SettingField& field : settings_schema) {
+        int channels = field.per_channel ? pwm_channel_count : 1;
+        for (int channel = 0; channel < channels; ++channel) {
+            if (!first) {
+                if (len + 1 >= size) {
+                    return 0;
+                }
+                out[len++] = ',';
+            }
+            first = false;
+            len = appendSettingJson(out, size, len, values, field, channel);
+            if (len >= size) {
+                return 0;
+            }
+        }
+    }
+    if (len + 1 >= size) {
+        return 0;
+    }
+    out[len++] = '}';
+    out[len] = '\0';
+    return len;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "MemoryBudget.h"
+#include "PWMControl.h"
+#include "PidController.h"
+#include "SeqLock.h"
+#include "Tachometer.h"
+#include "TaskConfig.h"
+
+struct SpeedControlConfig {
+    int channel = 0;
+    int tach_gpio = -1;
+    int pulses_per_rev = 2;
+    int period_ms = 50;
+    int window_ms = 250;        // tach counts are averaged over this long
+    PidGains gains{};
+};
+
+// Published once per control period
+struct SpeedStatus {
+    bool active;                // closed loop driving the duty
+    float target_rpm;
+    float rpm;
+    float duty;
+    uint32_t iterations;
+    uint32_t overruns;          // periods that started a whole period late
+    int32_t period_us;          // last measured period
+    int32_t max_jitter_us;      // worst deviation from the nominal period
+    int32_t compute_us;         // last measure + PID + post time
+    int32_t max_compute_us;
+};
+
+// Fixed-rate loop that measures pump speed from a tach line and drives the
+// channel's duty through PWMControl's setpoint mailbox to hold a target
+// RPM. A target of 0 hands the channel back to open-loop control.
+class SpeedController {
+public:
+    static const int MAX_WINDOW_SAMPLES = 32;
+
+    SpeedController(PWMControl& pump, const SpeedControlConfig& config)
+        : pump(pump), config(config), pid(config.gains) {
+        loop_lock = xSemaphoreCreateMutexStatic(&loop_lock_buffer);
+        window_samples = config.window_ms / config.period_ms;
+        if (window_samples < 1) {
+            window_samples = 1;
+        } else if (window_samples > MAX_WINDOW_SAMPLES) {
+            window_samples = MAX_WINDOW_SAMPLES;
+        }
+        if (!tach.begin(config.tach_gpio)) {
+            ESP_LOGE("SpeedController", "No tach input, speed control disabled.");
+            return;
+        }
+        // Above the duty task, so periods stay regular
+        xTaskCreateStaticPinnedToCore(controlTask, "speed_ctrl", speed_task_stack, this, speed_task_priority,
+                                      stack, &task_buffer, control_task_core);
+    }
+
+    int channel() const {
+        return config.channel;
+    }
+
+    // 0 stops closed-loop control and leaves the duty where it is. The loop
+    // reads the target and posts its duty under loop_lock, so once this
+    // returns any duty it computed for the old target has been posted, and
+    // a duty the caller posts next is not overwritten.
+    void setTarget(float rpm) {
+        xSemaphoreTake(loop_lock, portMAX_DELAY);
+        target_rpm.store(rpm > 0.0f ? rpm : 0.0f);
+        xSemaphoreGive(loop_lock);
+    }
+
+    float getTarget() const {
+        return target_rpm.load();
+    }
+
+    SpeedStatus getStatus() const {
+        return status.read();
+    }
+
+private:
+    static void controlTask(void* pvParameter) {
+        static_cast<SpeedController*>(pvParameter)->run();
+    }
+
+    void run() {
+        const TickType_t period = pdMS_TO_TICKS(config.period_ms) > 0 ? pdMS_TO_TICKS(config.period_ms) : 1;
+        const int64_t nominal_us = static_cast<int64_t>(period) * portTICK_PERIOD_MS * 1000;
+        const float dt = nominal_us / 1e6f;
+        uint32_t counts[MAX_WINDOW_SAMPLES];
+        uint32_t first = tach.count();
+        for (int i = 0; i < window_samples; ++i) {
+            counts[i] = first;
+        }
+        int slot = 0;
+        bool wasActive = false;
+        float lastDuty = -1.0f;
+        SpeedStatus current{};
+        int64_t last_wake = esp_timer_get_time();
+        TickType_t wake = xTaskGetTickCount();
+
+        for (;;) {
+            vTaskDelayUntil(&wake, period);
+            int64_t start = esp_timer_get_time();
+            int32_t elapsed = static_cast<int32_t>(start - last_wake);
+            last_wake = start;
+
+            // Pulses over the window, oldest sample against the newest
+            uint32_t now_count = tach.count();
+            uint32_t pulses = now_count - counts[slot];
+            counts[slot] = now_count;
+            slot = (slot + 1) % window_samples;
+            float window_s = dt * window_samples;
+            float rpm = pulses * 60.0f / (config.pulses_per_rev * window_s);
+
+            xSemaphoreTake(loop_lock, portMAX_DELAY);
+            float target = target_rpm.load();
+            bool active = target > 0.0f;
+            float duty = pump.getState(config.channel).duty;
+            if (active) {
+                if (!wasActive) {
+                    // Take over from the current duty without a bump
+                    pid.reset(duty, rpm);
+                    lastDuty = duty;
+                }
+                float output = pid.update(target, rpm, dt);
+                // Sub-resolution changes would only churn the mailbox
+                if (std::fabs(output - lastDuty) >= 0.05f) {
+                    pump.setDutyCyclePercentage(config.channel, output);
+                    lastDuty = output;
+                }
+                duty = output;
+            }
+            xSemaphoreGive(loop_lock);
+            wasActive = active;
+
+            int32_t compute = static_cast<int32_t>(esp_timer_get_time() - start);
+            int32_t jitter = static_cast<int32_t>(std::abs(elapsed - nominal_us));
+            current.active = active;
+            current.target_rpm = target;
+            current.rpm = rpm;
+            current.duty = duty;
+            ++current.iterations;
+            if (elapsed >= 2 * nominal_us) {
+                ++current.overruns;
+            }
+            current.period_us = elapsed;
+            if (current.iterations > 1 && jitter > current.max_jitter_us) {
+                current.max_jitter_us = jitter;
+            }
+            current.compute_us = compute;
+            if (compute > current.max_compute_us) {
+                current.max_compute_us = compute;
+            }
+            status.write(current);
+        }
+    }
+
+    PWMControl& pump;
+    SpeedControlConfig config;
+    PidController pid;          // owned by the control task
+    Tachometer tach;
+    int window_samples = 1;
+
+    std::atomic<float> target_rpm{0.0f};
+    SeqLock<SpeedStatus> status;
+    SemaphoreHandle_t loop_lock = nullptr;
+    StaticSemaphore_t loop_lock_buffer;
+
+    StaticTask_t task_buffer;
+    StackType_t stack[speed_task_stack];
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+#include "driver/gpio.h"
+#include "driver/pulse_cnt.h"
+#include "esp_log.h"
+
+// Counts tach pulses with a PCNT unit. The hardware counter is 16 bits;
+// accum_count extends it in the driver, so count() keeps rising for as
+// long as the pump runs and callers work with differences.
+class Tachometer {
+public:
+    static const int COUNTER_LIMIT = 30000;
+    static const int GLITCH_FILTER_NS = 1000;
+
+    bool begin(int gpio_num) {
+        pcnt_unit_config_t unit_config{};
+        unit_config.low_limit = -1;
+        unit_config.high_limit = COUNTER_LIMIT;
+        unit_config.flags.accum_count = 1;
+        esp_err_t err = pcnt_new_unit(&unit_config, &unit);
+        if (err != ESP_OK) {
+            ESP_LOGE("Tachometer", "Failed to create PCNT unit: %s", esp_err_to_name(err));
+            return false;
+        }
+
+        // Tach outputs are open collector and ring on long leads
+        pcnt_glitch_filter_config_t filter_config{};
+        filter_config.max_glitch_ns = GLITCH_FILTER_NS;
+        pcnt_unit_set_glitch_filter(unit, &filter_config);
+
+        pcnt_chan_config_t channel_config{};
+        channel_config.edge_gpio_num = gpio_num;
+        channel_config.level_gpio_num = -1;
+        pcnt_channel_handle_t channel = nullptr;
+        err = pcnt_new_channel(unit, &channel_config, &channel);
+        if (err != ESP_OK) {
+            ESP_LOGE("Tachometer", "Failed to create PCNT channel: %s", esp_err_to_name(err));
+            return false;
+        }
+        pcnt_channel_set_edge_action(channel, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_HOLD);
+        gpio_set_pull_mode(static_cast<gpio_num_t>(gpio_num), GPIO_PULLUP_ONLY);
+
+        // accum_count only carries over at a watch point
+        pcnt_unit_add_watch_point(unit, COUNTER_LIMIT);
+        if (pcnt_unit_enable(unit) != ESP_OK || pcnt_unit_clear_count(unit) != ESP_OK
+            || pcnt_unit_start(unit) != ESP_OK) {
+            ESP_LOGE("Tachometer", "Failed to start PCNT unit.");
+            return false;
+        }
+        return true;
+    }
+
+    // Rising edges seen so far
+    uint32_t count() const {
+        int value = 0;
+        if (unit == nullptr || pcnt_unit_get_count(unit, &value) != ESP_OK) {
+            return 0;
+        }
+        return static_cast<uint32_t>(value);
+    }
+
+private:
+    pcnt_unit_handle_t unit = nullptr;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+// Where the control path runs, from menuconfig. IDF's own tasks for
+// reference: httpd 5, lwIP 18, esp_timer 22, Wi-Fi 23.
+#if CONFIG_FREERTOS_UNICORE
+inline constexpr BaseType_t control_task_core = tskNO_AFFINITY;
+#else
+inline constexpr BaseType_t control_task_core = CONFIG_CONTROL_TASK_CORE < 0 ? tskNO_AFFINITY : CONFIG_CONTROL_TASK_CORE;
+#endif
+
+inline constexpr UBaseType_t duty_task_priority = CONFIG_DUTY_TASK_PRIORITY;
+inline constexpr UBaseType_t schedule_task_priority = CONFIG_SCHEDULE_TASK_PRIORITY;
+inline constexpr UBaseType_t button_task_priority = CONFIG_BUTTON_TASK_PRIORITY;
+#if CONFIG_SPEED_CONTROL
+inline constexpr UBaseType_t speed_task_priority = CONFIG_SPEED_TASK_PRIORITY;
+#else
+inline constexpr UBaseType_t speed_task_priority = duty_task_priority + 1;   // no speed task is created
+#endif
+
+// The core as a number for reports; -1 when the tasks float
+inline constexpr int controlTaskCoreId() {
+    return control_task_core == tskNO_AFFINITY ? -1 : static_cast<int>(control_task_core);
+}
@@ -5,16 +5,29 @@
 
 #include "sdkconfig.h"
 
-#include "Button.h"
+#include "ButtonWatcher.h"
 #include "WifiManager.h"
 #include "SettingsManager.h"
 #include "Ota.h"
+#include "OtaService.h"
 #include "LocalWebServer.h"
 #include "PWMControl.h"
+#include "Scheduler.h"
+#include "SpeedController.h"
+#include "BootTimeline.h"
+#include "MemoryBudget.h"
+#include "TaskConfig.h"
 
 static const char *TAG = "npc";
 
 static SemaphoreHandle_t wifiSemaphore;
+static const int MEMORY_BUDGET_DELAY_MS = 60000;
+
+// Memory the control path reserves at build time; raising it is a decision,
+// not an accident
+static const size_t CONTROL_PATH_RAM_BUDGET = 24 * 1024;
+static_assert(sizeof(PWMControl) + sizeof(SettingsManager) + sizeof(Scheduler) <= CONTROL_PATH_RAM_BUDGET,
+              "control path static RAM is over budget");
 
 static void localEventHandler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
     if (event_id == IP_EVENT_STA_GOT_IP) {
@@ -24,10 +37,9 @@ static void localEventHandler(void* arg, esp_event_base_t event_base, int32_t ev
 
 
 void initialize_sntp(SettingsManager& settings) {
-	setenv("TZ", settings.tz.c_str(), 1);
-	tzset();
     esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
     esp_sntp_setservername(0, settings.ntpServer.c_str());
+    sntp_set_time_sync_notification_cb(Scheduler::onTimeSync);
     esp_sntp_init();
     ESP_LOGI(TAG, "SNTP service initialized");
     int max_retry = 200;
@@ -38,6 +50,7 @@ void initialize_sntp(SettingsManager& settings) {
         ESP_LOGE(TAG, "Failed to synchronize NTP time");
         return; // Exit if unable to sync
     }
+    BootTimeline::mark(BootPhase::TimeSynced);
     time_t now = time(nullptr);
     struct tm timeinfo;
     localtime_r(&now, &timeinfo);
@@ -47,50 +60,95 @@ void initialize_sntp(SettingsManager& settings) {
 }
 
 
-void button_task(void *pvParameters) {
-	WiFiManager *wifiManager = static_cast<WiFiManager*>(pvParameters);  // Cast the void pointer back to WiFiManager pointer
+// Waits for the first NTP sync off the main path so the web server does
+// not sit behind it.
+void sntp_task(void *pvParameters) {
+	initialize_sntp(*static_cast<SettingsManager*>(pvParameters));
+	vTaskDelete(nullptr);
+}
 
-    Button button(static_cast<gpio_num_t>(CONFIG_BUTTON_PIN));
-    while (1) {
-        if (button.longPressed()) {
-            ESP_LOGI("BUTTON", "Long press detected, resetting WiFi settings.");
-            wifiManager->clear();
-        }
-        vTaskDelay(pdMS_TO_TICKS(100)); // Check every 100 ms
-    }
+
+static void onLongPress(void* arg) {
+	ESP_LOGI("BUTTON", "Long press detected, resetting WiFi settings.");
+	static_cast<WiFiManager*>(arg)->clear();
 }
 
 
 extern "C" void app_main() {
-	NvsStorageManager nv;
-	SettingsManager settings(nv);
+	BootTimeline::mark(BootPhase::AppMain);
+	ESP_LOGI(TAG, "Control path static RAM: pump %u, settings %u, scheduler %u of %u bytes",
+			 static_cast<unsigned>(sizeof(PWMControl)), static_cast<unsigned>(sizeof(SettingsManager)),
+			 static_cast<unsigned>(sizeof(Scheduler)), static_cast<unsigned>(CONTROL_PATH_RAM_BUDGET));
+	ESP_LOGI(TAG, "Control tasks on core %d, duty priority %u", controlTaskCoreId(),
+			 static_cast<unsigned>(duty_task_priority));
+	// The control path keeps its queue, task stacks and locks inside these
+	// objects, so they live in .bss rather than on this task's stack
+	static NvsStorageManager nv;
+	static SettingsManager settings(nv);
+	BootTimeline::mark(BootPhase::SettingsLoaded);
+
+	// Restore the outputs from saved settings before anything slow starts
+	static PWMControl pump(settings);
+	BootTimeline::mark(BootPhase::OutputRestored);
+	ESP_LOGI(TAG, "Output restored, duty is %g", settings.channels[0].duty);
+
+	// The clock survives a software reset, so schedules can run before NTP
+	setenv("TZ", settings.tz.c_str(), 1);
+	tzset();
+	static Scheduler scheduler(pump, settings);
+
+	SpeedController* speedController = nullptr;
+#if CONFIG_SPEED_CONTROL
+	static_assert(CONFIG_SPEED_CONTROL_CHANNEL < CONFIG_PWM_CHANNEL_COUNT, "Speed control channel does not exist");
+	SpeedControlConfig speedConfig;
+	speedConfig.channel = CONFIG_SPEED_CONTROL_CHANNEL;
+	speedConfig.tach_gpio = CONFIG_TACH_GPIO;
+	speedConfig.pulses_per_rev = CONFIG_TACH_PULSES_PER_REV;
+	speedConfig.period_ms = CONFIG_SPEED_CONTROL_PERIOD_MS;
+	speedConfig.window_ms = CONFIG_SPEED_TACH_WINDOW_MS;
+	speedConfig.gains.kp = CONFIG_SPEED_PID_KP_MILLI / 1000.0f;
+	speedConfig.gains.ki = CONFIG_SPEED_PID_KI_MILLI / 1000.0f;
+	speedConfig.gains.kd = CONFIG_SPEED_PID_KD_MILLI / 1000.0f;
+	static SpeedController speed(pump, speedConfig);
+	speedController = &speed;
+#endif
 
 	wifiSemaphore = xSemaphoreCreateBinary();
 	WiFiManager wifiManager(nv, localEventHandler, nullptr);
-	xTaskCreate(button_task, "button_task", 2048, &wifiManager, 10, NULL);
+	static ButtonWatcher button(static_cast<gpio_num_t>(CONFIG_BUTTON_PIN), onLongPress, &wifiManager);
+	button.start();
 
-	OTAUpdater ota(settings.otaUrl, [](int progress) {
+	OTAUpdater ota(settings.otaUrl.c_str(), [](int progress) {
 		ESP_LOGI("OTA", "%d", progress);
+		OtaService::onProgress(progress);
 	});
+	static OtaService otaService(ota, settings);
 
     if (xSemaphoreTake(wifiSemaphore, portMAX_DELAY) ) {
-		PWMControl pump(settings);
+		BootTimeline::mark(BootPhase::WifiConnected);
+		ESP_LOGI(TAG, "Main task continues after WiFi connection.");
 
-		ESP_LOGI(TAG, "Main task continues after WiFi connection. duty is %g", settings.duty);
-		initialize_sntp(settings);
-
-		static LocalWebContext  ctx{&wifiManager, &pump, &settings, &ota};
+		static LocalWebContext  ctx{&wifiManager, &pump, &settings, &ota, &otaService, &scheduler, speedController};
         static LocalWebServer webServer{&ctx};
 
         if (webServer.start() == ESP_OK) {
+            BootTimeline::mark(BootPhase::WebServerStarted);
             ESP_LOGI(TAG, "Web server started successfully.");
         } else {
             ESP_LOGE(TAG, "Failed to start web server.");
         }
 
+		xTaskCreate(sntp_task, "sntp_task", sntp_task_stack, &settings, 3, NULL);
+
+		// Stack watermarks only mean something once every task has had some work
+		TickType_t budgetDue = xTaskGetTickCount() + pdMS_TO_TICKS(MEMORY_BUDGET_DELAY_MS);
+		bool budgetLogged = false;
 		while (true) {
 			vTaskDelay(pdMS_TO_TICKS(100)); 
-		
+			if (!budgetLogged && static_cast<int32_t>(xTaskGetTickCount() - budgetDue) >= 0) {
+				logMemoryBudget();
+				budgetLogged = true;
+			}
 		}
 	}
 
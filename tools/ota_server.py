@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""Local OTA test rig.
+
+Serves a firmware image for pull updates, or pushes one to /ota/upload,
+while a prober keeps polling the device so handler responsiveness during
+the update can be measured. Reports transfer throughput and probe latency
+percentiles. Needs only the standard library.
+
+    tools/ota_server.py pull ${ESP_IP} build/condensor.bin --throttle 200
+    tools/ota_server.py push ${ESP_IP} build/condensor.bin --chunk 4096
+    tools/ota_server.py serve build/condensor.bin --port 8070     # just serve
+"""
+
+import argparse
+import http.client
+import http.server
+import json
+import os
+import socket
+import threading
+import time
+
+
+def percentile(values, fraction):
+    if not values:
+        return float("nan")
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def local_address(host):
+    """Address of the interface that routes to `host`."""
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as probe:
+        probe.connect((host, 80))
+        return probe.getsockname()[0]
+
+
+class Prober(threading.Thread):
+    """Polls a device path and records how long each answer takes."""
+
+    def __init__(self, host, port, path, interval):
+        super().__init__(daemon=True)
+        self.host, self.port, self.path, self.interval = host, port, path, interval
+        self.latencies_ms = []
+        self.failures = 0
+        self.last = None
+        self.stopping = threading.Event()
+
+    def run(self):
+        while not self.stopping.is_set():
+            started = time.perf_counter()
+            try:
+                conn = http.client.HTTPConnection(self.host, self.port, timeout=5)
+                conn.request("GET", self.path)
+                body = conn.getresponse().read()
+                self.latencies_ms.append((time.perf_counter() - started) * 1000.0)
+                try:
+                    self.last = json.loads(body)
+                except ValueError:
+                    pass
+                conn.close()
+            except OSError:
+                self.failures += 1
+            self.stopping.wait(self.interval)
+
+    def stop(self):
+        self.stopping.set()
+        self.join()
+
+    def report(self):
+        lat = self.latencies_ms
+        print(f"probe {self.path}: {len(lat)} answered, {self.failures} failed")
+        if lat:
+            print(f"  latency ms p50 {percentile(lat, 0.5):.1f}  p90 {percentile(lat, 0.9):.1f}"
+                  f"  p99 {percentile(lat, 0.99):.1f}  max {max(lat):.1f}")
+
+
+def make_handler(image, throttle_bps, stats):
+    class ImageHandler(http.server.BaseHTTPRequestHandler):
+        def do_GET(self):
+            self.send_response(200)
+            self.send_header("Content-Type", "application/octet-stream")
+            self.send_header("Content-Length", str(len(image)))
+            self.end_headers()
+            started = time.perf_counter()
+            sent = 0
+            try:
+                for offset in range(0, len(image), 4096):
+                    block = image[offset:offset + 4096]
+                    self.wfile.write(block)
+                    sent += len(block)
+                    if throttle_bps:
+                        ahead = sent / throttle_bps - (time.perf_counter() - started)
+                        if ahead > 0:
+                            time.sleep(ahead)
+            except OSError:
+                pass
+            elapsed = time.perf_counter() - started
+            stats.append((sent, elapsed))
+            print(f"served {sent} of {len(image)} bytes in {elapsed:.1f} s"
+                  f" ({sent / max(elapsed, 1e-6) / 1024:.1f} KiB/s)")
+
+        def log_message(self, fmt, *args):
+            pass
+
+    return ImageHandler
+
+
+def wait_for_finish(prober, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        state = (prober.last or {}).get("state")
+        if state in ("done", "failed"):
+            return prober.last
+        time.sleep(0.2)
+    return prober.last
+
+
+def serve(args):
+    image = open(args.image, "rb").read()
+    stats = []
+    server = http.server.ThreadingHTTPServer(("", args.port), make_handler(image, args.throttle * 1024, stats))
+    print(f"serving {args.image} ({len(image)} bytes) on port {args.port}")
+    thread = threading.Thread(target=server.serve_forever, daemon=True)
+    thread.start()
+    return server, stats
+
+
+def pull(args):
+    server, stats = serve(args)
+    url = f"http://{local_address(args.host)}:{args.port}/{os.path.basename(args.image)}"
+    prober = Prober(args.host, args.device_port, args.probe, args.interval)
+    prober.start()
+    conn = http.client.HTTPConnection(args.host, args.device_port, timeout=10)
+    conn.request("POST", "/ota", json.dumps({"ota_url": url}), {"Content-Type": "application/json"})
+    response = conn.getresponse()
+    print(f"/ota -> {response.status} {response.read().decode(errors='replace')}")
+    final = wait_for_finish(prober, args.timeout)
+    prober.stop()
+    server.shutdown()
+    print(f"final status: {final}")
+    prober.report()
+
+
+def push(args):
+    size = os.path.getsize(args.image)
+    prober = Prober(args.host, args.device_port, args.probe, args.interval)
+    prober.start()
+    conn = http.client.HTTPConnection(args.host, args.device_port, timeout=60)
+    conn.putrequest("POST", "/ota/upload")
+    conn.putheader("Content-Type", "application/octet-stream")
+    conn.putheader("Content-Length", str(size))
+    conn.endheaders()
+    started = time.perf_counter()
+    sent = 0
+    with open(args.image, "rb") as image:
+        while True:
+            block = image.read(args.chunk)
+            if not block:
+                break
+            conn.send(block)
+            sent += len(block)
+    response = conn.getresponse()
+    elapsed = time.perf_counter() - started
+    print(f"/ota/upload -> {response.status} {response.read().decode(errors='replace')}")
+    print(f"pushed {sent} bytes in {elapsed:.1f} s ({sent / max(elapsed, 1e-6) / 1024:.1f} KiB/s)")
+    prober.stop()
+    prober.report()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    def common(p, device=True):
+        if device:
+            p.add_argument("host", help="device address")
+        p.add_argument("image", help="firmware .bin")
+        p.add_argument("--device-port", type=int, default=80)
+        p.add_argument("--probe", default="/ota/status", help="path polled during the update")
+        p.add_argument("--interval", type=float, default=0.1, help="seconds between probes")
+        p.add_argument("--timeout", type=float, default=300)
+
+    p = sub.add_parser("pull", help="serve the image and ask the device to pull it")
+    common(p)
+    p.add_argument("--port", type=int, default=8070)
+    p.add_argument("--throttle", type=float, default=0, help="KiB/s, 0 for unlimited")
+
+    p = sub.add_parser("push", help="stream the image to /ota/upload")
+    common(p)
+    p.add_argument("--chunk", type=int, default=4096, help="bytes per send")
+
+    p = sub.add_parser("serve", help="only serve the image")
+    common(p, device=False)
+    p.add_argument("--port", type=int, default=8070)
+    p.add_argument("--throttle", type=float, default=0, help="KiB/s, 0 for unlimited")
+
+    args = parser.parse_args()
+    if args.command == "pull":
+        pull(args)
+    elif args.command == "push":
+        push(args)
+    else:
+        server, _ = serve(args)
+        try:
+            while True:
+                time.sleep(1)
+        except KeyboardInterrupt:
+            server.shutdown()
+
+
+if __name__ == "__main__":
+    main()
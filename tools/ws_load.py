@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Load generator for the /ws control channel.
+
+Streams duty frames at a fixed rate (or as fast as acks allow) and reports
+the sustained update rate and end-to-end latency, measured from sending a
+frame to receiving its ack.
+
+    pip install websockets
+    tools/ws_load.py ${ESP_IP} --rate 100 --duration 30
+    tools/ws_load.py ${ESP_IP} --rate 0 --window 4      # saturate
+"""
+
+import argparse
+import asyncio
+import struct
+import time
+
+import websockets
+
+COMMAND = struct.Struct("<IBBHI")      # ControlCommandFrame
+ACK = struct.Struct("<IIBBHIII")       # ControlAckFrame
+OP_DUTY = 1
+STATUS_NAMES = ["ok", "pending", "busy", "bad_frame", "bad_channel", "bad_value"]
+
+
+def percentile(values, fraction):
+    if not values:
+        return float("nan")
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+async def run(args):
+    uri = f"ws://{args.host}:{args.port}/ws"
+    sent = {}
+    latencies_ms = []
+    apply_us = []
+    statuses = {}
+    window = asyncio.Semaphore(args.window)
+    done = asyncio.Event()
+
+    async with websockets.connect(uri, max_queue=None) as ws:
+        async def receiver():
+            while not done.is_set() or sent:
+                try:
+                    message = await asyncio.wait_for(ws.recv(), timeout=2.0)
+                except asyncio.TimeoutError:
+                    break
+                now = time.perf_counter()
+                client_seq, _, status, _, _, _, _, device_us = ACK.unpack(message)
+                started = sent.pop(client_seq, None)
+                if started is None:
+                    continue
+                window.release()
+                latencies_ms.append((now - started) * 1000.0)
+                apply_us.append(device_us)
+                name = STATUS_NAMES[status] if status < len(STATUS_NAMES) else str(status)
+                statuses[name] = statuses.get(name, 0) + 1
+
+        receive_task = asyncio.create_task(receiver())
+        interval = 1.0 / args.rate if args.rate > 0 else 0.0
+        start = time.perf_counter()
+        next_send = start
+        seq = 0
+        while time.perf_counter() - start < args.duration:
+            await window.acquire()
+            if interval:
+                delay = next_send - time.perf_counter()
+                if delay > 0:
+                    await asyncio.sleep(delay)
+                next_send += interval
+            seq += 1
+            # Sweep the duty so every frame really changes the output
+            duty_centi = int((seq % 200) * 50)
+            frame = COMMAND.pack(seq, OP_DUTY, args.channel, 0, duty_centi)
+            sent[seq] = time.perf_counter()
+            await ws.send(frame)
+        elapsed = time.perf_counter() - start
+        done.set()
+        await receive_task
+
+    acked = len(latencies_ms)
+    print(f"sent {seq} frames in {elapsed:.1f} s, {acked} acked, {len(sent)} lost")
+    print(f"sustained rate: {acked / elapsed:.1f} updates/s")
+    print("round trip ms: p50 {:.2f}  p95 {:.2f}  p99 {:.2f}  max {:.2f}".format(
+        percentile(latencies_ms, 0.50), percentile(latencies_ms, 0.95),
+        percentile(latencies_ms, 0.99), max(latencies_ms, default=float("nan"))))
+    print("on-device apply us: p50 {}  p99 {}  max {}".format(
+        percentile(apply_us, 0.50), percentile(apply_us, 0.99), max(apply_us, default=0)))
+    print("status:", ", ".join(f"{name} {count}" for name, count in sorted(statuses.items())))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--channel", type=int, default=0)
+    parser.add_argument("--rate", type=float, default=50.0, help="frames per second, 0 for as fast as possible")
+    parser.add_argument("--duration", type=float, default=10.0, help="seconds")
+    parser.add_argument("--window", type=int, default=8, help="frames allowed in flight")
+    asyncio.run(run(parser.parse_args()))
+
+
+if __name__ == "__main__":
+    main()